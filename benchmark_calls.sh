@@ -0,0 +1,57 @@
+#!/usr/bin/env bash
+
+# Микробенчмарк вызовов (performance/Calls.lama) и Sort.lama, в котором
+# преобладают рекурсивные вызовы inner/rec: время текущего lvm по сравнению
+# с lvm, собранным из ревизии BASE_REV (по умолчанию HEAD~1 - до кэшей мест
+# вызова CALL/CALLC).
+
+source "$(dirname "$0")/benchmark_lib.sh"
+
+BASE_REV="${BASE_REV:-HEAD~1}"
+
+LVM_NEW="$PROJECT_DIR/build-calls/lvm"
+LVM_BASE="$PROJECT_DIR/build-base-src/build/lvm"
+
+# Вызовов за запуск Calls.lama: по 2692537 в fib (30) и в closureFib (30, 1)
+CALLS=5385074
+
+echo "=== Building lvm (current tree and $BASE_REV) ==="
+build_lvm build-calls
+build_base "$BASE_REV"
+echo ""
+
+compile Calls
+compile Sort
+
+echo "=== Call overhead ($RUNS runs each) ==="
+
+for STEM in Calls Sort; do
+    BC="$PROJECT_DIR/performance/$STEM.bc"
+
+    OUT_BASE=$("$LVM_BASE" "$BC" 2>&1)
+    OUT_NEW=$("$LVM_NEW" "$BC" 2>&1)
+    if [ "$OUT_BASE" != "$OUT_NEW" ]; then
+        echo "✗ $STEM.bc: outputs differ between $BASE_REV and current tree"
+        exit 1
+    fi
+
+    TIME_BASE=$(measure_time "\"$LVM_BASE\" \"$BC\" > /dev/null" $RUNS)
+    TIME_NEW=$(measure_time "\"$LVM_NEW\" \"$BC\" > /dev/null" $RUNS)
+    TIME_TRUSTED=$(measure_time "\"$LVM_NEW\" --trusted \"$BC\" > /dev/null" $RUNS)
+
+    echo ""
+    echo "$STEM.lama:"
+    for ROW in "$BASE_REV:        |$TIME_BASE" "current:          |$TIME_NEW" \
+               "current --trusted:|$TIME_TRUSTED"; do
+        NAME="${ROW%|*}"
+        TIME="${ROW#*|}"
+        if [ "$STEM" = "Calls" ]; then
+            echo "  $NAME ${TIME}s, $(echo "$CALLS / $TIME / 1000000" | bc -l | awk '{printf "%.1f", $1}')M calls/s"
+        else
+            echo "  $NAME ${TIME}s"
+        fi
+    done
+    echo "  speedup: $(echo "$TIME_BASE / $TIME_NEW" | bc -l | awk '{printf "%.2f", $1}')x"
+done
+
+remove_base
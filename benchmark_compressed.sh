@@ -0,0 +1,80 @@
+#!/usr/bin/env bash
+
+# Сжатые ссылки (-DLVM_COMPRESSED_REFS=ON, 32-битные слова кучи) по
+# сравнению с обычной 64-битной сборкой: пиковый RSS и время на Sort.lama
+# и регрессионном корпусе. Куча по умолчанию не собирается на этих
+# программах, так что RSS - это объем выделенных объектов.
+
+source "$(dirname "$0")/benchmark_lib.sh"
+
+LVM_WIDE="$PROJECT_DIR/build-wide/lvm"
+LVM_COMP="$PROJECT_DIR/build-compressed/lvm"
+
+echo "=== Building lvm ==="
+build_lvm build-wide
+build_lvm build-compressed -DLVM_COMPRESSED_REFS=ON
+echo ""
+
+compile Sort
+SORT_BC="$PROJECT_DIR/performance/Sort.bc"
+
+echo "=== Performance Benchmark: Sort.lama ($RUNS runs each) ==="
+echo ""
+
+OUT_WIDE=$("$LVM_WIDE" "$SORT_BC" 2>&1)
+OUT_COMP=$("$LVM_COMP" "$SORT_BC" 2>&1)
+if [ "$OUT_WIDE" != "$OUT_COMP" ]; then
+    echo "✗ Sort.bc: outputs differ between the builds"
+    exit 1
+fi
+
+for MODE in "" --jit; do
+    RSS_WIDE=$(measure_rss "\"$LVM_WIDE\" $MODE \"$SORT_BC\" > /dev/null")
+    RSS_COMP=$(measure_rss "\"$LVM_COMP\" $MODE \"$SORT_BC\" > /dev/null")
+    TIME_WIDE=$(measure_time "\"$LVM_WIDE\" $MODE \"$SORT_BC\" > /dev/null" $RUNS)
+    TIME_COMP=$(measure_time "\"$LVM_COMP\" $MODE \"$SORT_BC\" > /dev/null" $RUNS)
+    echo "  ${MODE:-interpreter}:"
+    echo "    64-bit words: ${TIME_WIDE}s, ${RSS_WIDE} KB peak RSS"
+    echo "    compressed:   ${TIME_COMP}s, ${RSS_COMP} KB peak RSS"
+    echo "    footprint:    $(echo "100 * ($RSS_WIDE - $RSS_COMP) / $RSS_WIDE" | bc -l | awk '{printf "-%.1f%%", $1}')"
+    echo "    speedup:      $(echo "$TIME_WIDE / $TIME_COMP" | bc -l | awk '{printf "%.2f", $1}')x"
+done
+echo ""
+
+# Регрессионные тесты: числа в сжатой куче 31-битные, поэтому программы
+# с расходящимся выводом пропускаются
+echo "=== Regression corpus ==="
+echo ""
+
+TOTAL_RSS_WIDE=0
+TOTAL_RSS_COMP=0
+TOTAL_WIDE=0
+TOTAL_COMP=0
+for FILE_PATH in "$BUILD_DIR"/*.lama; do
+    FILE_NAME="$(basename "$FILE_PATH")"
+    STEM="${FILE_NAME%.*}"
+    BC_FILE="$BUILD_DIR/$STEM.bc"
+    INPUT="$BUILD_DIR/$STEM.input"
+    [ -f "$BC_FILE" ] || continue
+    [ -f "$INPUT" ] || INPUT=/dev/null
+
+    OUT_WIDE=$("$LVM_WIDE" "$BC_FILE" < "$INPUT" 2>&1)
+    OUT_COMP=$("$LVM_COMP" "$BC_FILE" < "$INPUT" 2>&1)
+    if [ "$OUT_WIDE" != "$OUT_COMP" ]; then
+        echo "✗ $STEM: outputs differ"
+        continue
+    fi
+
+    RSS_WIDE=$(measure_rss "\"$LVM_WIDE\" \"$BC_FILE\" < \"$INPUT\" > /dev/null")
+    RSS_COMP=$(measure_rss "\"$LVM_COMP\" \"$BC_FILE\" < \"$INPUT\" > /dev/null")
+    T_WIDE=$(measure_time "\"$LVM_WIDE\" \"$BC_FILE\" < \"$INPUT\" > /dev/null" 3)
+    T_COMP=$(measure_time "\"$LVM_COMP\" \"$BC_FILE\" < \"$INPUT\" > /dev/null" 3)
+    TOTAL_RSS_WIDE=$((TOTAL_RSS_WIDE + RSS_WIDE))
+    TOTAL_RSS_COMP=$((TOTAL_RSS_COMP + RSS_COMP))
+    TOTAL_WIDE=$(echo "$TOTAL_WIDE + $T_WIDE" | bc -l)
+    TOTAL_COMP=$(echo "$TOTAL_COMP + $T_COMP" | bc -l)
+    echo "  $STEM: 64-bit ${T_WIDE}s/${RSS_WIDE} KB, compressed ${T_COMP}s/${RSS_COMP} KB"
+done
+
+echo ""
+echo "Total: 64-bit $(printf "%.3f" $TOTAL_WIDE)s/$TOTAL_RSS_WIDE KB, compressed $(printf "%.3f" $TOTAL_COMP)s/$TOTAL_RSS_COMP KB"
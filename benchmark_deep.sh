@@ -0,0 +1,65 @@
+#!/usr/bin/env bash
+
+# Копирование без рекурсии (обход Чейни по to-space): время и время GC на
+# DeepList.lama (списки по миллиону элементов, живые во время сборок) и
+# Sort.lama, с молодым поколением и без него (LVM_NURSERY_KB=0), плюс
+# регрессионный корпус. Глубина C-стека сборщика от формы кучи больше не
+# зависит, поэтому DeepList проходит и с маленьким стеком (ulimit -s).
+
+source "$(dirname "$0")/benchmark_lib.sh"
+
+LVM="$PROJECT_DIR/build-deep/lvm"
+
+echo "=== Building lvm ==="
+build_lvm build-deep
+echo ""
+
+compile DeepList
+compile Sort
+
+for NAME in DeepList Sort; do
+    BC="$PROJECT_DIR/performance/$NAME.bc"
+    echo "=== Performance Benchmark: $NAME.lama ($RUNS runs each) ==="
+    echo ""
+
+    OUT=$("$LVM" "$BC" 2>&1)
+    OUT_SMALL=$(ulimit -s 256 && "$LVM" "$BC" 2>&1)
+    if [ "$OUT" != "$OUT_SMALL" ]; then
+        echo "✗ $NAME.bc: outputs differ with a 256 KB C stack"
+        exit 1
+    fi
+
+    for MODE in "" --jit; do
+        GC_FLAT=$(gc_ms "LVM_NURSERY_KB=0 \"$LVM\" $MODE \"$BC\"")
+        GC_GEN=$(gc_ms "\"$LVM\" $MODE \"$BC\"")
+        TIME_FLAT=$(measure_time "LVM_NURSERY_KB=0 \"$LVM\" $MODE \"$BC\" > /dev/null" $RUNS)
+        TIME_GEN=$(measure_time "\"$LVM\" $MODE \"$BC\" > /dev/null" $RUNS)
+        echo "  ${MODE:-interpreter}:"
+        echo "    semispace only: ${TIME_FLAT}s total, ${GC_FLAT} ms GC"
+        echo "    generational:   ${TIME_GEN}s total, ${GC_GEN} ms GC"
+    done
+    echo ""
+done
+
+echo "=== Regression corpus ==="
+echo ""
+
+TOTAL=0
+TOTAL_GC=0
+for FILE_PATH in "$BUILD_DIR"/*.lama; do
+    FILE_NAME="$(basename "$FILE_PATH")"
+    STEM="${FILE_NAME%.*}"
+    BC_FILE="$BUILD_DIR/$STEM.bc"
+    INPUT="$BUILD_DIR/$STEM.input"
+    [ -f "$BC_FILE" ] || continue
+    [ -f "$INPUT" ] || INPUT=/dev/null
+
+    GC=$(gc_ms "\"$LVM\" \"$BC_FILE\" < \"$INPUT\"")
+    T=$(measure_time "\"$LVM\" \"$BC_FILE\" < \"$INPUT\" > /dev/null" 3)
+    TOTAL=$(echo "$TOTAL + $T" | bc -l)
+    TOTAL_GC=$(echo "$TOTAL_GC + ${GC:-0}" | bc -l)
+    echo "  $STEM: ${T}s, ${GC} ms GC"
+done
+
+echo ""
+echo "Total: $(printf "%.3f" $TOTAL)s, $(printf "%.3f" $TOTAL_GC) ms GC"
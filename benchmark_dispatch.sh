@@ -0,0 +1,68 @@
+#!/usr/bin/env bash
+
+# Сравнение двух вариантов диспетчеризации в eval():
+#   switch   - прежний цикл с вложенными switch (-DLVM_THREADED_DISPATCH=OFF)
+#   threaded - computed goto, обработчик на каждый байт опкода (по умолчанию)
+
+source "$(dirname "$0")/benchmark_lib.sh"
+
+LVM_SWITCH="$PROJECT_DIR/build-switch/lvm"
+LVM_THREADED="$PROJECT_DIR/build-threaded/lvm"
+
+# Собираем оба варианта интерпретатора
+echo "=== Building lvm (switch / threaded) ==="
+build_lvm build-switch -DLVM_THREADED_DISPATCH=OFF
+build_lvm build-threaded -DLVM_THREADED_DISPATCH=ON
+echo ""
+
+# Sort.lama
+echo "=== Performance Benchmark: Sort.lama ($RUNS runs each) ==="
+echo ""
+
+compile Sort
+SORT_BC="$PROJECT_DIR/performance/Sort.bc"
+
+OUT_SWITCH=$("$LVM_SWITCH" "$SORT_BC" 2>&1)
+OUT_THREADED=$("$LVM_THREADED" "$SORT_BC" 2>&1)
+if [ "$OUT_SWITCH" != "$OUT_THREADED" ]; then
+    echo "✗ Sort.bc: outputs differ between switch and threaded builds"
+    exit 1
+fi
+
+TIME_SWITCH=$(measure_time "\"$LVM_SWITCH\" \"$SORT_BC\" > /dev/null" $RUNS)
+TIME_THREADED=$(measure_time "\"$LVM_THREADED\" \"$SORT_BC\" > /dev/null" $RUNS)
+echo "  switch:   ${TIME_SWITCH}s"
+echo "  threaded: ${TIME_THREADED}s"
+echo "  speedup:  $(echo "$TIME_SWITCH / $TIME_THREADED" | bc -l | awk '{printf "%.2f", $1}')x"
+echo ""
+
+# Регрессионные тесты: сначала проверяем совпадение вывода, затем время
+echo "=== Regression corpus ==="
+echo ""
+
+TOTAL_SWITCH=0
+TOTAL_THREADED=0
+for FILE_PATH in "$BUILD_DIR"/*.lama; do
+    FILE_NAME="$(basename "$FILE_PATH")"
+    STEM="${FILE_NAME%.*}"
+    BC_FILE="$BUILD_DIR/$STEM.bc"
+    INPUT="$BUILD_DIR/$STEM.input"
+    [ -f "$BC_FILE" ] || continue
+    [ -f "$INPUT" ] || INPUT=/dev/null
+
+    OUT_SWITCH=$("$LVM_SWITCH" "$BC_FILE" < "$INPUT" 2>&1)
+    OUT_THREADED=$("$LVM_THREADED" "$BC_FILE" < "$INPUT" 2>&1)
+    if [ "$OUT_SWITCH" != "$OUT_THREADED" ]; then
+        echo "✗ $STEM: outputs differ"
+        continue
+    fi
+
+    T_SWITCH=$(measure_time "\"$LVM_SWITCH\" \"$BC_FILE\" < \"$INPUT\" > /dev/null" 3)
+    T_THREADED=$(measure_time "\"$LVM_THREADED\" \"$BC_FILE\" < \"$INPUT\" > /dev/null" 3)
+    TOTAL_SWITCH=$(echo "$TOTAL_SWITCH + $T_SWITCH" | bc -l)
+    TOTAL_THREADED=$(echo "$TOTAL_THREADED + $T_THREADED" | bc -l)
+    echo "  $STEM: switch ${T_SWITCH}s, threaded ${T_THREADED}s"
+done
+
+echo ""
+echo "Total: switch $(printf "%.3f" $TOTAL_SWITCH)s, threaded $(printf "%.3f" $TOTAL_THREADED)s"
@@ -0,0 +1,75 @@
+#!/usr/bin/env bash
+
+# Поколенческая сборка по сравнению с одной полукопирующей: время GC и
+# общее время на Sort.lama и регрессионном корпусе. Один и тот же lvm:
+# LVM_NURSERY_KB=0 отключает молодое поколение, LVM_GC_STATS=1 печатает
+# число сборок и время в них.
+
+source "$(dirname "$0")/benchmark_lib.sh"
+
+LVM="$PROJECT_DIR/build-gc/lvm"
+
+echo "=== Building lvm ==="
+build_lvm build-gc
+echo ""
+
+compile Sort
+SORT_BC="$PROJECT_DIR/performance/Sort.bc"
+
+echo "=== Performance Benchmark: Sort.lama ($RUNS runs each) ==="
+echo ""
+
+OUT_FLAT=$(LVM_NURSERY_KB=0 "$LVM" "$SORT_BC" 2>&1)
+OUT_GEN=$("$LVM" "$SORT_BC" 2>&1)
+if [ "$OUT_FLAT" != "$OUT_GEN" ]; then
+    echo "✗ Sort.bc: outputs differ with and without the nursery"
+    exit 1
+fi
+
+for MODE in "" --jit; do
+    GC_FLAT=$(gc_ms "LVM_NURSERY_KB=0 \"$LVM\" $MODE \"$SORT_BC\"")
+    GC_GEN=$(gc_ms "\"$LVM\" $MODE \"$SORT_BC\"")
+    TIME_FLAT=$(measure_time "LVM_NURSERY_KB=0 \"$LVM\" $MODE \"$SORT_BC\" > /dev/null" $RUNS)
+    TIME_GEN=$(measure_time "\"$LVM\" $MODE \"$SORT_BC\" > /dev/null" $RUNS)
+    echo "  ${MODE:-interpreter}:"
+    echo "    semispace only: ${TIME_FLAT}s total, ${GC_FLAT} ms GC"
+    echo "    generational:   ${TIME_GEN}s total, ${GC_GEN} ms GC"
+    echo "    speedup:        $(echo "$TIME_FLAT / $TIME_GEN" | bc -l | awk '{printf "%.2f", $1}')x"
+done
+echo ""
+
+echo "=== Regression corpus ==="
+echo ""
+
+TOTAL_FLAT=0
+TOTAL_GEN=0
+TOTAL_GC_FLAT=0
+TOTAL_GC_GEN=0
+for FILE_PATH in "$BUILD_DIR"/*.lama; do
+    FILE_NAME="$(basename "$FILE_PATH")"
+    STEM="${FILE_NAME%.*}"
+    BC_FILE="$BUILD_DIR/$STEM.bc"
+    INPUT="$BUILD_DIR/$STEM.input"
+    [ -f "$BC_FILE" ] || continue
+    [ -f "$INPUT" ] || INPUT=/dev/null
+
+    OUT_FLAT=$(LVM_NURSERY_KB=0 "$LVM" "$BC_FILE" < "$INPUT" 2>&1)
+    OUT_GEN=$("$LVM" "$BC_FILE" < "$INPUT" 2>&1)
+    if [ "$OUT_FLAT" != "$OUT_GEN" ]; then
+        echo "✗ $STEM: outputs differ"
+        continue
+    fi
+
+    GC_FLAT=$(gc_ms "LVM_NURSERY_KB=0 \"$LVM\" \"$BC_FILE\" < \"$INPUT\"")
+    GC_GEN=$(gc_ms "\"$LVM\" \"$BC_FILE\" < \"$INPUT\"")
+    T_FLAT=$(measure_time "LVM_NURSERY_KB=0 \"$LVM\" \"$BC_FILE\" < \"$INPUT\" > /dev/null" 3)
+    T_GEN=$(measure_time "\"$LVM\" \"$BC_FILE\" < \"$INPUT\" > /dev/null" 3)
+    TOTAL_FLAT=$(echo "$TOTAL_FLAT + $T_FLAT" | bc -l)
+    TOTAL_GEN=$(echo "$TOTAL_GEN + $T_GEN" | bc -l)
+    TOTAL_GC_FLAT=$(echo "$TOTAL_GC_FLAT + ${GC_FLAT:-0}" | bc -l)
+    TOTAL_GC_GEN=$(echo "$TOTAL_GC_GEN + ${GC_GEN:-0}" | bc -l)
+    echo "  $STEM: semispace ${T_FLAT}s/${GC_FLAT} ms GC, generational ${T_GEN}s/${GC_GEN} ms GC"
+done
+
+echo ""
+echo "Total: semispace $(printf "%.3f" $TOTAL_FLAT)s/$(printf "%.3f" $TOTAL_GC_FLAT) ms GC, generational $(printf "%.3f" $TOTAL_GEN)s/$(printf "%.3f" $TOTAL_GC_GEN) ms GC"
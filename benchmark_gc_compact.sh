@@ -0,0 +1,60 @@
+#!/usr/bin/env bash
+
+# Уплотняющая сборка старого поколения по сравнению с копирующей: пиковый
+# RSS, время и число сборок на Churn.lama, Trees.lama, DeepList.lama и
+# Sort.lama. LVM_GC_COMPACT=100 - только копирование, 0 - только
+# уплотнение, без переменной - выбор по заполненности. Куча по умолчанию
+# на этих программах не заполняется, поэтому lvm собирается с начальным
+# размером пространства SPACE_WORDS слов (-DLVM_SPACE_SIZE).
+
+source "$(dirname "$0")/benchmark_lib.sh"
+
+SPACE_WORDS="${SPACE_WORDS:-1048576}"
+
+LVM="$PROJECT_DIR/build-gc-compact/lvm"
+
+# Число полных сборок и уплотняющих среди них из строки
+# "gc stats: ..., M major (Y ms), C of them compacting; ..."
+majors() {
+    LVM_GC_STATS=1 sh -c "$1" 2>&1 > /dev/null | grep "^gc stats:" |
+        awk '{
+            n = 0; c = 0
+            for (i = 1; i <= NF; i++) {
+                if ($i == "major") n = $(i - 1)
+                if ($i ~ /^compacting/) c = $(i - 3)
+            }
+            print n, c
+        }'
+}
+
+echo "=== Building lvm ==="
+build_lvm build-gc-compact -DCMAKE_C_FLAGS="-DLVM_SPACE_SIZE=$SPACE_WORDS"
+echo ""
+
+for NAME in Churn Trees DeepList Sort; do
+    compile $NAME
+    BC="$PROJECT_DIR/performance/$NAME.bc"
+    echo "=== Mark-compact: $NAME.lama ($RUNS runs each) ==="
+    echo ""
+
+    OUT=$(LVM_GC_COMPACT=100 "$LVM" "$BC" 2>&1)
+    OUT_MC=$(LVM_GC_COMPACT=0 "$LVM" "$BC" 2>&1)
+    if [ "$OUT" != "$OUT_MC" ]; then
+        echo "✗ $NAME.bc: outputs differ with and without compaction"
+        exit 1
+    fi
+
+    for MODE in copying compacting adaptive; do
+        case $MODE in
+            copying)    ENV="LVM_GC_COMPACT=100" ;;
+            compacting) ENV="LVM_GC_COMPACT=0" ;;
+            adaptive)   ENV="" ;;
+        esac
+        read N C <<< "$(majors "$ENV \"$LVM\" \"$BC\"")"
+        RSS=$(measure_rss "$ENV \"$LVM\" \"$BC\" > /dev/null")
+        TIME=$(measure_time "$ENV \"$LVM\" \"$BC\" > /dev/null" $RUNS)
+        printf "  %-11s %ss, %s KB peak RSS, %s major collections (%s compacting)\n" \
+               "$MODE:" "$TIME" "$RSS" "$N" "$C"
+    done
+    echo ""
+done
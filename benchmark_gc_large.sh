@@ -0,0 +1,42 @@
+#!/usr/bin/env bash
+
+# Пространство больших объектов: время, время в сборках, число полных
+# сборок и пиковый RSS на Buffers.lama (несколько больших живых строк),
+# Churn.lama, Trees.lama и Sort.lama - с пространством (по умолчанию,
+# объекты от LVM_GC_LARGE_KB) и без него (LVM_GC_LARGE_KB=0, все объекты
+# копируются, как раньше).
+
+source "$(dirname "$0")/benchmark_lib.sh"
+
+LVM="$PROJECT_DIR/build-gc-large/lvm"
+
+echo "=== Building lvm ==="
+build_lvm build-gc-large
+echo ""
+
+for NAME in Buffers Churn Trees Sort; do
+    compile $NAME
+    BC="$PROJECT_DIR/performance/$NAME.bc"
+    echo "=== Large objects: $NAME.lama ($RUNS runs each) ==="
+    echo ""
+
+    OUT=$(LVM_GC_LARGE_KB=0 "$LVM" "$BC" 2>&1)
+    OUT_LARGE=$("$LVM" "$BC" 2>&1)
+    if [ "$OUT" != "$OUT_LARGE" ]; then
+        echo "✗ $NAME.bc: outputs differ with and without the large-object space"
+        exit 1
+    fi
+
+    for MODE in copied large; do
+        case $MODE in
+            copied) ENV="LVM_GC_LARGE_KB=0" ;;
+            large)  ENV="" ;;
+        esac
+        read MS N <<< "$(gc_ms_majors "$ENV \"$LVM\" \"$BC\"")"
+        RSS=$(measure_rss "$ENV \"$LVM\" \"$BC\" > /dev/null")
+        TIME=$(measure_time "$ENV \"$LVM\" \"$BC\" > /dev/null" $RUNS)
+        printf "  %-7s %ss, %s ms GC, %s major collections, %s KB peak RSS\n" \
+               "$MODE:" "$TIME" "$MS" "$N" "$RSS"
+    done
+    echo ""
+done
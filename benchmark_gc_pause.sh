@@ -0,0 +1,63 @@
+#!/usr/bin/env bash
+
+# Инкрементальная сборка старого поколения (LVM_GC_PAUSE_US): паузы p50,
+# p99 и максимальная, время в сборках и общее время на Trees.lama,
+# DeepList.lama и Sort.lama - без нее и с шагами по PAUSE_US микросекунд
+# (по умолчанию 500). Паузы - из строки "pauses: ..." статистики
+# LVM_GC_STATS=1, берется худший из запусков.
+
+source "$(dirname "$0")/benchmark_lib.sh"
+
+PAUSE_US="${PAUSE_US:-500}"
+
+LVM="$PROJECT_DIR/build-gc-pause/lvm"
+
+# Время в сборках (мс, среднее) и паузы p50/p99/max (мс, худшие) по
+# нескольким запускам
+gc_pauses() {
+    local cmd="$1"
+    local runs="${2:-5}"
+    for i in $(seq 1 $runs); do
+        LVM_GC_STATS=1 sh -c "$cmd" 2>&1 > /dev/null | grep "^gc stats:" |
+            awk '{
+                ms = 0
+                for (i = 1; i <= NF; i++) {
+                    if ($i ~ /^\(/ && $(i + 1) ~ /^ms/) ms += substr($i, 2)
+                    if ($i == "p50") p50 = $(i + 1)
+                    if ($i == "p99") p99 = $(i + 1)
+                    if ($i == "max") max = $(i + 1)
+                }
+                print ms, p50, p99, max
+            }'
+    done | awk '{ ms += $1; if ($2 > p50) p50 = $2; if ($3 > p99) p99 = $3; if ($4 > max) max = $4 }
+                END { printf "%.3f %.3f %.3f %.3f", ms / NR, p50, p99, max }'
+}
+
+echo "=== Building lvm ==="
+build_lvm build-gc-pause
+echo ""
+
+for NAME in Trees DeepList Sort; do
+    compile $NAME
+    BC="$PROJECT_DIR/performance/$NAME.bc"
+    echo "=== GC pauses: $NAME.lama ($RUNS runs each) ==="
+    echo ""
+
+    OUT=$("$LVM" "$BC" 2>&1)
+    OUT_INC=$(LVM_GC_PAUSE_US=$PAUSE_US "$LVM" "$BC" 2>&1)
+    if [ "$OUT" != "$OUT_INC" ]; then
+        echo "✗ $NAME.bc: outputs differ with LVM_GC_PAUSE_US=$PAUSE_US"
+        exit 1
+    fi
+
+    for P in "" $PAUSE_US; do
+        read MS P50 P99 MAX <<< "$(gc_pauses "LVM_GC_PAUSE_US=$P \"$LVM\" \"$BC\"" $RUNS)"
+        TIME=$(measure_time "LVM_GC_PAUSE_US=$P \"$LVM\" \"$BC\" > /dev/null" $RUNS)
+        if [ -z "$P" ]; then
+            echo "  stop-the-world:     ${TIME}s total, ${MS} ms GC, pauses p50 ${P50} / p99 ${P99} / max ${MAX} ms"
+        else
+            echo "  incremental ${P} us: ${TIME}s total, ${MS} ms GC, pauses p50 ${P50} / p99 ${P99} / max ${MAX} ms"
+        fi
+    done
+    echo ""
+done
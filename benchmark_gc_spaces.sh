@@ -0,0 +1,51 @@
+#!/usr/bin/env bash
+
+# Повторное использование полупространств: число page faults, время в
+# сборках, общее время и пиковый RSS на Sort.lama, Trees.lama и
+# DeepList.lama при LVM_GC_RELEASE=unmap (пространство отображается и
+# снимается на каждую сборку, как раньше), dontneed (по умолчанию) и free.
+# Молодое поколение отключено, а начальная куча мала (HEAP_INIT), чтобы
+# каждая сборка копировала пространство целиком и сборок было много.
+
+source "$(dirname "$0")/benchmark_lib.sh"
+
+HEAP_INIT="${HEAP_INIT:-4M}"
+
+LVM="$PROJECT_DIR/build-gc-spaces/lvm"
+
+# Пиковый RSS в KB и число page faults (без обращения к диску)
+measure_rss_faults() {
+    { /usr/bin/time -f "rss %M %R" sh -c "$1" 2>&1; } | grep "^rss" | awk '{print $2, $3}'
+}
+
+echo "=== Building lvm ==="
+build_lvm build-gc-spaces
+echo ""
+
+ENV_BASE="LVM_NURSERY_KB=0 LVM_HEAP_INIT=$HEAP_INIT"
+
+for NAME in Sort Trees DeepList; do
+    compile $NAME
+    BC="$PROJECT_DIR/performance/$NAME.bc"
+    echo "=== Semispace reuse: $NAME.lama ($RUNS runs each) ==="
+    echo ""
+
+    OUT=$(env $ENV_BASE LVM_GC_RELEASE=unmap "$LVM" "$BC" 2>&1)
+    for R in dontneed free; do
+        OUT_R=$(env $ENV_BASE LVM_GC_RELEASE=$R "$LVM" "$BC" 2>&1)
+        if [ "$OUT" != "$OUT_R" ]; then
+            echo "✗ $NAME.bc: outputs differ with LVM_GC_RELEASE=$R"
+            exit 1
+        fi
+    done
+
+    for R in unmap dontneed free; do
+        CMD="env $ENV_BASE LVM_GC_RELEASE=$R \"$LVM\" \"$BC\""
+        read MS N <<< "$(gc_ms_majors "$CMD")"
+        read RSS FAULTS <<< "$(measure_rss_faults "$CMD > /dev/null")"
+        TIME=$(measure_time "$CMD > /dev/null" $RUNS)
+        printf "  %-9s %ss, %s ms GC in %s collections, %s page faults, %s KB peak RSS\n" \
+               "$R:" "$TIME" "$MS" "$N" "$FAULTS" "$RSS"
+    done
+    echo ""
+done
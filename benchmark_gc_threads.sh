@@ -0,0 +1,50 @@
+#!/usr/bin/env bash
+
+# Параллельная сборка: время GC и средняя пауза при LVM_GC_THREADS от 1
+# до MAX_THREADS (по умолчанию - число ядер, больше runtime и не возьмет)
+# на Trees.lama, DeepList.lama и Sort.lama. Пауза - время в сборках,
+# деленное на их число; ускорение - относительно одного потока.
+
+source "$(dirname "$0")/benchmark_lib.sh"
+
+MAX_THREADS="${MAX_THREADS:-$(nproc)}"
+
+LVM="$PROJECT_DIR/build-gc-threads/lvm"
+
+# Суммарное время в сборках (мс) и их число по нескольким запускам из
+# строки "gc stats: N minor (X ms, ...), M major (Y ms)"
+gc_stats() {
+    local cmd="$1"
+    local runs="${2:-5}"
+    for i in $(seq 1 $runs); do
+        LVM_GC_STATS=1 sh -c "$cmd" 2>&1 > /dev/null | grep "^gc stats:" |
+            sed 's/gc stats: \([0-9]*\) minor (\([0-9.]*\) ms.*, \([0-9]*\) major (\([0-9.]*\) ms.*/\1 \2 \3 \4/'
+    done | awk '{ n += $1 + $3; ms += $2 + $4 } END { printf "%.3f %d", ms / NR, n / NR }'
+}
+
+echo "=== Building lvm ==="
+build_lvm build-gc-threads
+echo ""
+
+for NAME in Trees DeepList Sort; do
+    compile $NAME
+    BC="$PROJECT_DIR/performance/$NAME.bc"
+    echo "=== GC threads: $NAME.lama ($RUNS runs each) ==="
+    echo ""
+
+    OUT=$("$LVM" "$BC" 2>&1)
+    BASE=""
+    for T in $(seq 1 $MAX_THREADS); do
+        OUT_T=$(LVM_GC_THREADS=$T "$LVM" "$BC" 2>&1)
+        if [ "$OUT" != "$OUT_T" ]; then
+            echo "✗ $NAME.bc: output differs with $T GC threads"
+            exit 1
+        fi
+        read MS N <<< "$(gc_stats "LVM_GC_THREADS=$T \"$LVM\" \"$BC\"" $RUNS)"
+        [ -n "$BASE" ] || BASE=$MS
+        PAUSE=$(awk -v ms=$MS -v n=$N 'BEGIN { printf "%.3f", (n ? ms / n : 0) }')
+        SPEEDUP=$(awk -v b=$BASE -v ms=$MS 'BEGIN { printf "%.2f", (ms > 0 ? b / ms : 1) }')
+        echo "  $T threads: ${MS} ms GC, $N collections, ${PAUSE} ms mean pause, ${SPEEDUP}x"
+    done
+    echo ""
+done
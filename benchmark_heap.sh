@@ -0,0 +1,82 @@
+#!/usr/bin/env bash
+
+# Размер кучи: фиксированное большое пространство (как было раньше - 2 GB,
+# без изменения размера) против адаптивного по умолчанию и адаптивного с
+# коэффициентом роста 4. Время, пиковый RSS, число полных сборок и размер
+# старого пространства (в конце и наибольший) на регрессионном корпусе
+# (маленькие программы) и на Churn.lama, Trees.lama, DeepList.lama.
+
+source "$(dirname "$0")/benchmark_lib.sh"
+
+LVM="$PROJECT_DIR/build-heap/lvm"
+
+# Число полных сборок и размер старого пространства (KB) из строки
+# "gc stats: ..., M major (Y ms), ...; old space S KB, at most P KB, ..."
+heap_stats() {
+    LVM_GC_STATS=1 sh -c "$1" 2>&1 > /dev/null | grep "^gc stats:" |
+        awk '{
+            for (i = 1; i <= NF; i++) {
+                if ($i == "major") n = $(i - 1)
+                if ($i == "space") s = $(i + 1)
+                if ($i == "most") p = $(i + 1)
+            }
+            print n, s, p
+        }'
+}
+
+FIXED="--heap-init=2G --gc-time=100"
+ADAPTIVE=""
+GROWTH4="--heap-growth=4"
+
+echo "=== Building lvm ==="
+build_lvm build-heap
+echo ""
+
+echo "=== Heap sizing: regression corpus ==="
+echo ""
+for MODE in fixed adaptive; do
+    case $MODE in
+        fixed)    FLAGS="$FIXED" ;;
+        adaptive) FLAGS="$ADAPTIVE" ;;
+    esac
+    MAX_RSS=0
+    MAX_SPACE=0
+    for BC in "$BUILD_DIR"/test*.bc; do
+        INPUT="${BC%.bc}.input"
+        [ -f "$INPUT" ] || INPUT=/dev/null
+        RSS=$(measure_rss "\"$LVM\" $FLAGS \"$BC\" < \"$INPUT\" > /dev/null")
+        read N S P <<< "$(heap_stats "\"$LVM\" $FLAGS \"$BC\" < \"$INPUT\"")"
+        [ "$RSS" -gt "$MAX_RSS" ] && MAX_RSS=$RSS
+        [ "${P:-0}" -gt "$MAX_SPACE" ] && MAX_SPACE=$P
+    done
+    printf "  %-9s at most %s KB peak RSS, %s KB old space\n" "$MODE:" "$MAX_RSS" "$MAX_SPACE"
+done
+echo ""
+
+for NAME in Churn Trees DeepList; do
+    compile $NAME
+    BC="$PROJECT_DIR/performance/$NAME.bc"
+    echo "=== Heap sizing: $NAME.lama ($RUNS runs each) ==="
+    echo ""
+
+    OUT=$("$LVM" $FIXED "$BC" 2>&1)
+    OUT_ADAPTIVE=$("$LVM" "$BC" 2>&1)
+    if [ "$OUT" != "$OUT_ADAPTIVE" ]; then
+        echo "✗ $NAME.bc: outputs differ with a fixed and an adaptive heap"
+        exit 1
+    fi
+
+    for MODE in fixed adaptive growth-4; do
+        case $MODE in
+            fixed)    FLAGS="$FIXED" ;;
+            adaptive) FLAGS="$ADAPTIVE" ;;
+            growth-4) FLAGS="$GROWTH4" ;;
+        esac
+        read N S P <<< "$(heap_stats "\"$LVM\" $FLAGS \"$BC\"")"
+        RSS=$(measure_rss "\"$LVM\" $FLAGS \"$BC\" > /dev/null")
+        TIME=$(measure_time "\"$LVM\" $FLAGS \"$BC\" > /dev/null" $RUNS)
+        printf "  %-9s %ss, %s KB peak RSS, %s major collections, old space %s KB (at most %s KB)\n" \
+               "$MODE:" "$TIME" "$RSS" "$N" "$S" "$P"
+    done
+    echo ""
+done
@@ -0,0 +1,53 @@
+#!/usr/bin/env bash
+
+# Huge pages для кучи (LVM_HUGEPAGES): время, время в сборках, пиковый RSS
+# и объем huge pages на Sort.lama, Trees.lama, DeepList.lama и Churn.lama -
+# с обычными страницами, с thp (MADV_HUGEPAGE) и hugetlb (MAP_HUGETLB; без
+# зарезервированных страниц в /proc/sys/vm/nr_hugepages это тот же thp).
+# При /sys/kernel/mm/transparent_hugepage/enabled = never thp ничего не
+# меняет, объем huge pages будет нулевым.
+
+source "$(dirname "$0")/benchmark_lib.sh"
+
+LVM="$PROJECT_DIR/build-hugepages/lvm"
+
+# Время в сборках (мс) и объем huge pages (KB) из строки
+# "gc stats: N minor (X ms, ...), M major (Y ms)..., H KB in huge pages; ..."
+gc_huge() {
+    LVM_GC_STATS=1 sh -c "$1" 2>&1 > /dev/null | grep "^gc stats:" |
+        awk '{
+            ms = 0; huge = 0
+            for (i = 1; i <= NF; i++) {
+                if ($i ~ /^\(/ && $(i + 1) ~ /^ms/) ms += substr($i, 2)
+                if ($i == "huge") huge = $(i - 3)
+            }
+            printf "%.3f %s", ms, huge
+        }'
+}
+
+echo "=== Building lvm ==="
+build_lvm build-hugepages
+echo ""
+
+for NAME in Sort Trees DeepList Churn; do
+    compile $NAME
+    BC="$PROJECT_DIR/performance/$NAME.bc"
+    echo "=== Huge pages: $NAME.lama ($RUNS runs each) ==="
+    echo ""
+
+    OUT=$("$LVM" "$BC" 2>&1)
+    OUT_THP=$(LVM_HUGEPAGES=thp "$LVM" "$BC" 2>&1)
+    if [ "$OUT" != "$OUT_THP" ]; then
+        echo "✗ $NAME.bc: outputs differ with LVM_HUGEPAGES=thp"
+        exit 1
+    fi
+
+    for H in off thp hugetlb; do
+        read MS HUGE <<< "$(gc_huge "LVM_HUGEPAGES=$H \"$LVM\" \"$BC\"")"
+        RSS=$(measure_rss "LVM_HUGEPAGES=$H \"$LVM\" \"$BC\" > /dev/null")
+        TIME=$(measure_time "LVM_HUGEPAGES=$H \"$LVM\" \"$BC\" > /dev/null" $RUNS)
+        printf "  %-8s %ss, %s ms GC, %s KB peak RSS, %s KB in huge pages\n" \
+               "$H:" "$TIME" "$MS" "$RSS" "$HUGE"
+    done
+    echo ""
+done
@@ -0,0 +1,46 @@
+#!/usr/bin/env bash
+
+# Шаблонный JIT (--jit) по сравнению с интерпретатором: Sort.lama (основной
+# бенчмарк), Calls.lama (вызовы) и Slots.lama (циклы с LD/ST). Все режимы -
+# один и тот же lvm из текущего дерева: с проверками, --trusted и --jit
+# (--trusted и машинный код функций после JIT_HOT_CALLS вызовов или
+# JIT_HOT_LOOPS переходов назад с входом посреди цикла), плюс отчет
+# --tier-stats о том, какие функции и почему ушли в машинный код.
+
+source "$(dirname "$0")/benchmark_lib.sh"
+
+LVM="$PROJECT_DIR/build-jit/lvm"
+
+echo "=== Building lvm ==="
+build_lvm build-jit
+echo ""
+
+compile Sort
+compile Calls
+compile Slots
+
+echo "=== Interpreter vs. JIT ($RUNS runs each) ==="
+
+for STEM in Sort Calls Slots; do
+    BC="$PROJECT_DIR/performance/$STEM.bc"
+
+    OUT_INTERP=$("$LVM" "$BC" 2>&1)
+    OUT_JIT=$("$LVM" --jit "$BC" 2>&1)
+    if [ "$OUT_INTERP" != "$OUT_JIT" ]; then
+        echo "✗ $STEM.bc: outputs differ between the interpreter and --jit"
+        exit 1
+    fi
+
+    TIME_INTERP=$(measure_time "\"$LVM\" \"$BC\" > /dev/null" $RUNS)
+    TIME_TRUSTED=$(measure_time "\"$LVM\" --trusted \"$BC\" > /dev/null" $RUNS)
+    TIME_JIT=$(measure_time "\"$LVM\" --jit \"$BC\" > /dev/null" $RUNS)
+
+    echo ""
+    echo "$STEM.lama:"
+    echo "  lvm:           ${TIME_INTERP}s"
+    echo "  lvm --trusted: ${TIME_TRUSTED}s"
+    echo "  lvm --jit:     ${TIME_JIT}s"
+    echo "  speedup over lvm:           $(echo "$TIME_INTERP / $TIME_JIT" | bc -l | awk '{printf "%.2f", $1}')x"
+    echo "  speedup over lvm --trusted: $(echo "$TIME_TRUSTED / $TIME_JIT" | bc -l | awk '{printf "%.2f", $1}')x"
+    "$LVM" --tier-stats "$BC" 2>&1 > /dev/null | sed 's/^/  /'
+done
@@ -0,0 +1,80 @@
+# Общие функции скриптов benchmark_*.sh (подключается через source из
+# корня проекта). Скрипт задает только свое: сборки, программы и режимы.
+# Сборки lvm лежат в build-* (см. .gitignore).
+
+set -o pipefail
+
+PROJECT_DIR="$(pwd)"
+LAMAC="${LAMAC:-$PROJECT_DIR/Lama/src/lamac}"
+BUILD_DIR="${BUILD_DIR:-regression/}"
+RUNS="${RUNS:-5}"
+
+# Функция для измерения времени выполнения (среднее по нескольким запускам)
+measure_time() {
+    local cmd="$1"
+    local runs="${2:-5}"
+    local total=0
+
+    for i in $(seq 1 $runs); do
+        local time_output
+        time_output=$({ /usr/bin/time -p sh -c "$cmd" 2>&1; } | grep real | awk '{print $2}')
+        total=$(echo "$total + $time_output" | bc -l)
+    done
+
+    echo "$total / $runs" | bc -l | awk '{printf "%.3f", $1}'
+}
+
+# Пиковый RSS в KB
+measure_rss() {
+    { /usr/bin/time -f "rss %M" sh -c "$1" 2>&1; } | grep "^rss" | awk '{print $2}'
+}
+
+# Время сборок (малых и полных) в мс из строки "gc stats:" (LVM_GC_STATS)
+gc_ms() {
+    LVM_GC_STATS=1 sh -c "$1" 2>&1 > /dev/null | grep "^gc stats:" |
+        sed 's/.*minor (\([0-9.]*\) ms.*major (\([0-9.]*\) ms.*/\1 \2/' |
+        awk '{printf "%.3f", $1 + $2}'
+}
+
+# То же время сборок и число полных сборок через пробел
+gc_ms_majors() {
+    LVM_GC_STATS=1 sh -c "$1" 2>&1 > /dev/null | grep "^gc stats:" |
+        sed 's/.*minor (\([0-9.]*\) ms.* \([0-9]*\) major (\([0-9.]*\) ms.*/\1 \3 \2/' |
+        awk '{printf "%.3f %s", $1 + $2, $3}'
+}
+
+# performance/NAME.lama -> performance/NAME.bc, если его еще нет
+compile() {
+    local name="$1"
+    if [ ! -f "$PROJECT_DIR/performance/$name.bc" ]; then
+        (cd "$PROJECT_DIR/performance" && "$LAMAC" -b "$name.lama")
+    fi
+    if [ ! -f "$PROJECT_DIR/performance/$name.bc" ]; then
+        echo "Error: Failed to compile $name.lama"
+        exit 1
+    fi
+}
+
+# Release-сборка lvm в каталоге DIR с дополнительными опциями cmake
+build_lvm() {
+    local dir="$1"
+    shift
+    cmake -S "$PROJECT_DIR" -B "$PROJECT_DIR/$dir" -DCMAKE_BUILD_TYPE=Release "$@" > /dev/null || exit 1
+    cmake --build "$PROJECT_DIR/$dir" -j > /dev/null || exit 1
+}
+
+# Release-сборка lvm из ревизии REV в рабочей копии build-base-src:
+# build-base-src/build/lvm (рабочую копию удаляет remove_base)
+build_base() {
+    local rev="$1"
+    local src="$PROJECT_DIR/build-base-src"
+    rm -rf "$src"
+    git worktree prune
+    git worktree add --detach "$src" "$rev" > /dev/null 2>&1 || exit 1
+    cmake -S "$src" -B "$src/build" -DCMAKE_BUILD_TYPE=Release > /dev/null || exit 1
+    cmake --build "$src/build" -j > /dev/null || exit 1
+}
+
+remove_base() {
+    git worktree remove --force "$PROJECT_DIR/build-base-src"
+}
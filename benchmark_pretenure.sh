@@ -0,0 +1,61 @@
+#!/usr/bin/env bash
+
+# Претенуринг по местам выделения (LVM_GC_PRETENURE): время, время в
+# сборках, объем, скопированный из молодого поколения, объем, выделенный
+# сразу в старом пространстве, и пиковый RSS на Trees.lama (узлы деревьев
+# живут долго), DeepList.lama, Churn.lama (одно место строит и постоянный,
+# и временные списки) и Sort.lama - без претенуринга (LVM_GC_PRETENURE=0)
+# и с ним (по умолчанию). Затем - отчет о местах выделения (LVM_GC_SITES).
+
+source "$(dirname "$0")/benchmark_lib.sh"
+
+LVM="$PROJECT_DIR/build-pretenure/lvm"
+
+# Время в сборках (мс), скопированное из молодого поколения и выделенное в
+# старом пространстве (KB) из строки "gc stats: N minor (X ms, W words
+# promoted), M major (Y ms)..., P KB pretenured; ..."
+gc_pretenure() {
+    LVM_GC_STATS=1 sh -c "$1" 2>&1 > /dev/null | grep "^gc stats:" |
+        awk -v word="$(getconf LONG_BIT)" '{
+            ms = 0; promoted = 0; old = 0
+            for (i = 1; i <= NF; i++) {
+                if ($i ~ /^\(/ && $(i + 1) ~ /^ms/) ms += substr($i, 2)
+                if ($i == "words" && $(i + 1) ~ /^promoted/) promoted = $(i - 1)
+                if ($i ~ /^pretenured/) old = $(i - 2)
+            }
+            printf "%.3f %d %s", ms, promoted * word / 8 / 1024, old
+        }'
+}
+
+echo "=== Building lvm ==="
+build_lvm build-pretenure
+echo ""
+
+for NAME in Trees DeepList Churn Sort; do
+    compile $NAME
+    BC="$PROJECT_DIR/performance/$NAME.bc"
+    echo "=== Pretenuring: $NAME.lama ($RUNS runs each) ==="
+    echo ""
+
+    OUT=$(LVM_GC_PRETENURE=0 "$LVM" "$BC" 2>&1)
+    OUT_OLD=$("$LVM" "$BC" 2>&1)
+    if [ "$OUT" != "$OUT_OLD" ]; then
+        echo "✗ $NAME.bc: outputs differ with and without pretenuring"
+        exit 1
+    fi
+
+    for MODE in nursery pretenured; do
+        case $MODE in
+            nursery)    ENV="LVM_GC_PRETENURE=0" ;;
+            pretenured) ENV="" ;;
+        esac
+        read MS PROMOTED OLD <<< "$(gc_pretenure "$ENV \"$LVM\" \"$BC\"")"
+        RSS=$(measure_rss "$ENV \"$LVM\" \"$BC\" > /dev/null")
+        TIME=$(measure_time "$ENV \"$LVM\" \"$BC\" > /dev/null" $RUNS)
+        printf "  %-11s %ss, %s ms GC, %s KB promoted, %s KB pretenured, %s KB peak RSS\n" \
+               "$MODE:" "$TIME" "$MS" "$PROMOTED" "$OLD" "$RSS"
+    done
+    echo ""
+    LVM_GC_SITES=1 "$LVM" "$BC" 2>&1 > /dev/null | head -8
+    echo ""
+done
@@ -0,0 +1,84 @@
+#!/usr/bin/env bash
+
+# Регистровая форма (--regvm) по сравнению со стековой (--trusted): число
+# диспетчеризаций (сборка с -DLVM_DISPATCH_STATS=ON) и время на Sort.lama
+# и регрессионном корпусе. Обе формы - один и тот же lvm из текущего дерева.
+
+source "$(dirname "$0")/benchmark_lib.sh"
+
+LVM="$PROJECT_DIR/build-regvm/lvm"
+LVM_STATS="$PROJECT_DIR/build-regvm-stats/lvm"
+
+# Число диспетчеризаций из строки "dispatch stats: N dispatches, ..."
+dispatches() {
+    "$LVM_STATS" "$@" 2>&1 > /dev/null | grep "^dispatch stats:" | awk '{print $3}'
+}
+
+echo "=== Building lvm ==="
+build_lvm build-regvm
+build_lvm build-regvm-stats -DLVM_DISPATCH_STATS=ON
+echo ""
+
+compile Sort
+SORT_BC="$PROJECT_DIR/performance/Sort.bc"
+
+echo "=== Performance Benchmark: Sort.lama ($RUNS runs each) ==="
+echo ""
+
+OUT_STACK=$("$LVM" --trusted "$SORT_BC" 2>&1)
+OUT_REG=$("$LVM" --regvm "$SORT_BC" 2>&1)
+if [ "$OUT_STACK" != "$OUT_REG" ]; then
+    echo "✗ Sort.bc: outputs differ between --trusted and --regvm"
+    exit 1
+fi
+
+D_STACK=$(dispatches --trusted "$SORT_BC")
+D_REG=$(dispatches --regvm "$SORT_BC")
+TIME_STACK=$(measure_time "\"$LVM\" --trusted \"$SORT_BC\" > /dev/null" $RUNS)
+TIME_REG=$(measure_time "\"$LVM\" --regvm \"$SORT_BC\" > /dev/null" $RUNS)
+echo "  --trusted: ${TIME_STACK}s, $D_STACK dispatches"
+echo "  --regvm:   ${TIME_REG}s, $D_REG dispatches"
+echo "  dispatches: $(echo "100 * ($D_STACK - $D_REG) / $D_STACK" | bc -l | awk '{printf "-%.1f%%", $1}')"
+echo "  speedup:    $(echo "$TIME_STACK / $TIME_REG" | bc -l | awk '{printf "%.2f", $1}')x"
+echo ""
+
+# Регрессионные тесты: сначала проверяем совпадение вывода, затем счетчики и время
+echo "=== Regression corpus ==="
+echo ""
+
+TOTAL_D_STACK=0
+TOTAL_D_REG=0
+TOTAL_STACK=0
+TOTAL_REG=0
+for FILE_PATH in "$BUILD_DIR"/*.lama; do
+    FILE_NAME="$(basename "$FILE_PATH")"
+    STEM="${FILE_NAME%.*}"
+    BC_FILE="$BUILD_DIR/$STEM.bc"
+    INPUT="$BUILD_DIR/$STEM.input"
+    [ -f "$BC_FILE" ] || continue
+    [ -f "$INPUT" ] || INPUT=/dev/null
+
+    OUT_STACK=$("$LVM" --trusted "$BC_FILE" < "$INPUT" 2>&1)
+    OUT_REG=$("$LVM" --regvm "$BC_FILE" < "$INPUT" 2>&1)
+    if [ "$OUT_STACK" != "$OUT_REG" ]; then
+        echo "✗ $STEM: outputs differ"
+        continue
+    fi
+
+    D_STACK=$(dispatches --trusted "$BC_FILE" < "$INPUT")
+    D_REG=$(dispatches --regvm "$BC_FILE" < "$INPUT")
+    if [ -z "$D_STACK" ] || [ -z "$D_REG" ]; then
+        echo "  $STEM: (no stats: program did not reach HALT)"
+        continue
+    fi
+    T_STACK=$(measure_time "\"$LVM\" --trusted \"$BC_FILE\" < \"$INPUT\" > /dev/null" 3)
+    T_REG=$(measure_time "\"$LVM\" --regvm \"$BC_FILE\" < \"$INPUT\" > /dev/null" 3)
+    TOTAL_D_STACK=$((TOTAL_D_STACK + D_STACK))
+    TOTAL_D_REG=$((TOTAL_D_REG + D_REG))
+    TOTAL_STACK=$(echo "$TOTAL_STACK + $T_STACK" | bc -l)
+    TOTAL_REG=$(echo "$TOTAL_REG + $T_REG" | bc -l)
+    echo "  $STEM: --trusted ${T_STACK}s/$D_STACK, --regvm ${T_REG}s/$D_REG"
+done
+
+echo ""
+echo "Total: --trusted $(printf "%.3f" $TOTAL_STACK)s/$TOTAL_D_STACK dispatches, --regvm $(printf "%.3f" $TOTAL_REG)s/$TOTAL_D_REG dispatches"
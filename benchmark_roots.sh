@@ -0,0 +1,87 @@
+#!/usr/bin/env bash
+
+# Точный обход корней стека (карты стека, tools/stackmap.c) по сравнению с
+# консервативным просмотром всего стека (LVM_GC_CONSERVATIVE=1): время GC,
+# объем продвинутых в старое поколение объектов (ложное удержание мертвыми
+# слотами) и общее время на Sort.lama и регрессионном корпусе.
+
+source "$(dirname "$0")/benchmark_lib.sh"
+
+LVM="$PROJECT_DIR/build-roots/lvm"
+
+# Время в сборках (мс) и продвинутые слова из строки
+# "gc stats: N minor (X ms, W words promoted), M major (Y ms)"
+gc_stats() {
+    LVM_GC_STATS=1 sh -c "$1" 2>&1 > /dev/null | grep "^gc stats:" |
+        sed 's/.*minor (\([0-9.]*\) ms, \([0-9]*\) words.*major (\([0-9.]*\) ms.*/\1 \2 \3/' |
+        awk '{printf "%.3f %d", $1 + $3, $2}'
+}
+
+echo "=== Building lvm ==="
+build_lvm build-roots
+echo ""
+
+compile Sort
+SORT_BC="$PROJECT_DIR/performance/Sort.bc"
+
+echo "=== Performance Benchmark: Sort.lama ($RUNS runs each) ==="
+echo ""
+
+OUT_CONS=$(LVM_GC_CONSERVATIVE=1 "$LVM" "$SORT_BC" 2>&1)
+OUT_PREC=$("$LVM" "$SORT_BC" 2>&1)
+if [ "$OUT_CONS" != "$OUT_PREC" ]; then
+    echo "✗ Sort.bc: outputs differ between conservative and precise roots"
+    exit 1
+fi
+
+for MODE in "" --jit --regvm; do
+    read GC_CONS PROM_CONS <<< "$(gc_stats "LVM_GC_CONSERVATIVE=1 \"$LVM\" $MODE \"$SORT_BC\"")"
+    read GC_PREC PROM_PREC <<< "$(gc_stats "\"$LVM\" $MODE \"$SORT_BC\"")"
+    TIME_CONS=$(measure_time "LVM_GC_CONSERVATIVE=1 \"$LVM\" $MODE \"$SORT_BC\" > /dev/null" $RUNS)
+    TIME_PREC=$(measure_time "\"$LVM\" $MODE \"$SORT_BC\" > /dev/null" $RUNS)
+    echo "  ${MODE:-interpreter}:"
+    echo "    conservative: ${TIME_CONS}s total, ${GC_CONS} ms GC, ${PROM_CONS} words promoted"
+    echo "    precise:      ${TIME_PREC}s total, ${GC_PREC} ms GC, ${PROM_PREC} words promoted"
+    echo "    speedup:      $(echo "$TIME_CONS / $TIME_PREC" | bc -l | awk '{printf "%.2f", $1}')x"
+done
+echo ""
+
+echo "=== Regression corpus ==="
+echo ""
+
+TOTAL_CONS=0
+TOTAL_PREC=0
+TOTAL_GC_CONS=0
+TOTAL_GC_PREC=0
+TOTAL_PROM_CONS=0
+TOTAL_PROM_PREC=0
+for FILE_PATH in "$BUILD_DIR"/*.lama; do
+    FILE_NAME="$(basename "$FILE_PATH")"
+    STEM="${FILE_NAME%.*}"
+    BC_FILE="$BUILD_DIR/$STEM.bc"
+    INPUT="$BUILD_DIR/$STEM.input"
+    [ -f "$BC_FILE" ] || continue
+    [ -f "$INPUT" ] || INPUT=/dev/null
+
+    OUT_CONS=$(LVM_GC_CONSERVATIVE=1 "$LVM" "$BC_FILE" < "$INPUT" 2>&1)
+    OUT_PREC=$("$LVM" "$BC_FILE" < "$INPUT" 2>&1)
+    if [ "$OUT_CONS" != "$OUT_PREC" ]; then
+        echo "✗ $STEM: outputs differ"
+        continue
+    fi
+
+    read GC_CONS PROM_CONS <<< "$(gc_stats "LVM_GC_CONSERVATIVE=1 \"$LVM\" \"$BC_FILE\" < \"$INPUT\"")"
+    read GC_PREC PROM_PREC <<< "$(gc_stats "\"$LVM\" \"$BC_FILE\" < \"$INPUT\"")"
+    T_CONS=$(measure_time "LVM_GC_CONSERVATIVE=1 \"$LVM\" \"$BC_FILE\" < \"$INPUT\" > /dev/null" 3)
+    T_PREC=$(measure_time "\"$LVM\" \"$BC_FILE\" < \"$INPUT\" > /dev/null" 3)
+    TOTAL_CONS=$(echo "$TOTAL_CONS + $T_CONS" | bc -l)
+    TOTAL_PREC=$(echo "$TOTAL_PREC + $T_PREC" | bc -l)
+    TOTAL_GC_CONS=$(echo "$TOTAL_GC_CONS + ${GC_CONS:-0}" | bc -l)
+    TOTAL_GC_PREC=$(echo "$TOTAL_GC_PREC + ${GC_PREC:-0}" | bc -l)
+    TOTAL_PROM_CONS=$((TOTAL_PROM_CONS + ${PROM_CONS:-0}))
+    TOTAL_PROM_PREC=$((TOTAL_PROM_PREC + ${PROM_PREC:-0}))
+    echo "  $STEM: conservative ${T_CONS}s/${GC_CONS} ms GC/${PROM_CONS} words, precise ${T_PREC}s/${GC_PREC} ms GC/${PROM_PREC} words"
+done
+
+echo ""
+echo "Total: conservative $(printf "%.3f" $TOTAL_CONS)s/$(printf "%.3f" $TOTAL_GC_CONS) ms GC/$TOTAL_PROM_CONS words, precise $(printf "%.3f" $TOTAL_PREC)s/$(printf "%.3f" $TOTAL_GC_PREC) ms GC/$TOTAL_PROM_PREC words"
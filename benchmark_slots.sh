@@ -0,0 +1,50 @@
+#!/usr/bin/env bash
+
+# Микробенчмарк обращений к переменным (performance/Slots.lama): пропускная
+# способность LD/ST текущего lvm по сравнению с lvm, собранным из ревизии
+# BASE_REV (по умолчанию HEAD~1 - до предвычисления смещений слотов).
+
+source "$(dirname "$0")/benchmark_lib.sh"
+
+BASE_REV="${BASE_REV:-HEAD~1}"
+
+LVM_NEW="$PROJECT_DIR/build-slots/lvm"
+LVM_BASE="$PROJECT_DIR/build-base-src/build/lvm"
+
+# Обращений к переменным за запуск: 3000000 итераций цикла args
+# (14 LD/ST на итерацию) и 3000000 итераций цикла captured (10 LD/ST)
+ACCESSES=72000000
+
+echo "=== Building lvm (current tree and $BASE_REV) ==="
+build_lvm build-slots
+build_base "$BASE_REV"
+echo ""
+
+compile Slots
+SLOTS_BC="$PROJECT_DIR/performance/Slots.bc"
+
+OUT_BASE=$("$LVM_BASE" "$SLOTS_BC" 2>&1)
+OUT_NEW=$("$LVM_NEW" "$SLOTS_BC" 2>&1)
+if [ "$OUT_BASE" != "$OUT_NEW" ]; then
+    echo "✗ Slots.bc: outputs differ between $BASE_REV and current tree"
+    exit 1
+fi
+
+echo "=== LD/ST throughput: Slots.lama ($RUNS runs each) ==="
+echo ""
+
+report() {
+    local name="$1"
+    local time="$2"
+    echo "  $name ${time}s, $(echo "$ACCESSES / $time / 1000000" | bc -l | awk '{printf "%.1f", $1}')M accesses/s"
+}
+
+TIME_BASE=$(measure_time "\"$LVM_BASE\" \"$SLOTS_BC\" > /dev/null" $RUNS)
+TIME_NEW=$(measure_time "\"$LVM_NEW\" \"$SLOTS_BC\" > /dev/null" $RUNS)
+TIME_TRUSTED=$(measure_time "\"$LVM_NEW\" --trusted \"$SLOTS_BC\" > /dev/null" $RUNS)
+report "$BASE_REV:        " "$TIME_BASE"
+report "current:          " "$TIME_NEW"
+report "current --trusted:" "$TIME_TRUSTED"
+echo "  speedup: $(echo "$TIME_BASE / $TIME_NEW" | bc -l | awk '{printf "%.2f", $1}')x"
+
+remove_base
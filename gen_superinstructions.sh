@@ -0,0 +1,120 @@
+#!/usr/bin/env bash
+
+# Генерация tools/superinstr.def по частотам идиом (lvm --idioms).
+#
+# Идиомы (пары и тройки инструкций) собираются со всех .bc обучающего
+# корпуса и суммируются. LINE выбрасывается (quicken() не порождает для
+# него инструкций). Остаются последовательности из 2-3 инструкций, которые
+# умеет сливать интерпретатор; переход допускается только последним.
+# Первые SUPERINSTR_N по частоте записываются в виде X-макросов
+# SUPER2/SUPER3, из которых собираются слитые обработчики в eval().
+#
+# После перегенерации нужно пересобрать lvm.
+
+set -o pipefail
+
+PROJECT_DIR="$(pwd)"
+LAMAC="${LAMAC:-$PROJECT_DIR/Lama/src/lamac}"
+LVM="${LVM:-build/lvm}"
+CORPUS="${CORPUS:-performance regression}"
+SUPERINSTR_N="${SUPERINSTR_N:-32}"
+OUTPUT="${OUTPUT:-tools/superinstr.def}"
+
+if [ ! -x "$LVM" ]; then
+    echo "Error: $LVM not found, build lvm first"
+    exit 1
+fi
+
+# Компилируем .lama без байткода, если есть lamac
+if [ -x "$LAMAC" ]; then
+    for DIR in $CORPUS; do
+        for FILE_PATH in "$DIR"/*.lama; do
+            [ -f "${FILE_PATH%.lama}.bc" ] && continue
+            (cd "$DIR" && "$LAMAC" -b "$(basename "$FILE_PATH")") || \
+                echo "Warning: failed to compile $FILE_PATH" >&2
+        done
+    done
+fi
+
+BC_FILES=()
+for DIR in $CORPUS; do
+    for BC_FILE in "$DIR"/*.bc; do
+        [ -f "$BC_FILE" ] && BC_FILES+=("$BC_FILE")
+    done
+done
+
+if [ ${#BC_FILES[@]} -eq 0 ]; then
+    echo "Error: no bytecode files in: $CORPUS"
+    exit 1
+fi
+
+echo "Collecting idioms from ${#BC_FILES[@]} files..." >&2
+
+for BC_FILE in "${BC_FILES[@]}"; do
+    "$LVM" --idioms "$BC_FILE" 2>/dev/null | grep "×"
+done | awk -v top="$SUPERINSTR_N" -v corpus="$CORPUS" -v nfiles="${#BC_FILES[@]}" '
+BEGIN {
+    # мнемоника (как в opcode_names.c) -> имя в enum Bytecode
+    split("BINOP +;BINOP -;BINOP *;BINOP /;BINOP %;BINOP <;BINOP <=;BINOP >;BINOP >=;BINOP ==;BINOP !=;BINOP &&;BINOP ||;" \
+          "CONST;STRING;SEXP;STA;DROP;DUP;SWAP;ELEM;" \
+          "LD G;LD L;LD A;LD C;ST G;ST L;ST A;ST C;TAG;ARRAY;" \
+          "PATT =str;PATT #string;PATT #array;PATT #sexp;PATT #ref;PATT #val;PATT #fun;" \
+          "CALL Lread;CALL Lwrite;CALL Llength;CALL Lstring;JMP;CJMPz;CJMPnz", names, ";")
+    split("ADD;SUB;MUL;DIV;MOD;LT;LE;GT;GE;EQ;NEQ;AND;OR;" \
+          "CONST;STRING;SEXP;STA;DROP;DUP;SWAP;ELEM;" \
+          "LD_G;LD_L;LD_A;LD_C;ST_G;ST_L;ST_A;ST_C;TAG;ARRAY;" \
+          "PATT_STR;PATT_STRING;PATT_ARRAY;PATT_SEXP;PATT_REF;PATT_VAL;PATT_FUN;" \
+          "READ;WRITE;LENGTH;STRINGV;JMP;CJMPz;CJMPnz", ids, ";")
+    for (i in names) fusable[names[i]] = ids[i]
+    jump["JMP"] = jump["CJMPz"] = jump["CJMPnz"] = 1
+}
+{
+    count = $1
+    text = $0
+    sub(/^[^#]*# /, "", text)
+
+    # разбор мнемоник: BINOP/LD/LDA/ST/PATT/CALL Lxxx занимают два слова
+    nt = split(text, w, " ")
+    n = 0
+    ok = 1
+    for (i = 1; i <= nt; i++) {
+        m = w[i]
+        if ((m == "BINOP" || m == "LD" || m == "LDA" || m == "ST" || m == "PATT" ||
+             (m == "CALL" && (w[i+1] ~ /^L/ || w[i+1] == "Barray"))) && i < nt) {
+            m = m " " w[++i]
+        }
+        if (m == "LINE") continue
+        if (!(m in fusable) || n > 0 && jump[seq[n]]) { ok = 0; break }
+        seq[++n] = fusable[m]
+    }
+    if (!ok || n < 2 || n > 3) next
+
+    key = seq[1]
+    for (i = 2; i <= n; i++) key = key " " seq[i]
+    freq[key] += count
+}
+END {
+    printf "/* Суперинструкции: сгенерировано gen_superinstructions.sh, не редактировать.\n"
+    printf "   Корпус: %s (%d файлов), отобрано %d самых частых последовательностей.\n", corpus, nfiles, top
+    printf "   SUPERn(имя, опкоды...)  -- статическая частота в корпусе */\n\n"
+    fflush()
+
+    cmd = "sort -k1,1nr -k2"
+    for (k in freq) print freq[k] "\t" k | cmd
+    close(cmd)
+}' | awk -v top="$SUPERINSTR_N" '
+/^\/\*|^   |^$/ { print; next }
+{
+    if (++emitted > top) next
+    split($0, f, "\t")
+    n = split(f[2], op, " ")
+    name = op[1]
+    args = "BC_" op[1]
+    for (i = 2; i <= n; i++) { name = name "__" op[i]; args = args ", BC_" op[i] }
+    pad = 56 - length(name) - length(args)
+    printf "SUPER%d(%s, %s)%*s/* %d */\n", n, name, args, pad > 1 ? pad : 1, "", f[1]
+}' > "$OUTPUT.tmp" || exit 1
+
+mv "$OUTPUT.tmp" "$OUTPUT"
+echo "Wrote $OUTPUT:" >&2
+grep -c "^SUPER" "$OUTPUT" >&2
@@ -7,12 +7,19 @@
 #include <stdbool.h>
 #include <stdarg.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <limits.h>
+#include <stddef.h>
 
 #include "tools/idiom.h"
 #include "tools/decode.h"
 #include "tools/verifier.h"
 #include "tools/opcode_names.h"
+#include "tools/quicken.h"
+#include "tools/jit.h"
+#include "tools/regvm.h"
+#include "tools/stackmap.h"
+#include "tools/heapprof.h"
 #include "runtime/runtime.h"
 #include "tools/bytecode_defs.h"
 
@@ -30,23 +37,8 @@
     do { \
         const lama_State *__L = (L); \
         const bytefile *__bf = (bf); \
-        long __offset = (__L && __bf && __L->ip && __bf->code_ptr) ? \
-                       (long)(__L->ip - __bf->code_ptr - 1) : -1; \
-        if (__offset >= 0) { \
-            failure("ERROR at offset %ld (0x%lx): " fmt, \
-                   __offset, __offset, ##__VA_ARGS__); \
-        } else { \
-            failure("ERROR: " fmt, ##__VA_ARGS__); \
-        } \
-    } while(0)
-
-/* Макрос для ошибок при проверке кода (только ip и bf) */
-#define ERROR_AT_IP(ip, bf, fmt, ...) \
-    do { \
-        const char *__ip = (ip); \
-        const bytefile *__bf = (bf); \
-        long __offset = (__ip && __bf && __bf->code_ptr) ? \
-                       (long)(__ip - __bf->code_ptr - 1) : -1; \
+        long __offset = (__L && __bf && __L->pc && __bf->code_ptr) ? \
+                       (long)(__L->pc[-1].src - __bf->code_ptr) : -1; \
         if (__offset >= 0) { \
             failure("ERROR at offset %ld (0x%lx): " fmt, \
                    __offset, __offset, ##__VA_ARGS__); \
@@ -69,8 +61,8 @@ extern size_t __gc_stack_top, __gc_stack_bottom;
 //extern void __gc_root_scan_stack();
 
 /* Forward declarations */
-static void vfailure(char *s, va_list args);
-static void failure(char *s, ...);
+static void vfailure(char *s, va_list args) __attribute__((noreturn));
+static void failure(char *s, ...) __attribute__((noreturn));
 
 /* The unpacked representation of bytecode file */
 //typedef struct {
@@ -156,13 +148,15 @@ static bytefile* read_file (const char *fname) {
     }
 
     // Проверка максимального размера файла
-    if (size > INT_MAX - (long)sizeof(int)*4) {
-        failure("File too large: %ld bytes (max: %ld)\n", size, INT_MAX - (long)sizeof(int)*4);
+    if (size > INT_MAX - (long)offsetof(bytefile, buffer)) {
+        failure("File too large: %ld bytes (max: %ld)\n", size, INT_MAX - (long)offsetof(bytefile, buffer));
     }
 
     rewind (f);
 
-    file = (bytefile*) malloc (sizeof(int)*4 + size);
+    /* Файл читается с поля stringtab_size: заголовок из трех int
+       в файле и в структуре совпадает при любом размере указателя */
+    file = (bytefile*) malloc (offsetof(bytefile, stringtab_size) + size);
     if (file == 0) {
         failure ("*** FAILURE: unable to allocate memory.\n");
     }
@@ -181,7 +175,7 @@ static bytefile* read_file (const char *fname) {
     }
 
     // Проверка, что указатели в пределах выделенной памяти
-    size_t buffer_size = sizeof(int)*4 + size;
+    size_t buffer_size = offsetof(bytefile, stringtab_size) + size;
     char *buffer_end = (char*)file + buffer_size;
 
     // Проверка public_ptr
@@ -238,22 +232,27 @@ typedef void** StkId;
 
 typedef struct Lama_CallInfo {
     int n_args, n_locs, n_caps;
+    int n_extra;    /* 1 - замыкание лежит под аргументами (CALLC через кэш) */
     StkId base;
-    const char *ret_ip;
+    const Instr *ret_pc;
 } lama_CallInfo;
 
 typedef struct Lama_State {
-    const char *ip;
+    const Instr *pc;       /* следующая инструкция предекодированного потока */
     const char *code_start;
     const char *code_end;  /* Первый байт ПОСЛЕ конца кода */
     StkId base;
     StkId stack_last;
+    void **stack_block;    /* начало блока памяти стека (для free) */
     lama_CallInfo *base_ci;
     lama_CallInfo *ci;
     lama_CallInfo *end_ci;
+    lama_CallInfo *ci_block;
     int size_ci;
     int stacksize;
     int n_globals;
+    JitCtx *native;        /* исполняется машинный код (L->pc не указывает
+                              на инструкцию верхнего кадра) или NULL */
 } lama_State;
 
 static lama_State eval_state;
@@ -280,6 +279,7 @@ static lama_State eval_state;
 static void lama_reallocstack(lama_State *L, int newsize) {
     StkId prev_base = L->base;
     StkId prev_stack_last = L->stack_last;
+    void **prev_block = L->stack_block;
     StkId prev_stack_top = stack_top;
     StkId prev_stack_bottom = stack_bottom;
     int prev_stacksize = L->stacksize;
@@ -289,17 +289,19 @@ static void lama_reallocstack(lama_State *L, int newsize) {
         failure("Failed to allocate stack of size %d\n", newsize);
     }
 
+    L->stack_block = new_stack;
     set_gc_ptr(__gc_stack_bottom, new_stack + newsize - 1);
-    int shift = stack_bottom - prev_stack_bottom;
+    ptrdiff_t shift = stack_bottom - prev_stack_bottom;
     set_gc_ptr(__gc_stack_top, prev_stack_top + shift);
     L->base = prev_base + shift;
     L->stacksize = newsize;
     L->stack_last = stack_bottom - L->stacksize;
 
+    /* Стек растет вниз: старое содержимое прижимается к новому дну */
     int elements_to_copy = prev_stacksize;
     if (elements_to_copy > 0) {
-        memcpy(new_stack,
-               prev_stack_last + 1,
+        memcpy(new_stack + (newsize - prev_stacksize),
+               prev_block,
                elements_to_copy * sizeof(void*));
     }
 
@@ -317,7 +319,7 @@ static void lama_reallocstack(lama_State *L, int newsize) {
     foreach_ci(L, ci_ptr)
         ci_ptr->base = ci_ptr->base + shift;
 
-    free(prev_stack_last + 1 - prev_stacksize);
+    free(prev_block);
 }
 
 static void lama_growstack(lama_State *L, int n) {
@@ -334,19 +336,19 @@ static void lama_growstack(lama_State *L, int n) {
 #define lama_numsub(a,b)((a)-(b))
 #define lama_nummul(a,b)((a)*(b))
 
-static int safe_div(lama_State *L, const bytefile *bf, int a, int b) {
+static aint safe_div(lama_State *L, const bytefile *bf, aint a, aint b) {
     if (b == 0) {
-        ERROR_AT(L, bf, "Division by zero: %d / %d\n", a, b);
+        ERROR_AT(L, bf, "Division by zero: %" PRIdPTR " / %" PRIdPTR "\n", a, b);
     }
     return a / b;
 }
 
-static int safe_mod(lama_State *L, const bytefile *bf, int a, int b) {
+static aint safe_mod(lama_State *L, const bytefile *bf, aint a, aint b) {
     if (b == 0) {
-        ERROR_AT(L, bf, "Modulo by zero: %d %% %d\n", a, b);
+        ERROR_AT(L, bf, "Modulo by zero: %" PRIdPTR " %% %" PRIdPTR "\n", a, b);
     }
 
-    int result = a % b;
+    aint result = a % b;
     if (result < 0) {
         result += (b > 0) ? b : -b;
     }
@@ -389,29 +391,6 @@ static void lama_settop(lama_State *L, int idx) {
 //#define lama_pop(L,n)lama_settop(L,-(n))
 #define lama_pop(L,n) lama_pop_n(L, n)
 
-static void check_ip_bounds(const lama_State *L, size_t bytes_to_read, const bytefile *bf) {
-    /* Изменено: проверяем, что ip + bytes_to_read не выходит за code_end */
-    /* code_end указывает на ПЕРВЫЙ байт ПОСЛЕ конца кода */
-    if (L->ip + bytes_to_read > L->code_end) {
-        ERROR_AT_IP(L->ip, bf,
-                   "Bytecode read out of bounds: ip=%p, bytes=%zu, code_end=%p (last valid byte at %p)\n"
-                   "Current instruction likely at offset %ld\n",
-                   (void*)L->ip, bytes_to_read, (void*)L->code_end, (void*)(L->code_end - 1),
-                   (long)(L->ip - bf->code_ptr - 1));
-    }
-}
-
-static int read_int(lama_State *L, const bytefile *bf) {
-    check_ip_bounds(L, sizeof(int), bf);
-    L->ip += sizeof(int);
-    return *(const int*)(L->ip - sizeof(int));
-}
-
-static unsigned char read_byte(lama_State *L, const bytefile *bf) {
-    check_ip_bounds(L, 1, bf);
-    return (unsigned char)*L->ip++;
-}
-
 static StkId idx2StkId(lama_State *L, int idx) {
     if (idx > L->base - stack_top) {
         failure("Stack index out of bounds: idx=%d, available=%ld\n",
@@ -428,6 +407,8 @@ static void check_loc_bounds(lama_State *L, int idx, int max, const char *loc_ty
     }
 }
 
+#ifdef DEBUG
+/* Только для отладочной печати: цикл адресует слоты через qloc2adr */
 static void **loc2adr(lama_State *L, lama_Loc loc, const bytefile *bf) {
     int idx = loc.idx;
 
@@ -506,8 +487,9 @@ static void **loc2adr(lama_State *L, lama_Loc loc, const bytefile *bf) {
 
     return base_ptr + offset;
 }
+#endif
 
-static int lama_tonumber(lama_State *L, int idx, const bytefile *bf) {
+static aint lama_tonumber(lama_State *L, int idx, const bytefile *bf) {
     void *o = *idx2StkId(L, idx);
     if(!UNBOXED(o)) {
         const char *type_desc = "boxed value";
@@ -528,26 +510,29 @@ static int lama_tonumber(lama_State *L, int idx, const bytefile *bf) {
 
 static void lama_reallocCI(lama_State *L, int newsize) {
     lama_CallInfo *prev_base_ci = L->base_ci;
-    lama_CallInfo *prev_end_ci = L->end_ci;
+    lama_CallInfo *prev_block = L->ci_block;
     lama_CallInfo *prev_ci = L->ci;
     int prev_size_ci = L->size_ci;
 
-    L->base_ci = alloc_stack(lama_CallInfo, newsize);
-    if (!L->base_ci) {
+    lama_CallInfo *new_ci = alloc_stack(lama_CallInfo, newsize);
+    if (!new_ci) {
         failure("Failed to allocate CallInfo of size %d\n", newsize);
     }
 
-    int shift = L->base_ci - prev_base_ci;
+    /* Цепочка CallInfo, как и стек, растет вниз от base_ci */
+    L->ci_block = new_ci;
+    L->base_ci = new_ci + newsize - 1;
+    ptrdiff_t shift = L->base_ci - prev_base_ci;
 
     L->size_ci = newsize;
     L->ci = prev_ci + shift;
     L->end_ci = L->base_ci - L->size_ci;
 
-    memcpy(L->end_ci + 1,
-           prev_end_ci + 1,
+    memcpy(new_ci + (newsize - prev_size_ci),
+           prev_block,
            prev_size_ci * sizeof(lama_CallInfo));
 
-    free(prev_end_ci + 1 - prev_size_ci);
+    free(prev_block);
 }
 
 static void lama_growCI(lama_State *L, int n) {
@@ -566,6 +551,7 @@ static void lama_growCI(lama_State *L, int n) {
 #define print_debug(...) (void)0
 #endif
 
+#ifdef DEBUG
 static void printstack(const lama_State *L) {
     printf("stack\n");
     for (int i = 0; i < L->base - stack_top; i++) {
@@ -645,21 +631,21 @@ static void printargs(const lama_State *L, const bytefile *bf) {
     }
     printf("\n");
 }
-
-#ifndef DEBUG
+#else
 #define printstack(l) (void)0
 #define printglobals(l) (void)0
 #define printlocals(l) (void)0
 #define printargs(l) (void)0
 #endif
 
-static void lama_begin(lama_State *L, int n_caps, int n_args, int n_locs, char *retip, void *fun, const bytefile *bf) {
+static void lama_begin(lama_State *L, int n_caps, int n_args, int n_locs, const Instr *ret_pc, void *fun) {
     inc_ci(L)
     lama_CallInfo *ci = L->ci;
-    ci->ret_ip = retip;
+    ci->ret_pc = ret_pc;
     ci->n_caps = n_caps;
     ci->n_args = n_args;
     ci->n_locs = n_locs;
+    ci->n_extra = 0;
 
     if(fun == NULL)
         lama_pushdummy(L)
@@ -670,17 +656,15 @@ static void lama_begin(lama_State *L, int n_caps, int n_args, int n_locs, char *
     lama_settop(L, n_caps + n_locs);
     L->base = ci->base = stack_top;
 
-    for(int i = 0; i < n_caps; i++) {
-        lama_Loc loc = {i, LOC_C};
-        *loc2adr(L, loc, bf) = cast(void**, fun)[i + 1];
-    }
-    for(int i = 0; i < n_locs; i++) {
-        lama_Loc loc = {i, LOC_L};
-        *loc2adr(L, loc, bf) = cast(void*, 1);
-    }
+    /* Размеры кадра только что заданы, поэтому слоты адресуются напрямую
+       (раскладка - как в loc2adr) */
+    for(int i = 0; i < n_caps; i++)
+        L->base[n_caps + n_locs - i] = FIELD(fun, i + 1);
+    for(int i = 0; i < n_locs; i++)
+        L->base[n_locs - i] = cast(void*, 1);
 }
 
-static void lama_end(lama_State *L, const bytefile *bf) {
+static void lama_end(lama_State *L) {
     void *ret = *idx2StkId(L, 1);
     int n_caps = L->ci->n_caps;
     int n_args = L->ci->n_args;
@@ -693,18 +677,72 @@ static void lama_end(lama_State *L, const bytefile *bf) {
 
     void *fun = *(L->base + (n_caps + n_locs + 1));
     for(int i = 0; i < n_caps; i++) {
-        lama_Loc loc = {i, LOC_C};
-        cast(void**, fun)[i + 1] = *loc2adr(L, loc, bf);
+        SET_FIELD(fun, i + 1, L->base[n_caps + n_locs - i]);
+        GC_WRITE_BARRIER(fun, L->base[n_caps + n_locs - i]);
     }
 
-    set_gc_ptr(__gc_stack_top, stack_top + (n_caps + n_args + n_locs + 2));
+    set_gc_ptr(__gc_stack_top, stack_top + (n_caps + n_args + n_locs + 2 + L->ci->n_extra));
 
-    L->ip = L->ci->ret_ip;
+    L->pc = L->ci->ret_pc;
     ++L->ci;
     L->base = L->ci->base;
     lama_push(L, ret);
 }
 
+/* Точный обход корней стека (gc_root_scan_stack в runtime) по цепочке
+   CallInfo вместо консервативного просмотра всего стека. Корни - все
+   глобальные, стек операндов каждого кадра, захваты, функция кадра с
+   захватами (их записывает обратно END) и живые по карте стека
+   (tools/stackmap.h) локальные и аргументы. Фиктивные слова
+   lama_pushdummy, замыкание под аргументами (n_extra) и мертвые слоты не
+   просматриваются. Кадр без карты (функция с ошибкой загрузки)
+   просматривается целиком. */
+static StackMaps *stack_maps;
+
+#define gc_root(p) do { \
+            if (!UNBOXED(*(p))) gc_test_and_copy_root(cast(size_t**, (p))); \
+        } while (0)
+
+static void lama_scan_frame(const lama_CallInfo *ci, const Instr *pc) {
+    StkId base = ci->base;
+    int n_caps = ci->n_caps, n_args = ci->n_args, n_locs = ci->n_locs;
+    StackMap map;
+    bool precise = pc && stackmap_find(stack_maps, pc, &map) &&
+                   map.n_locs == n_locs && map.n_args == n_args;
+
+    /* раскладка - как в loc2adr */
+    for (int i = 0; i < n_locs; i++)
+        if (!precise || stackmap_live(&map, i))
+            gc_root(base + n_locs - i);
+    for (int i = 0; i < n_caps; i++)
+        gc_root(base + n_caps + n_locs - i);
+    if (n_caps > 0)
+        gc_root(base + n_caps + n_locs + 1);
+    for (int i = 0; i < n_args; i++)
+        if (!precise || stackmap_live(&map, n_locs + i))
+            gc_root(base + n_caps + n_args + n_locs + 1 - i);
+}
+
+static void lama_scan_stack(void) {
+    lama_State *L = &eval_state;
+    for (int i = 0; i < L->n_globals; i++)
+        gc_root(stack_bottom - i);
+
+    /* верхний кадр стоит на текущей инструкции, остальные - на вызове */
+    StkId top = stack_top;
+    const Instr *pc = L->native ? L->native->gc_at : L->pc - 1;
+    for (const lama_CallInfo *ci = L->ci; ; ci++) {
+        for (StkId p = top + 1; p <= ci->base; p++)
+            gc_root(p);
+        if (ci == L->base_ci) break;
+        lama_scan_frame(ci, pc);
+        top = ci->base + ci->n_caps + ci->n_args + ci->n_locs + 1 + ci->n_extra;
+        pc = ci->ret_pc - 1;
+    }
+}
+
+#undef gc_root
+
 /* Найти точку входа main в таблице публичных символов */
 static const char* find_main_entrypoint(const bytefile *bf) {
     if (bf->public_symbols_number == 0) {
@@ -740,28 +778,167 @@ static const char* find_main_entrypoint(const bytefile *bf) {
     return NULL;
 }
 
-static void check_jump_offset(const lama_State *L, int offset) {
-    /* code_start + offset должен указывать внутрь кода (до code_end) */
-    if (offset < 0 || L->code_start + offset >= L->code_end) {
-        failure("Invalid jump offset: %d (code range: %p-%p, last valid at %p)\n",
-               offset, L->code_start, L->code_end, L->code_end - 1);
+/* Захваты проверяются при исполнении: их число известно только из замыкания */
+static void check_capture(lama_State *L, int idx, const bytefile *bf) {
+    if (idx >= L->ci->n_caps) {
+        ERROR_AT(L, bf, "Bounds error accessing capture[%d]\n"
+                "  Maximum allowed: %d\n", idx, L->ci->n_caps);
+    }
+}
+
+/* Адрес захватываемой переменной по предвычисленному описанию */
+static void **qloc2adr(lama_State *L, const QLoc *c, const bytefile *bf) {
+    switch (c->tt) {
+        case LOC_G: return stack_bottom - c->off;
+        case LOC_L: return L->base + c->off;
+        case LOC_C: check_capture(L, c->idx, bf); /* fallthrough */
+        default:    return L->base + L->ci->n_caps + c->off;
+    }
+}
+
+/* Ошибка, обнаруженная quicken() при загрузке и отложенная до исполнения */
+static void quick_fault(lama_State *L, const Instr *in, const bytefile *bf) __attribute__((noreturn));
+static void quick_fault(lama_State *L, const Instr *in, const bytefile *bf) {
+    unsigned char h = (unsigned char)*in->src >> 4;
+    unsigned char l = (unsigned char)*in->src & 0x0F;
+    static const char *loc_names[LOC_N] = {"global", "local", "argument", "capture"};
+
+    switch (in->a) {
+        case QFAULT_INVALID_OP:
+            switch (h) {
+                case OP_BINOP:   OPFAIL(L, bf, "Invalid binary operation\n");
+                case OP_PRIMARY: OPFAIL(L, bf, "Invalid primary opcode\n");
+                case OP_LD:
+                    OPFAIL(L, bf, "Invalid location type for LD: %d (max %d)\n",
+                        l, LOC_N - 1);
+                case OP_LDA:
+                    ERROR_AT(L, bf, "Invalid location type for LDA: %d\n", l);
+                case OP_ST:
+                    ERROR_AT(L, bf, "Invalid location type for ST: %d\n", l);
+                case OP_CTRL:    OPFAIL(L, bf, "Invalid control opcode\n");
+                case OP_PATT:    OPFAIL(L, bf, "Invalid pattern opcode\n");
+                case OP_BUILTIN: OPFAIL(L, bf, "Invalid builtin opcode\n");
+                default:
+                    ERROR_AT(L, bf, "Invalid opcode prefix: %d\n", h);
+            }
+        case QFAULT_TRUNCATED:
+            ERROR_AT(L, bf, "Bytecode read out of bounds: only %d byte(s) left for "
+                    "opcode 0x%02x and its operands\n", in->b, (unsigned char)*in->src);
+        case QFAULT_BAD_JUMP:
+            ERROR_AT(L, bf, "Invalid jump offset: %d (code size %ld)\n",
+                    in->b, (long)(L->code_end - L->code_start));
+        case QFAULT_BAD_CALL: {
+            unsigned char first_byte = (unsigned char)bf->code_ptr[in->b];
+            ERROR_AT(L, bf, "Invalid function pointer in %s at offset %d: "
+                    "opcode %d-%d (0x%02x), expected %d-{%d,%d}\n",
+                    h == OP_CTRL && l == CTRL_CALL ? "CALL" : "CLOSURE",
+                    in->b, first_byte >> 4, first_byte & 0x0F, first_byte,
+                    OP_CTRL, CTRL_BEGIN, CTRL_CBEGIN);
+        }
+        case QFAULT_BAD_LOC:
+            if (h == OP_CTRL)
+                ERROR_AT(L, bf, "CLOSURE: invalid reference for capture #%d\n", in->b);
+            ERROR_AT(L, bf, "Bounds error accessing %s[%d] outside of the current frame\n",
+                    loc_names[l], in->b);
+        case QFAULT_BAD_STRING:
+            ERROR_AT(L, bf, "String index out of bounds: pos=%d, stringtab_size=%d\n",
+                    in->b, bf->stringtab_size);
+        default:
+            failure("INTERNAL: unknown load-time fault %d\n", in->a);
     }
 }
 
-void eval (const bytefile *bf, const char *fname) {
+/* Мономорфный кэш места вызова CALLC по точке входа и числу захватов
+   замыкания fun. При промахе кэш переходит на новое замыкание, если его
+   BEGIN/CBEGIN примет этот вызов; NULL - вызов идет общим путем */
+static CallCache *callc_cache(QCode *q, const Instr *in, void *fun) {
+    CallCache *c = &q->calls[in->b];
+    const Instr *entry = qcode_closure_target(q, FIELD(fun, 0));
+    int n_args = in->a;
+    int n_caps = LEN(TO_DATA(fun)->tag) - 1;
+    if (c->entry == entry && c->n_caps == n_caps)
+        return c;
+    if (entry->a == n_args && n_args >= 0 && entry->b >= 0 &&
+        (entry->op == BC_CBEGIN || (entry->op == BC_BEGIN && n_caps == 0))) {
+        *c = (CallCache){entry, n_caps, n_args, entry->b};
+        return c;
+    }
+    return NULL;
+}
+
+/* Цикл интерпретатора: с проверками, без них, с JIT и для регистровой
+   формы (см. lvm_loop.inc) */
+#define LVM_TRUSTED 0
+#define LVM_JIT 0
+#define LVM_REGISTER 0
+#define LVM_EXECUTE execute_checked
+#include "lvm_loop.inc"
+#undef LVM_TRUSTED
+#undef LVM_JIT
+#undef LVM_REGISTER
+#undef LVM_EXECUTE
+
+#define LVM_TRUSTED 1
+#define LVM_JIT 0
+#define LVM_REGISTER 0
+#define LVM_EXECUTE execute_trusted
+#include "lvm_loop.inc"
+#undef LVM_TRUSTED
+#undef LVM_JIT
+#undef LVM_REGISTER
+#undef LVM_EXECUTE
+
+#define LVM_TRUSTED 1
+#define LVM_JIT 1
+#define LVM_REGISTER 0
+#define LVM_EXECUTE execute_jit
+#include "lvm_loop.inc"
+#undef LVM_TRUSTED
+#undef LVM_JIT
+#undef LVM_REGISTER
+#undef LVM_EXECUTE
+
+#define LVM_TRUSTED 1
+#define LVM_JIT 0
+#define LVM_REGISTER 1
+#define LVM_EXECUTE execute_register
+#include "lvm_loop.inc"
+#undef LVM_TRUSTED
+#undef LVM_JIT
+#undef LVM_REGISTER
+#undef LVM_EXECUTE
+
+/* Режимы исполнения (ключи командной строки) */
+typedef enum {
+    EXEC_CHECKED,   // по умолчанию
+    EXEC_TRUSTED,   // --trusted: verify_quickened, затем цикл без проверок
+    EXEC_JIT,       // --jit: то же и машинный код горячих функций
+    EXEC_TIER_STATS,// --tier-stats: --jit и отчет о счетчиках и переходах между уровнями
+    EXEC_REGISTER   // --regvm: verify_quickened, регистровая форма кода и ее цикл
+} ExecMode;
+
+void eval (const bytefile *bf, const char *fname, ExecMode mode) {
    lama_State *L = &eval_state;
-   L->ip = find_main_entrypoint(bf);  // Начинаем с main
+   const char *entry = find_main_entrypoint(bf);  // Начинаем с main
    L->code_start = bf->code_ptr;
    /* ВАЖНОЕ ИСПРАВЛЕНИЕ: code_end указывает на ПЕРВЫЙ байт ПОСЛЕ конца кода */
    L->code_end = code_stop_ptr + 1;  // +1 чтобы указывать за пределы кода
    L->n_globals = bf->global_area_size;
 
    // Проверка, что main находится в пределах кода
-   if (L->ip < L->code_start || L->ip >= L->code_end) {
+   if (entry < L->code_start || entry >= L->code_end) {
         failure("Main entrypoint %p out of bounds [%p, %p) in %s\n"
             "Offset: %ld, Code size: %ld bytes\n",
-            L->ip, L->code_start, L->code_end, fname,
-            L->ip - bf->code_ptr, L->code_end - L->code_start);
+            entry, L->code_start, L->code_end, fname,
+            entry - bf->code_ptr, L->code_end - L->code_start);
+   }
+
+   /* Предекодирование: операнды читаются и проверяются один раз */
+   QCode *q = quicken(bf, L->code_end - L->code_start);
+   L->pc = qcode_at(q, entry);
+   if (L->pc == NULL) {
+        failure("Main entrypoint at offset %ld is not an instruction boundary in %s\n",
+            entry - bf->code_ptr, fname);
    }
 
    void **stack_start = alloc_stack(void*, INIT_STACK_SIZE);
@@ -769,6 +946,7 @@ void eval (const bytefile *bf, const char *fname) {
         failure("Failed to allocate %zu bytes for stack: %s\n",
             INIT_STACK_SIZE * sizeof(void*), strerror(errno));
    }
+   L->stack_block = stack_start;
    __gc_stack_top = set_gc_ptr(__gc_stack_bottom, stack_start + INIT_STACK_SIZE - 1);
    L->base = stack_bottom;
    L->stacksize = INIT_STACK_SIZE;
@@ -780,6 +958,7 @@ void eval (const bytefile *bf, const char *fname) {
        failure("Failed to allocate %zu bytes for CallInfo after successful stack allocation: %s\n",
             INIT_STACK_SIZE * sizeof(lama_CallInfo), strerror(errno));
    }
+   L->ci_block = ci_start;
    L->base_ci = L->ci = ci_start + INIT_STACK_SIZE - 1;
    L->size_ci = INIT_STACK_SIZE;
    L->end_ci = L->base_ci - L->size_ci;
@@ -791,439 +970,149 @@ void eval (const bytefile *bf, const char *fname) {
    lama_pushnumber(L, 0);
    lama_pushnumber(L, 0);
 
-   L->ci->n_locs = L->ci->n_args = 0;
+   L->ci->n_locs = L->ci->n_args = L->ci->n_caps = L->ci->n_extra = 0;
    L->ci->base = L->base;
    lama_pushnumber(L, 0);
    lama_pushdummy(L);
 
-   char *ret_ip = code_stop_ptr;
-
-   for(int i = 0; i < L->n_globals; i++) {
-        lama_Loc loc = {i, LOC_G};
-        *loc2adr(L, loc, bf) = cast(void*, 1);
-   }
-
-   do {
-#ifdef DEBUG
-        printstack(L);
-        printglobals(L, bf);
-        printlocals(L, bf);
-        printargs(L, bf);
-        printf("=============\n");
-#endif
-        /* Проверяем, не достигли ли мы конца кода перед чтением */
-        if (L->ip >= L->code_end) {
-            failure("Reached end of bytecode without stop opcode\n");
+   /* main возвращается на завершающий HALT (или на сторожа за концом кода) */
+   const Instr *ret_pc = qcode_at(q, code_stop_ptr);
+   if (ret_pc == NULL) ret_pc = &q->code[q->n_code];
+
+   for(int i = 0; i < L->n_globals; i++)
+        *(stack_bottom - i) = cast(void*, 1);
+
+   /* Места выделения памяти - смещения в байткоде (см. vmalloc) */
+   gc_sites_init(bf->code_ptr, L->code_end - L->code_start);
+
+   /* LVM_GC_CONSERVATIVE - прежний консервативный просмотр стека (для сравнения) */
+   stack_maps = stackmap_build(q);
+   if (getenv("LVM_GC_CONSERVATIVE") == NULL)
+        gc_root_scan_stack = lama_scan_stack;
+
+   /* Проверки, доказанные верификатором, в режимах --trusted и --jit не
+      выполняются; машинный код порождается только для проверенного кода */
+   bool verified = false;
+   if (mode != EXEC_CHECKED) {
+        VerificationError err;
+        verified = verify_quickened(q, L->pc, &err);
+        if (!verified) {
+            fprintf(stderr, "%s: not verified at offset %d (0x%x): %s; "
+                    "running with runtime checks\n", fname, err.offset, err.offset, err.message);
+            free(err.message);
         }
+   }
 
-        check_ip_bounds(L, 1, bf);
-        //char x = read_byte(L, bf), h = (x & 0xF0) >> 4, l = x & 0x0F;
-        unsigned char x = read_byte(L, bf);
-        unsigned char h = (x & 0xF0) >> 4;
-        unsigned char l = x & 0x0F;
-
-        switch (h) {
-            case OP_HALT:
-                goto stop;
-            case OP_BINOP: { //BINOP
-                print_debug("BINOP\n");
-
-                int nc = cast(int, *idx2StkId(L, 1));
-                if(UNBOXED(nc)) nc = UNBOX(nc);
-                int nb = cast(int, *idx2StkId(L, 2));
-                if(UNBOXED(nb)) nb = UNBOX(nb);
-                lama_pop(L, 2);
-                switch (l) {
-                    case OP_ADD:    lama_pushnumber(L, lama_numadd(nb,nc)); break;
-                    case OP_SUB:    lama_pushnumber(L, lama_numsub(nb,nc)); break;
-                    case OP_MUL:    lama_pushnumber(L, lama_nummul(nb,nc)); break;
-                    case OP_DIV:    lama_pushnumber(L, lama_numdiv(nb,nc)); break;
-                    case OP_MOD:    lama_pushnumber(L, lama_nummod(nb,nc)); break;
-                    case OP_LT:     lama_pushnumber(L, lama_numlt(nb,nc));  break;
-                    case OP_LE:     lama_pushnumber(L, lama_numle(nb,nc));  break;
-                    case OP_GT:     lama_pushnumber(L, lama_numgt(nb,nc));  break;
-                    case OP_GE:     lama_pushnumber(L, lama_numge(nb,nc));  break;
-                    case OP_EQ:     lama_pushnumber(L, lama_numeq(nb,nc));  break;
-                    case OP_NEQ:    lama_pushnumber(L, lama_numneq(nb,nc)); break;
-                    case OP_AND:    lama_pushnumber(L, lama_numand(nb,nc)); break;
-                    case OP_OR:     lama_pushnumber(L, lama_numor(nb,nc));  break;
-                    default:
-                        OPFAIL(L, bf, "Invalid binary operation\n");
-                }
-                break;
-            }
-            case OP_PRIMARY:
-                switch (l) {
-                    case PRIMARY_CONST: //CONST
-                        print_debug("CONST\n");
-                        lama_pushnumber(L, read_int(L, bf));
-                        break;
-                    case PRIMARY_STRING: //STRING
-                        print_debug("STRING\n");
-                        lama_push(L, Bstring(get_string(bf, read_int(L, bf))));
-                        break;
-                    case PRIMARY_SEXP: { //SEXP
-                        print_debug("SEXP\n");
-                        int tag = LtagHash(get_string(bf, read_int(L, bf)));
-                        int n = read_int(L, bf);
-                        void* b = LmakeSexp(BOX(n + 1), tag);
-                        for (int i = 0; i < n; i++)
-                            cast(void**, b)[i] = *idx2StkId(L, n - i);
-                        lama_pop(L, n);
-                        lama_push(L, b);
-                        break;
-                    }
-                    case PRIMARY_STI: //STI
-                        ERROR_AT(L, bf, "Invalid opcode: STI\n");
-                    case PRIMARY_STA: { //STA
-                        print_debug("STA\n");
-                        StkId v = *idx2StkId(L, 1);
-                        int i = cast(int, *idx2StkId(L, 2));
-                        StkId x = *idx2StkId(L, 3);
-                        lama_pop(L, 3);
-                        lama_push(L, Bsta(v, i, x));
-                        break;
-                    }
-                    case PRIMARY_JMP: { //JMP
-                        print_debug("JMP\n");
-                        int addr = read_int(L, bf);
-                        check_jump_offset(L, addr);
-                        L->ip = bf->code_ptr + addr;
-                        break;
-                    }
-                    case PRIMARY_END: //END
-                        print_debug("END\n");
-                        lama_end(L, bf);
-                        break;
-                    case PRIMARY_RET: //RET
-                        ERROR_AT(L, bf, "Invalid opcode: RET\n");
-                    case PRIMARY_DROP: //DROP
-                        print_debug("DROP\n");
-                        lama_pop(L, 1);
-                        break;
-                    case PRIMARY_DUP: //DUP
-                        print_debug("DUP\n");
-                        lama_push(L, *idx2StkId(L, 1));
-                        break;
-                    case PRIMARY_SWAP: { //SWAP
-                        print_debug("SWAP\n");
-                        swap(*idx2StkId(L, 1), *idx2StkId(L, 2));
-                        break;
-                    }
-                    case PRIMARY_ELEM: { //ELEM
-                        print_debug("ELEM\n");
-                        int i = cast(int, *idx2StkId(L, 1));
-                        void* p = *idx2StkId(L, 2);
-                        lama_pop(L, 2);
-                        lama_push(L, Belem(p, i));
-                        break;
-                    }
-                    default:
-                        OPFAIL(L, bf, "Invalid primary opcode\n");
-                }
-                break;
-            case OP_LD: { //LD
-                print_debug("LD");
-                unsigned char loc_type = l;
-                if (loc_type >= LOC_N) {  // LOC_N = 4
-                    OPFAIL(L, bf, "Invalid location type for LD: %d (max %d)\n",
-                        loc_type, LOC_N - 1);
-                }
-                lama_Loc loc = {read_int(L, bf), (char)loc_type};  // Приведение к char
-                lama_push(L, *loc2adr(L, loc, bf));
-                break;
-            }
-            case OP_LDA: { //LDA
-                print_debug("LDA\n");
-                unsigned char loc_type = l;
-                if (loc_type >= LOC_N) {
-                    ERROR_AT(L, bf, "Invalid location type for LDA: %d\n", loc_type);
-                }
-                lama_Loc loc = {read_int(L, bf), (char)loc_type};
-                lama_push(L, loc2adr(L, loc, bf));
-                lama_pushdummy(L);
-                break;
-            }
-            case OP_ST: { //ST
-                print_debug("ST\n");
-                unsigned char loc_type = l;
-                if (loc_type >= LOC_N) {
-                    ERROR_AT(L, bf, "Invalid location type for ST: %d\n", loc_type);
-                }
-                lama_Loc loc = {read_int(L, bf), (char)loc_type};
-                *loc2adr(L, loc, bf) = *idx2StkId(L, 1);
-                break;
-            }
-            case OP_CTRL:
-                switch (l) {
-                    case CTRL_CJMPz: { //CJMPz
-                        print_debug("CJMPz\n");
-                        int n = lama_tonumber(L, 1, bf);
-                        lama_pop(L, 1);
-                        int addr = read_int(L, bf);
-                        check_jump_offset(L, addr);
-                        if(n == 0) L->ip = bf->code_ptr + addr;
-                        break;
-                    }
-                    case CTRL_CJMPnz: { //CJMPnz
-                        print_debug("CJMPnz\n");
-                        int n = lama_tonumber(L, 1, bf);
-                        lama_pop(L, 1);
-                        int addr = read_int(L, bf);
-                        check_jump_offset(L, addr);
-                        if(n != 0) L->ip = bf->code_ptr + addr;
-                        break;
-                    }
-                    case CTRL_BEGIN: {
-                        print_debug("BEGIN\n");
+   /* --regvm: исполняется регистровая форма; вход в main и возврат из нее -
+      ее инструкции с теми же смещениями в байткоде */
+   QCode *rq = NULL;
+   if (verified && mode == EXEC_REGISTER) {
+        rq = regvm_translate(q);
+        L->pc = qcode_at(rq, entry);
+        ret_pc = qcode_at(rq, code_stop_ptr);
+        if (ret_pc == NULL) ret_pc = &rq->code[rq->n_code];
+   }
 
-                        // Проверяем, что на стеке достаточно элементов
-                        if (L->base - stack_top < 2) {
-                            ERROR_AT(L, bf, "BEGIN: stack underflow, need 2 values, have %ld\n",
-                                    (long)(L->base - stack_top));
-                        }
+   Jit *jit = NULL;
+   if (verified && (mode == EXEC_JIT || mode == EXEC_TIER_STATS)) {
+        jit = jit_new(q, jit_native_call, jit_native_end);
+        if (!jit)
+            fprintf(stderr, "%s: JIT is not supported on this platform; "
+                    "running with the interpreter\n", fname);
+   }
 
-                        int n_caps = lama_tonumber(L, 2, bf);
-                        if (n_caps != 0) {
-                            void *cap_value = *idx2StkId(L, 2);
-                            ERROR_AT(L, bf, "BEGIN: expected 0 captures for non-closure function, "
-                                    "got %d (value=%p, %s)\n",
-                                    n_caps, cap_value,
-                                    UNBOXED(cap_value) ? "unboxed number" : "boxed value");
-                        }
+   if (rq)
+        execute_register(L, bf, fname, rq, ret_pc, NULL);
+   else if (jit)
+        execute_jit(L, bf, fname, q, ret_pc, jit);
+   else if (verified)
+        execute_trusted(L, bf, fname, q, ret_pc, NULL);
+   else
+        execute_checked(L, bf, fname, q, ret_pc, NULL);
+
+    if (mode == EXEC_TIER_STATS) {
+        if (jit)
+            jit_report(jit, bf->code_ptr, stderr);
+        else
+            fprintf(stderr, "tier stats: no native tier, all code interpreted\n");
+    }
 
-                        void *fun = *idx2StkId(L, 1);
-                        if(lama_isdummy(L, 1)) {
-                            fun = NULL;
-                        // Leads to ERROR:
-                        // ERROR at offset 0 (0x0): BEGIN: expected function or dummy at stack[1], got `addr` (tag=0)
-                        } /* else if (!ttisfunction(fun) && fun != NULL) {
-                            ERROR_AT("BEGIN: expected function or dummy at stack[1], "
-                                    "got %p (tag=%d)\n",
-                                    fun, !UNBOXED(fun) ? TO_DATA(fun)->tag : -1);
-                        } */
-
-                        lama_pop(L, 2);
-                        int n_args = read_int(L, bf), n_locs = read_int(L, bf);
-
-                        // Дополнительные проверки аргументов
-                        if (n_args < 0) ERROR_AT(L, bf, "BEGIN: negative n_args: %d\n", n_args);
-                        if (n_locs < 0) ERROR_AT(L, bf, "BEGIN: negative n_locs: %d\n", n_locs);
-
-                        lama_begin(L, 0, n_args, n_locs, ret_ip, fun, bf);
-                        break;
-                    }
-                    case CTRL_CBEGIN: { //CBEGIN
-                        print_debug("CBEGIN\n");
-                        int n_caps = lama_tonumber(L, 2, bf);
-                        void *fun = *idx2StkId(L, 1);
-                        if(lama_isdummy(L, 1)) fun = NULL;
-                        lama_pop(L, 2);
-                        int n_args = read_int(L, bf), n_locs = read_int(L, bf);
-                        lama_begin(L, n_caps, n_args, n_locs, ret_ip, fun, bf);
-                        break;
-                    }
-                    case CTRL_CLOSURE: { //CLOSURE
-                        print_debug("CLOSURE\n");
-                        int func_offset = read_int(L, bf);
-                        check_jump_offset(L, func_offset);
-                        int n_caps = read_int(L, bf);
-                        void *fun = LMakeClosure(BOX(n_caps), bf->code_ptr + func_offset);
-                        for (int i = 0; i < n_caps; i++) {
-                            //char tt = read_byte(L, bf);
-                            unsigned char tt_byte = read_byte(L, bf);
-                            if (tt_byte >= LOC_N) {
-                                failure("Invalid location type %d\n", tt_byte);
-                            }
-                            char tt = (char)tt_byte;
-                            int idx = read_int(L, bf);
-                            lama_Loc loc = {idx, tt};
-                            cast(void**, fun)[i + 1] = *loc2adr(L, loc, bf);
-                        }
-                        lama_push(L, fun);
-                        break;
-                    }
-                    case CTRL_CALLC: {
-                        print_debug("CALLC\n");
-                        int n_args = read_int(L, bf);
-                        void *fun = *idx2StkId(L, n_args + 1);
-
-                        /* Улучшенная проверка функции */
-                        if (!ttisfunction(fun)) {
-                            char *type = "unknown/boxed";
-                            if (UNBOXED(fun)) type = "unboxed number";
-                            else if (ttisstring(fun)) type = "string";
-                            else if (ttisarray(fun)) type = "array";
-                            else if (ttissexp(fun)) type = "sexp";
-
-                            ERROR_AT(L, bf, "CALLC expected function at stack position %d, got %s (value: %p)\n",
-                                    n_args + 1, type, fun);
-                        }
+    /* --heap-profile: runtime считал выделения по местам (LVM_HEAP_PROFILE) */
+    char *profile = getenv("LVM_HEAP_PROFILE");
+    if (profile != NULL) {
+        heap_profile_report(bf, L->code_end - L->code_start, stderr);
+        /* строки в профиле - строки исходника: X.bc собран из X.lama */
+        char source[PATH_MAX];
+        size_t n = strlen(fname);
+        if (n > 3 && strcmp(fname + n - 3, ".bc") == 0 && n + 2 < sizeof(source))
+            snprintf(source, sizeof(source), "%.*s.lama", (int)(n - 3), fname);
+        else
+            snprintf(source, sizeof(source), "%s", fname);
+        if (*profile != '\0' && !heap_profile_pprof(bf, L->code_end - L->code_start, source, profile))
+            fprintf(stderr, "%s: cannot write the heap profile to %s: %s\n", fname, profile, strerror(errno));
+    }
 
-                        for(int i = n_args; i > 0; i--)
-                            *idx2StkId(L, i + 1) = *idx2StkId(L, i);
-                        lama_pop(L, 1);
-                        int n_caps = LEN(TO_DATA(fun)->tag) - 1;
-                        lama_pushnumber(L, n_caps); //n_caps
-                        lama_push(L, fun);
-                        ret_ip = L->ip;
-                        char *func_ptr = cast(char**, fun)[0];
-
-                        /* Улучшенная проверка указателя функции */
-                        unsigned char first_byte = (unsigned char)*func_ptr;
-                        unsigned char func_h = (first_byte & 0xF0) >> 4;
-                        unsigned char func_l = first_byte & 0x0F;
-
-                        if (func_h != OP_CTRL ||
-                            (func_l != CTRL_BEGIN && func_l != CTRL_CBEGIN)) {
-                            ERROR_AT(L, bf, "Invalid function pointer in CALLC: opcode %d-%d (0x%02x) at %p, "
-                                    "expected %d-{%d,%d}\n",
-                                    func_h, func_l, first_byte, func_ptr,
-                                    OP_CTRL, CTRL_BEGIN, CTRL_CBEGIN);
-                        }
+    jit_free(jit);
+    stackmap_free(stack_maps);
+    qcode_free(rq);
+    qcode_free(q);
+    /* стек и цепочка CallInfo могли быть перевыделены при росте */
+    free(L->stack_block);
+    free(L->ci_block);
 
-                        L->ip = func_ptr;
-                        break;
-                    }
-                    case CTRL_CALL: { //CALL
-                        print_debug("CALL\n");
-                        int func_offset = read_int(L, bf);
-                        check_jump_offset(L, func_offset);
-                        int n_args = read_int(L, bf);
-                        char *func_ptr = bf->code_ptr + func_offset;
-
-                        /* Улучшенная проверка указателя функции */
-                        unsigned char first_byte = (unsigned char)*func_ptr;
-                        unsigned char func_h = (first_byte & 0xF0) >> 4;
-                        unsigned char func_l = first_byte & 0x0F;
-
-                        if (func_h != OP_CTRL ||
-                            (func_l != CTRL_BEGIN && func_l != CTRL_CBEGIN)) {
-                            ERROR_AT(L, bf, "Invalid function pointer in CALL at offset %d: "
-                                    "opcode %d-%d (0x%02x) at %p, expected %d-{%d,%d}\n",
-                                    func_offset, func_h, func_l, first_byte, func_ptr,
-                                    OP_CTRL, CTRL_BEGIN, CTRL_CBEGIN);
-                        }
+    #undef ERROR_AT
+    #undef OPFAIL
+}
 
-                        lama_pushnumber(L, 0); //n_caps
-                        lama_pushdummy(L);
-                        ret_ip = L->ip;
-                        L->ip = func_ptr;
-                        break;
-                    }
-                    case CTRL_TAG: { //TAG
-                        print_debug("TAG\n");
-                        int t = LtagHash(get_string(bf, read_int(L, bf)));
-                        int n = read_int(L, bf);
-                        *idx2StkId(L, 1) = cast(void*, Btag(*idx2StkId(L, 1), t, BOX(n)));
-                        break;
-                    }
-                    case CTRL_ARRAY: { //ARRAY
-                        print_debug("ARRAY\n");
-                        int n = read_int(L, bf);
-                        *idx2StkId(L, 1) = cast(void*, Barray_patt(*idx2StkId(L, 1), BOX(n)));
-                        break;
-                    }
-                    case CTRL_FAIL: { //FAIL
-                        print_debug("FAIL\n");
-                        int line = read_int(L, bf);
-                        int col = read_int(L, bf);
-                        void *v = *idx2StkId(L, 1);
-                        Bmatch_failure(v, fname, line, col);
-                        exit(0);
-                    }
-                    case CTRL_LINE: { //LINE
-                        int line = read_int(L, bf);
-                        print_debug("LINE %d\n", line);
-                        break;
-                    }
-                    default:
-                        OPFAIL(L, bf, "Invalid control opcode\n");
-                }
-                break;
-            case OP_PATT: { //PATT
-                print_debug("PATT\n");
-                switch (l) {
-                    case PATT_STR: //=str
-                        *idx2StkId(L, 2) = cast(void*, Bstring_patt(*idx2StkId(L, 2), *idx2StkId(L, 1)));
-                        lama_pop(L, 1);
-                        break;
-                    case PATT_STRING_TAG: //#string
-                        *idx2StkId(L, 1) = cast(void*, Bstring_tag_patt(*idx2StkId(L, 1)));
-                        break;
-                    case PATT_ARRAY_TAG: //#array
-                        *idx2StkId(L, 1) = cast(void*, Barray_tag_patt(*idx2StkId(L, 1)));
-                        break;
-                    case PATT_SEXP_TAG: //#sexp
-                        *idx2StkId(L, 1) = cast(void*, Bsexp_tag_patt(*idx2StkId(L, 1)));
-                        break;
-                    case PATT_REF: //#ref
-                        *idx2StkId(L, 1) = cast(void*, Bboxed_patt(*idx2StkId(L, 1)));
-                        break;
-                    case PATT_VAL: //#val
-                        *idx2StkId(L, 1) = cast(void*, Bunboxed_patt(*idx2StkId(L, 1)));
-                        break;
-                    case PATT_FUN: //#fun
-                        *idx2StkId(L, 1) = cast(void*, Bclosure_tag_patt(*idx2StkId(L, 1)));
-                        break;
-                    default:
-                        OPFAIL(L, bf, "Invalid pattern opcode\n");
-                }
-                break;
-            }
-            case OP_BUILTIN: {
-                switch (l) {
-                    case BUILTIN_READ: // CALL Lread
-                        print_debug("Lread\n");
-                        lama_push(L, cast(void*, Lread()));
-                        break;
-                    case BUILTIN_WRITE: //CALL Lwrite
-                        print_debug("Lwrite\n");
-                        Lwrite(cast(int, *idx2StkId(L, 1)));
-                        break;
-                    case BUILTIN_LENGTH: //CALL Llength
-                        print_debug("Llength\n");
-                        *idx2StkId(L, 1) = cast(void*, Blength(*idx2StkId(L, 1)));
-                        break;
-                    case BUILTIN_STRING: //CALL Lstring
-                        print_debug("Lstring\n");
-                        *idx2StkId(L, 1) = Bstringval(*idx2StkId(L, 1));
-                        break;
-                    case BUILTIN_ARRAY: { //CALL Barray
-                        print_debug("Barray\n");
-                        int n = read_int(L, bf);
-                        void *p = LmakeArray(BOX(n));
-                        for (int i = 0; i < n; i++)
-                            cast(void**, p)[i] = *idx2StkId(L, n - i);
-                        lama_pop(L, n);
-                        lama_push(L, p);
-                        break;
-                    }
-                    default:
-                        OPFAIL(L, bf, "Invalid builtin opcode\n");
-                }
-                break;
-            }
-            default:
-                ERROR_AT(L, bf, "Invalid opcode prefix: %d\n", h);
+/* Размеры кучи: runtime читает их из окружения при первом выделении памяти
+   (см. init_heap_sizing в runtime.c), поэтому флаг только задает переменную */
+static const struct { const char *flag, *var; } heap_flags[] = {
+    { "--heap-init=",   "LVM_HEAP_INIT" },
+    { "--heap-max=",    "LVM_HEAP_MAX" },
+    { "--heap-growth=", "LVM_HEAP_GROWTH" },
+    { "--gc-time=",     "LVM_GC_TIME_PCT" },
+    { "--huge-pages=",  "LVM_HUGEPAGES" },
+    { "--heap-profile=","LVM_HEAP_PROFILE" },
+};
+
+static bool heap_flag (const char *arg) {
+    /* без файла - только отчет в stderr */
+    if (strcmp(arg, "--heap-profile") == 0) {
+        setenv("LVM_HEAP_PROFILE", "", 1);
+        return true;
+    }
+    for (size_t i = 0; i < sizeof(heap_flags) / sizeof(heap_flags[0]); i++) {
+        size_t n = strlen(heap_flags[i].flag);
+        if (strncmp(arg, heap_flags[i].flag, n) == 0) {
+            setenv(heap_flags[i].var, arg + n, 1);
+            return true;
         }
     }
-    while (true);
-    stop:
-    free(stack_start);
-    free(ci_start);
-
-    #undef ERROR_AT
-    #undef OPFAIL
+    return false;
 }
 
 int main (int argc, char* argv[]) {
+    // флаги кучи идут перед режимом; argv[0] сдвигается вместе с остальными
+    while (argc > 1 && heap_flag(argv[1])) {
+        argv[1] = argv[0];
+        argv++;
+        argc--;
+    }
+
     if (argc < 2) {
         failure("Usage:\n"
                 "  %s program.bc – execute Lama bytecode\n"
+                "  %s --trusted program.bc – verify, then execute without runtime checks\n"
+                "  %s --jit program.bc – as --trusted, compiling hot functions to x86 code\n"
+                "  %s --tier-stats program.bc – as --jit, reporting tiering counters to stderr\n"
+                "  %s --regvm program.bc – as --trusted, translated to register form\n"
                 "  %s --idioms program.bc – analyze idioms\n"
-		        "  %s --verify program.bc - verify bytecode\n",
-                argv[0], argv[0], argv[0]);
+		        "  %s --verify program.bc - verify bytecode\n"
+                "Heap options, before the mode (sizes in bytes, with K, M or G):\n"
+                "  --heap-init=SIZE --heap-max=SIZE --heap-growth=FACTOR --gc-time=PERCENT\n"
+                "  --huge-pages=thp|hugetlb\n"
+                "  --heap-profile[=FILE] - allocations by site to stderr (and FILE in pprof format)\n",
+                argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0]);
     }
 
     if (strcmp(argv[1], "--verify") == 0 || strcmp(argv[1], "--verify-verbose") == 0) {
@@ -1334,8 +1223,22 @@ int main (int argc, char* argv[]) {
         return 0;
     }
 
+    if (strcmp(argv[1], "--trusted") == 0 || strcmp(argv[1], "--jit") == 0 ||
+        strcmp(argv[1], "--tier-stats") == 0 || strcmp(argv[1], "--regvm") == 0) {
+        if (argc < 3) failure("Usage: %s %s <bytecode-file>\n", argv[0], argv[1]);
+
+        ExecMode mode = strcmp(argv[1], "--trusted") == 0 ? EXEC_TRUSTED :
+                        strcmp(argv[1], "--jit") == 0 ? EXEC_JIT :
+                        strcmp(argv[1], "--regvm") == 0 ? EXEC_REGISTER : EXEC_TIER_STATS;
+        bytefile *f = read_file (argv[2]);
+        eval (f, argv[2], mode);
+        //free(f->global_ptr);
+        free(f);
+        return 0;
+    }
+
     bytefile *f = read_file (argv[1]);
-    eval (f, argv[1]);
+    eval (f, argv[1], EXEC_CHECKED);
     //free(f->global_ptr);
     free(f);
     return 0;
@@ -0,0 +1,4 @@
+  $ ../src/Driver.exe -runtime ../runtime -I ../stdlib/x64 -i test113.lama < test113.input
+  1000000
+  100000
+  2000000
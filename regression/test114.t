@@ -0,0 +1,3 @@
+  $ ../src/Driver.exe -runtime ../runtime -I ../stdlib/x64 -i test114.lama < test114.input
+  45
+  55
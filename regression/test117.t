@@ -0,0 +1,3 @@
+  $ ../src/Driver.exe -runtime ../runtime -I ../stdlib/x64 -i test117.lama < test117.input
+  200030000
+  65536
@@ -46,17 +46,36 @@ for FILE_PATH in "$BUILD_DIR"/*.lama; do
 	# run the reference interpreter.
 	EXPECTED_OUTPUT="$("$LAMAC" -i "$FILE_PATH" < "$INPUT_FILE" 2>&1)"
 
-	ACTUAL_OUTPUT="$("$LVM" "$BC_FILE" < "$INPUT_FILE" 2>&1 | tee /dev/tty)"
-
-	if ! [ "$EXPECTED_OUTPUT" = "$ACTUAL_OUTPUT" ]; then
-		echo -e "\033[91mtest failed!\033[m expected output:"
-		echo "$EXPECTED_OUTPUT"
-		FAILED=$(($FAILED + 1))
-		FAILED_NAMES+=("$FILE_NAME")
-	else
-		echo -e "\033[92mtest passed\033[m"
-		PASSED=$(($PASSED + 1))
+	# runtime settings for the test: VAR=value lines in $STEM.env; every
+	# $STEM.<variant>.env runs the test once more with its own settings.
+	ENV_FILES=("")
+	if [ -f "$BUILD_DIR/$STEM.env" ]; then
+		ENV_FILES=("$BUILD_DIR/$STEM.env")
 	fi
+	for ENV_FILE in "$BUILD_DIR/$STEM".*.env; do
+		[ -f "$ENV_FILE" ] && ENV_FILES+=("$ENV_FILE")
+	done
+
+	for ENV_FILE in "${ENV_FILES[@]}"; do
+		TEST_NAME="$FILE_NAME"
+		TEST_ENV=()
+		if [ -n "$ENV_FILE" ]; then
+			mapfile -t TEST_ENV < "$ENV_FILE"
+			TEST_NAME="$FILE_NAME ($(basename "$ENV_FILE"))"
+		fi
+
+		ACTUAL_OUTPUT="$(env "${TEST_ENV[@]}" "$LVM" "$BC_FILE" < "$INPUT_FILE" 2>&1 | tee /dev/tty)"
+
+		if ! [ "$EXPECTED_OUTPUT" = "$ACTUAL_OUTPUT" ]; then
+			echo -e "\033[91mtest failed!\033[m expected output:"
+			echo "$EXPECTED_OUTPUT"
+			FAILED=$(($FAILED + 1))
+			FAILED_NAMES+=("$TEST_NAME")
+		else
+			echo -e "\033[92mtest passed\033[m"
+			PASSED=$(($PASSED + 1))
+		fi
+	done
 done
 
 echo -e "\033[1mresult: $PASSED passed, $FAILED failed\033[m"
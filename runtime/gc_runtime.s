@@ -53,7 +53,7 @@ __post_gc2:
 	
 	// Scan stack for roots
 	// strting from __gc_stack_top
-	// till __gc_stack_bottom
+	// till __gc_stack_bottom inclusive
 __gc_root_scan_stack:
 			pushl	%ebp
 			movl	%esp, %ebp
@@ -106,7 +106,7 @@ gc_run_t:
 next:
 			addl	$4, %eax
 			cmpl	%eax, __gc_stack_bottom
-			jne	loop
+			jae	loop
 returnn:
 			movl	$0, %eax
 			popl	%edx
@@ -12,6 +12,10 @@
 # include <regex.h>
 # include <time.h>
 # include <limits.h>
+# include <inttypes.h>
+# include <pthread.h>
+# include <sched.h>
+# include <unistd.h>
 
 #include "runtime.h"
 
@@ -42,6 +46,7 @@ typedef struct {
 
 static pool from_space;
 static pool to_space;
+static pool nursery;
 size_t      *current;
 /* end */
 
@@ -163,20 +168,21 @@ void Lassert (void *f, char *s, ...) {
 //} sexp;
 
 extern void* alloc    (size_t);
-extern void* Bsexp    (int n, ...);
-extern int   LtagHash (char*);
+extern void* alloc_sexp (size_t);
+extern void* Bsexp    (aint n, ...);
+extern aint LtagHash (char*);
 
 void *global_sysargs;
 
 // Gets a raw tag
-extern int LkindOf (void *p) {
+extern aint LkindOf (void *p) {
   if (UNBOXED(p)) return UNBOXED_TAG;
   
   return TAG(TO_DATA(p)->tag);
 }
 
 // Compare sexprs tags
-extern int LcompareTags (void *p, void *q) {
+extern aint LcompareTags (void *p, void *q) {
   data *pd, *qd;
   
   ASSERT_BOXED ("compareTags, 0", p);
@@ -216,7 +222,7 @@ void* Ls__Infix_58 (void *p, void *q) {
 }
 
 // Functional synonym for built-in operator "!!";
-int Ls__Infix_3333 (void *p, void *q) {
+aint Ls__Infix_3333 (void *p, void *q) {
   ASSERT_UNBOXED("captured !!:1", p);
   ASSERT_UNBOXED("captured !!:2", q);
 
@@ -224,7 +230,7 @@ int Ls__Infix_3333 (void *p, void *q) {
 }
 
 // Functional synonym for built-in operator "&&";
-int Ls__Infix_3838 (void *p, void *q) {
+aint Ls__Infix_3838 (void *p, void *q) {
   ASSERT_UNBOXED("captured &&:1", p);
   ASSERT_UNBOXED("captured &&:2", q);
 
@@ -232,12 +238,12 @@ int Ls__Infix_3838 (void *p, void *q) {
 }
 
 // Functional synonym for built-in operator "==";
-int Ls__Infix_6161 (void *p, void *q) {
+aint Ls__Infix_6161 (void *p, void *q) {
   return BOX(p == q);
 }
 
 // Functional synonym for built-in operator "!=";
-int Ls__Infix_3361 (void *p, void *q) {
+aint Ls__Infix_3361 (void *p, void *q) {
   ASSERT_UNBOXED("captured !=:1", p);
   ASSERT_UNBOXED("captured !=:2", q);
 
@@ -245,7 +251,7 @@ int Ls__Infix_3361 (void *p, void *q) {
 }
 
 // Functional synonym for built-in operator "<=";
-int Ls__Infix_6061 (void *p, void *q) {
+aint Ls__Infix_6061 (void *p, void *q) {
   ASSERT_UNBOXED("captured <=:1", p);
   ASSERT_UNBOXED("captured <=:2", q);
 
@@ -253,7 +259,7 @@ int Ls__Infix_6061 (void *p, void *q) {
 }
 
 // Functional synonym for built-in operator "<";
-int Ls__Infix_60 (void *p, void *q) {
+aint Ls__Infix_60 (void *p, void *q) {
   ASSERT_UNBOXED("captured <:1", p);
   ASSERT_UNBOXED("captured <:2", q);
 
@@ -261,7 +267,7 @@ int Ls__Infix_60 (void *p, void *q) {
 }
 
 // Functional synonym for built-in operator ">=";
-int Ls__Infix_6261 (void *p, void *q) {
+aint Ls__Infix_6261 (void *p, void *q) {
   ASSERT_UNBOXED("captured >=:1", p);
   ASSERT_UNBOXED("captured >=:2", q);
 
@@ -269,7 +275,7 @@ int Ls__Infix_6261 (void *p, void *q) {
 }
 
 // Functional synonym for built-in operator ">";
-int Ls__Infix_62 (void *p, void *q) {
+aint Ls__Infix_62 (void *p, void *q) {
   ASSERT_UNBOXED("captured >:1", p);
   ASSERT_UNBOXED("captured >:2", q);
 
@@ -277,7 +283,7 @@ int Ls__Infix_62 (void *p, void *q) {
 }
 
 // Functional synonym for built-in operator "+";
-int Ls__Infix_43 (void *p, void *q) {
+aint Ls__Infix_43 (void *p, void *q) {
   ASSERT_UNBOXED("captured +:1", p);
   ASSERT_UNBOXED("captured +:2", q);
 
@@ -285,7 +291,7 @@ int Ls__Infix_43 (void *p, void *q) {
 }
 
 // Functional synonym for built-in operator "-";
-int Ls__Infix_45 (void *p, void *q) {
+aint Ls__Infix_45 (void *p, void *q) {
   if (UNBOXED(p)) {
     ASSERT_UNBOXED("captured -:2", q);
     return BOX(UNBOX(p) - UNBOX(q));
@@ -296,7 +302,7 @@ int Ls__Infix_45 (void *p, void *q) {
 }
 
 // Functional synonym for built-in operator "*";
-int Ls__Infix_42 (void *p, void *q) {
+aint Ls__Infix_42 (void *p, void *q) {
   ASSERT_UNBOXED("captured *:1", p);
   ASSERT_UNBOXED("captured *:2", q);
 
@@ -304,7 +310,7 @@ int Ls__Infix_42 (void *p, void *q) {
 }
 
 // Functional synonym for built-in operator "/";
-int Ls__Infix_47 (void *p, void *q) {
+aint Ls__Infix_47 (void *p, void *q) {
   ASSERT_UNBOXED("captured /:1", p);
   ASSERT_UNBOXED("captured /:2", q);
 
@@ -312,14 +318,14 @@ int Ls__Infix_47 (void *p, void *q) {
 }
 
 // Functional synonym for built-in operator "%";
-int Ls__Infix_37 (void *p, void *q) {
+aint Ls__Infix_37 (void *p, void *q) {
   ASSERT_UNBOXED("captured %:1", p);
   ASSERT_UNBOXED("captured %:2", q);
 
   return BOX(UNBOX(p) % UNBOX(q));
 }
 
-extern int Blength (void *p) {
+extern aint Blength (void *p) {
   data *a = (data*) BOX (NULL);
   
   ASSERT_BOXED(".length", p);
@@ -332,7 +338,7 @@ static char* chars = "_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ01234
 
 extern char* de_hash (int);
 
-extern int LtagHash (char *s) {
+extern aint LtagHash (char *s) {
   char *p;
   int  h = 0, limit = 0;
                
@@ -443,7 +449,7 @@ int is_valid_heap_pointer (void *p);
 extern void printValue (void *p) {
   data *a = (data*) BOX(NULL);
   unsigned i   = BOX(0);
-  if (UNBOXED(p)) printStringBuf ("%d", UNBOX(p));
+  if (UNBOXED(p)) printStringBuf ("%" PRIdPTR, UNBOX(p));
   else {
     if (! is_valid_heap_pointer(p)) {
       printStringBuf ("0x%x", p);
@@ -460,8 +466,8 @@ extern void printValue (void *p) {
     case CLOSURE_TAG:
       printStringBuf ("<closure ");
       for (i = 0; i < LEN(a->tag); i++) {
-	if (i) printValue ((void*)((int*) a->contents)[i]);
-	else printStringBuf ("0x%x", (void*)((int*) a->contents)[i]);
+	if (i) printValue (FIELD(a->contents, i));
+	else printStringBuf ("0x%x", FIELD(a->contents, i));
 	
 	if (i != LEN(a->tag) - 1) printStringBuf (", ");
       }
@@ -471,7 +477,7 @@ extern void printValue (void *p) {
     case ARRAY_TAG:
       printStringBuf ("[");
       for (i = 0; i < LEN(a->tag); i++) {
-        printValue ((void*)((int*) a->contents)[i]);
+        printValue (FIELD(a->contents, i));
 	if (i != LEN(a->tag) - 1) printStringBuf (", ");
       }
       printStringBuf ("]");
@@ -490,8 +496,8 @@ extern void printValue (void *p) {
 	printStringBuf ("{");
 
 	while (LEN(a->tag)) {
-	  printValue ((void*)((int*) b->contents)[0]);
-	  b = (data*)((int*) b->contents)[1];
+	  printValue (FIELD(b->contents, 0));
+	  b = (data*) FIELD(b->contents, 1);
 	  if (! UNBOXED(b)) {
 	    printStringBuf (", ");
 	    b = TO_DATA(b);
@@ -506,7 +512,7 @@ extern void printValue (void *p) {
 	if (LEN(a->tag)) {
 	  printStringBuf (" (");
 	  for (i = 0; i < LEN(a->tag); i++) {
-	    printValue ((void*)((int*) a->contents)[i]);
+	    printValue (FIELD(a->contents, i));
 	    if (i != LEN(a->tag) - 1) printStringBuf (", ");
 	  }
 	  printStringBuf (")");
@@ -543,8 +549,8 @@ static void stringcat (void *p) {
 	data *b = a;
 	
 	while (LEN(a->tag)) {
-	  stringcat ((void*)((int*) b->contents)[0]);
-	  b = (data*)((int*) b->contents)[1];
+	  stringcat (FIELD(b->contents, 0));
+	  b = (data*) FIELD(b->contents, 1);
 	  if (! UNBOXED(b)) {
 	    b = TO_DATA(b);
 	  }
@@ -561,7 +567,7 @@ static void stringcat (void *p) {
   }
 }
 
-extern int LmatchSubString (char *subj, char *patt, int pos) {
+extern aint LmatchSubString (char *subj, char *patt, aint pos) {
   data *p = TO_DATA(patt), *s = TO_DATA(subj);
   int   n;
 
@@ -577,7 +583,7 @@ extern int LmatchSubString (char *subj, char *patt, int pos) {
   return BOX(strncmp (subj + UNBOX(pos), patt, n) == 0);
 }
 
-extern void* Lsubstring (void *subj, int p, int l) {
+extern void* Lsubstring (void *subj, aint p, aint l) {
   data *d = TO_DATA(subj);
   int pp = UNBOX (p), ll = UNBOX (l);
 
@@ -591,7 +597,7 @@ extern void* Lsubstring (void *subj, int p, int l) {
     __pre_gc ();
 
     push_extra_root (&subj);
-    r = (data*) alloc (ll + 1 + sizeof (int));
+    r = (data*) alloc (ll + 1 + sizeof(hword));
     pop_extra_root (&subj);
 
     r->tag = STRING_TAG | (ll << 3);
@@ -613,16 +619,16 @@ extern struct re_pattern_buffer *Lregexp (char *regexp) {
 
   memset (b, 0, sizeof (regex_t));
   
-  int n = (int) re_compile_pattern (regexp, strlen (regexp), b);
+  const char *err = re_compile_pattern (regexp, strlen (regexp), b);
   
-  if (n != 0) {
-    failure ("%", strerror (n));
+  if (err != NULL) {
+    failure ("%s\n", err);
   };
 
   return b;
 }
 
-extern int LregexpMatch (struct re_pattern_buffer *b, char *s, int pos) {
+extern aint LregexpMatch (struct re_pattern_buffer *b, char *s, aint pos) {
   int res;
   
   ASSERT_BOXED("regexpMatch:1", b);
@@ -681,8 +687,8 @@ void *Lclone (void *p) {
       print_indent ();
       printf ("Lclone: closure or array &p=%p p=%p ebp=%p\n", &p, p, ebp); fflush (stdout);
 #endif
-      data *obj = (data*) alloc (sizeof(int) * (l+1));
-      memcpy (obj, TO_DATA(p), sizeof(int) * (l+1));
+      data *obj = (data*) alloc (sizeof(hword) * (l+1));
+      memcpy (obj, TO_DATA(p), sizeof(hword) * (l+1));
       res = (void*) (obj->contents);
       break;
     }
@@ -692,8 +698,8 @@ void *Lclone (void *p) {
 #ifdef DEBUG_PRINT
       print_indent (); printf ("Lclone: sexp\n"); fflush (stdout);
 #endif
-      sexp *sobj = (sexp*) alloc (sizeof(int) * (l+2));
-      memcpy (sobj, TO_SEXP(p), sizeof(int) * (l+2));
+      sexp *sobj = (sexp*) alloc_sexp (sizeof(hword) * (l+2));
+      memcpy (sobj, TO_SEXP(p), sizeof(hword) * (l+2));
       res = (void*) sobj->contents.contents;
       break;
     }
@@ -719,7 +725,8 @@ void *Lclone (void *p) {
 }
 
 # define HASH_DEPTH 3
-# define HASH_APPEND(acc, x) (((acc + (unsigned) x) << (WORD_SIZE / 2)) | ((acc + (unsigned) x) >> (WORD_SIZE / 2)))
+# define HASH_SHIFT (CHAR_BIT * sizeof(unsigned) / 2)
+# define HASH_APPEND(acc, x) (((acc + (unsigned) (auint) x) << HASH_SHIFT) | ((acc + (unsigned) (auint) x) >> HASH_SHIFT))
 
 int inner_hash (int depth, unsigned acc, void *p) {
   if (depth > HASH_DEPTH) return acc;
@@ -745,7 +752,7 @@ int inner_hash (int depth, unsigned acc, void *p) {
     }
       
     case CLOSURE_TAG:
-      acc = HASH_APPEND(acc, ((void**) a->contents)[0]);
+      acc = HASH_APPEND(acc, FIELD(a->contents, 0));
       i = 1;
       break;
       
@@ -769,7 +776,7 @@ int inner_hash (int depth, unsigned acc, void *p) {
     }
 
     for (; i<l; i++) 
-      acc = inner_hash (depth+1, acc, ((void**) a->contents)[i]);
+      acc = inner_hash (depth+1, acc, FIELD(a->contents, i));
 
     return acc;
   }
@@ -782,11 +789,11 @@ extern void* LstringInt (char *b) {
   return (void*) BOX(n);
 }
 
-extern int Lhash (void *p) {
+extern aint Lhash (void *p) {
   return BOX(0x3fffff & inner_hash (0, 0, p));
 }
 
-extern int LflatCompare (void *p, void *q) {
+extern aint LflatCompare (void *p, void *q) {
   if (UNBOXED(p)) {
     if (UNBOXED(q)) {
       return BOX (UNBOX(p) - UNBOX(q));
@@ -800,8 +807,8 @@ extern int LflatCompare (void *p, void *q) {
   else return BOX(1);
 }
 
-extern int Lcompare (void *p, void *q) {
-# define COMPARE_AND_RETURN(x,y) do { if (x != y) return BOX((int)((x) - (y))); } while (0)
+extern aint Lcompare (void *p, void *q) {
+# define COMPARE_AND_RETURN(x,y) do { if (x != y) return BOX((aint)((x) - (y))); } while (0)
   
   if (p == q) return BOX(0);
  
@@ -829,7 +836,7 @@ extern int Lcompare (void *p, void *q) {
           return BOX(strcmp (a->contents, b->contents));
       
         case CLOSURE_TAG:
-          COMPARE_AND_RETURN (((void**) a->contents)[0], ((void**) b->contents)[0]);
+          COMPARE_AND_RETURN (FIELD(a->contents, 0), FIELD(b->contents, 0));
           COMPARE_AND_RETURN (la, lb);
           i = 1;
           break;
@@ -856,7 +863,7 @@ extern int Lcompare (void *p, void *q) {
         }
 
         for (; i<la; i++) {
-          int c = Lcompare (((void**) a->contents)[i], ((void**) b->contents)[i]);
+          int c = Lcompare (FIELD(a->contents, i), FIELD(b->contents, i));
           if (c != BOX(0)) return BOX(c);
         }
     
@@ -865,11 +872,11 @@ extern int Lcompare (void *p, void *q) {
       else return BOX(-1);
     }
     else if (is_valid_heap_pointer (q)) return BOX(1);
-    else return BOX ((int)(p - q));
+    else return BOX ((aint)(p - q));
   }
 }
 
-extern void* Belem (void *p, int i) {
+extern void* Belem (void *p, aint i) {
   data *a = (data *)BOX(NULL);
 
   ASSERT_BOXED(".elem:1", p);
@@ -882,10 +889,10 @@ extern void* Belem (void *p, int i) {
     return (void*) BOX((int)a->contents[i]);
   }
   
-  return (void*) ((int*) a->contents)[i];
+  return FIELD(a->contents, i);
 }
 
-extern void* LmakeArray (int length) {
+extern void* LmakeArray (aint length) {
   data *r;
   int n;
 
@@ -894,18 +901,18 @@ extern void* LmakeArray (int length) {
   __pre_gc ();
 
   n = UNBOX(length);
-  r = (data*) alloc (sizeof(int) * (n+1));
+  r = (data*) alloc (sizeof(hword) * (n+1));
 
   r->tag = ARRAY_TAG | (n << 3);
 
-  memset (r->contents, 0, n * sizeof(int));
+  memset (r->contents, 0, n * sizeof(hword));
   
   __post_gc ();
 
   return r->contents;
 }
 
-extern void* LmakeSexp (int bn, int btag) {
+extern void* LmakeSexp (aint bn, aint btag) {
     sexp   *r;
     data   *d;
 
@@ -916,7 +923,7 @@ extern void* LmakeSexp (int bn, int btag) {
 
     __pre_gc () ;
 
-    r = (sexp*) alloc (sizeof(int) * (n+1));
+    r = (sexp*) alloc_sexp (sizeof(hword) * (n+1));
     d = &(r->contents);
 
     d->tag = SEXP_TAG | ((n-1) << 3);
@@ -927,7 +934,7 @@ extern void* LmakeSexp (int bn, int btag) {
     return d->contents;
 }
 
-extern void* LmakeString (int length) {
+extern void* LmakeString (aint length) {
   int   n = UNBOX(length);
   data *r;
 
@@ -935,7 +942,7 @@ extern void* LmakeString (int length) {
   
   __pre_gc () ;
   
-  r = (data*) alloc (n + 1 + sizeof (int));
+  r = (data*) alloc (n + 1 + sizeof(hword));
 
   r->tag = STRING_TAG | (n << 3);
 
@@ -944,15 +951,15 @@ extern void* LmakeString (int length) {
   return r->contents;
 }
 
-extern void* LMakeClosure (int bn, void *entry) {
+extern void* LMakeClosure (aint bn, void *entry) {
     data    *r;
     int     n = UNBOX(bn);
 
     __pre_gc ();
 
-    r = (data*) alloc (sizeof(int) * (n+2));
+    r = (data*) alloc (sizeof(hword) * (n+2));
     r->tag = CLOSURE_TAG | ((n + 1) << 3);
-    ((void**) r->contents)[0] = entry;
+    SET_FIELD(r->contents, 0, entry);
 
     __post_gc();
 
@@ -1028,43 +1035,39 @@ extern void* Bstringval (void *p) {
   return s;
 }
 
-extern void* Bclosure (int bn, void *entry, ...) {
+extern void* Bclosure (aint bn, void *entry, ...) {
   va_list args; 
-  int     i, ai;
-  register int * ebp asm ("ebp");
-  size_t  *argss;
+  int     i;
   data    *r; 
   int     n = UNBOX(bn);
+  aint    argss[n > 0 ? n : 1];
   
   __pre_gc ();
 #ifdef DEBUG_PRINT
   indent++; print_indent ();
   printf ("Bclosure: create n = %d\n", n); fflush(stdout);
 #endif
-  argss = (size_t*)(ebp + 12);
-  for (i = 0; i<n; i++, argss++) {
-    push_extra_root ((void**)argss);
+  /* captured values may move during alloc: keep them in rooted slots */
+  va_start(args, entry);
+  for (i = 0; i<n; i++) {
+    argss[i] = va_arg(args, aint);
+    push_extra_root ((void**)&argss[i]);
   }
+  va_end(args);
 
-  r = (data*) alloc (sizeof(int) * (n+2));
+  r = (data*) alloc (sizeof(hword) * (n+2));
   
   r->tag = CLOSURE_TAG | ((n + 1) << 3);
-  ((void**) r->contents)[0] = entry;
-  
-  va_start(args, entry);
+  SET_FIELD(r->contents, 0, entry);
   
   for (i = 0; i<n; i++) {
-    ai = va_arg(args, int);
-    ((int*)r->contents)[i+1] = ai;
+    SET_FIELD(r->contents, i+1, argss[i]);
   }
-  
-  va_end(args);
 
   __post_gc();
 
-  argss--;
-  for (i = 0; i<n; i++, argss--) {
-    pop_extra_root ((void**)argss);
+  for (i = n-1; i>=0; i--) {
+    pop_extra_root ((void**)&argss[i]);
   }
 
 #ifdef DEBUG_PRINT
@@ -1076,9 +1079,10 @@ extern void* Bclosure (int bn, void *entry, ...) {
   return r->contents;
 }
 
-extern void* Barray (int bn, ...) {
+extern void* Barray (aint bn, ...) {
   va_list args; 
-  int     i, ai; 
+  int     i;
+  aint    ai;
   data    *r; 
   int     n = UNBOX(bn);
     
@@ -1088,15 +1092,15 @@ extern void* Barray (int bn, ...) {
   indent++; print_indent ();
   printf ("Barray: create n = %d\n", n); fflush(stdout);
 #endif
-  r = (data*) alloc (sizeof(int) * (n+1));
+  r = (data*) alloc (sizeof(hword) * (n+1));
 
   r->tag = ARRAY_TAG | (n << 3);
   
   va_start(args, bn);
   
   for (i = 0; i<n; i++) {
-    ai = va_arg(args, int);
-    ((int*)r->contents)[i] = ai;
+    ai = va_arg(args, aint);
+    SET_FIELD(r->contents, i, ai);
   }
   
   va_end(args);
@@ -1108,10 +1112,10 @@ extern void* Barray (int bn, ...) {
   return r->contents;
 }
 
-extern void* Bsexp (int bn, ...) {
+extern void* Bsexp (aint bn, ...) {
   va_list args; 
   int     i;    
-  int     ai;  
+  aint    ai;  
   sexp   *r;  
   data   *d;  
   int n = UNBOX(bn); 
@@ -1120,9 +1124,9 @@ extern void* Bsexp (int bn, ...) {
   
 #ifdef DEBUG_PRINT
   indent++; print_indent ();
-  printf("Bsexp: allocate %zu!\n",sizeof(int) * (n+1)); fflush (stdout);
+  printf("Bsexp: allocate %zu!\n",sizeof(hword) * (n+1)); fflush (stdout);
 #endif
-  r = (sexp*) alloc (sizeof(int) * (n+1));
+  r = (sexp*) alloc_sexp (sizeof(hword) * (n+1));
   d = &(r->contents);
   r->tag = 0;
     
@@ -1131,12 +1135,12 @@ extern void* Bsexp (int bn, ...) {
   va_start(args, bn);
   
   for (i=0; i<n-1; i++) {
-    ai = va_arg(args, int);
+    ai = va_arg(args, aint);
     
-    ((int*)d->contents)[i] = ai;
+    SET_FIELD(d->contents, i, ai);
   }
 
-  r->tag = UNBOX(va_arg(args, int));
+  r->tag = UNBOX(va_arg(args, aint));
 
 #ifdef DEBUG_PRINT
   r->tag = SEXP_TAG | ((r->tag) << 3);
@@ -1152,7 +1156,7 @@ extern void* Bsexp (int bn, ...) {
   return d->contents;
 }
 
-extern int Btag (void *d, int t, int n) {
+extern aint Btag (void *d, aint t, aint n) {
   data *r; 
   
   if (UNBOXED(d)) return BOX(0);
@@ -1167,7 +1171,7 @@ extern int Btag (void *d, int t, int n) {
   }
 }
 
-extern int Barray_patt (void *d, int n) {
+extern aint Barray_patt (void *d, aint n) {
   data *r; 
   
   if (UNBOXED(d)) return BOX(0);
@@ -1177,7 +1181,7 @@ extern int Barray_patt (void *d, int n) {
   }
 }
 
-extern int Bstring_patt (void *x, void *y) {
+extern aint Bstring_patt (void *x, void *y) {
   data *rx = (data *) BOX (NULL),
        *ry = (data *) BOX (NULL);
   
@@ -1193,45 +1197,51 @@ extern int Bstring_patt (void *x, void *y) {
   }
 }
 
-extern int Bclosure_tag_patt (void *x) {
+extern aint Bclosure_tag_patt (void *x) {
   if (UNBOXED(x)) return BOX(0);
   
   return BOX(TAG(TO_DATA(x)->tag) == CLOSURE_TAG);
 }
 
-extern int Bboxed_patt (void *x) {
+extern aint Bboxed_patt (void *x) {
   return BOX(UNBOXED(x) ? 0 : 1);
 }
 
-extern int Bunboxed_patt (void *x) {
+extern aint Bunboxed_patt (void *x) {
   return BOX(UNBOXED(x) ? 1 : 0);
 }
 
-extern int Barray_tag_patt (void *x) {
+extern aint Barray_tag_patt (void *x) {
   if (UNBOXED(x)) return BOX(0);
   
   return BOX(TAG(TO_DATA(x)->tag) == ARRAY_TAG);
 }
 
-extern int Bstring_tag_patt (void *x) {
+extern aint Bstring_tag_patt (void *x) {
   if (UNBOXED(x)) return BOX(0);
   
   return BOX(TAG(TO_DATA(x)->tag) == STRING_TAG);
 }
 
-extern int Bsexp_tag_patt (void *x) {
+extern aint Bsexp_tag_patt (void *x) {
   if (UNBOXED(x)) return BOX(0);
   
   return BOX(TAG(TO_DATA(x)->tag) == SEXP_TAG);
 }
 
-extern void* Bsta (void *v, int i, void *x) {
+extern void* Bsta (void *v, aint i, void *x) {
   if (UNBOXED(i)) {
     ASSERT_BOXED(".sta:3", x);
     //    ASSERT_UNBOXED(".sta:2", i);
   
-    if (TAG(TO_DATA(x)->tag) == STRING_TAG)((char*) x)[UNBOX(i)] = (char) UNBOX(v);
-    else ((int*) x)[UNBOX(i)] = (int) v;
+    if (TAG(TO_DATA(x)->tag) == STRING_TAG) {
+      ((char*) x)[UNBOX(i)] = (char) UNBOX(v);
+      GC_LOG_WRITE(x);
+    }
+    else {
+      SET_FIELD(x, UNBOX(i), v);
+      GC_WRITE_BARRIER(x, v);
+    }
 
     return v;
   }
@@ -1241,15 +1251,28 @@ extern void* Bsta (void *v, int i, void *x) {
   return v;
 }
 
+#if defined(__x86_64__)
+/* SysV AMD64 passes the first six integer arguments in registers;
+   va_start spills them to reg_save_area, the rest stay on the stack */
+static size_t *va_slot (va_list va, int i) {
+  unsigned gp = va->gp_offset + i * sizeof(size_t);
+  if (gp < 6 * sizeof(size_t)) return (size_t*)((char*)va->reg_save_area + gp);
+  return (size_t*)va->overflow_arg_area + (gp - 6 * sizeof(size_t)) / sizeof(size_t);
+}
+#else
+static size_t *va_slot (va_list va, int i) {
+  return (size_t*)va + i;
+}
+#endif
+
 static void fix_unboxed (char *s, va_list va) {
-  size_t *p = (size_t*)va;
   int i = 0;
   
   while (*s) {
     if (*s == '%') {
-      size_t n = p [i];
-      if (UNBOXED (n)) {
-	p[i] = UNBOX(n);
+      size_t *p = va_slot (va, i);
+      if (UNBOXED (*p)) {
+	*p = UNBOX(*p);
       }
       i++;
     }
@@ -1265,7 +1288,7 @@ extern void Lfailure (char *s, ...) {
   vfailure    (s, args);
 }
 
-extern void Bmatch_failure (void *v, char *fname, int line, int col) {
+extern void Bmatch_failure (void *v, char *fname, aint line, aint col) {
   createStringBuf ();
   printValue (v);
   failure ("match failure at %s:%d:%d, value '%s'\n",
@@ -1287,7 +1310,7 @@ extern void* /*Lstrcat*/ Li__Infix_4343 (void *a, void *b) {
 
   push_extra_root (&a);
   push_extra_root (&b);
-  d  = (data *) alloc (sizeof(int) + LEN(da->tag) + LEN(db->tag) + 1);
+  d  = (data *) alloc (sizeof(hword) + LEN(da->tag) + LEN(db->tag) + 1);
   pop_extra_root (&b);
   pop_extra_root (&a);
 
@@ -1348,12 +1371,12 @@ extern void* LgetEnv (char *var) {
   return s;
 }
 
-extern int Lsystem (char *cmd) {
+extern aint Lsystem (char *cmd) {
   return BOX (system (cmd));
 }
 
 extern void Lfprintf (FILE *f, char *s, ...) {
-  va_list args = (va_list) BOX (NULL);
+  va_list args;
 
   ASSERT_BOXED("fprintf:1", f);
   ASSERT_STRING("fprintf:2", s);  
@@ -1367,7 +1390,7 @@ extern void Lfprintf (FILE *f, char *s, ...) {
 }
 
 extern void Lprintf (char *s, ...) {
-  va_list args = (va_list) BOX (NULL);
+  va_list args;
 
   ASSERT_STRING("printf:1", s);
 
@@ -1481,26 +1504,26 @@ extern void* Ltl (void *v) {
 }
 
 /* Lread is an implementation of the "read" construct */
-extern int Lread () {
-  int result = BOX(0);
+extern aint Lread () {
+  aint result = BOX(0);
 
   // Add space for matching lamac output (tests)
   printf (" > ");
   fflush (stdout);
-  scanf  ("%d", &result);
+  scanf  ("%" SCNdPTR, &result);
 
   return BOX(result);
 }
 
 /* Lwrite is an implementation of the "write" construct */
-extern int Lwrite (int n) {
-  printf ("%d\n", UNBOX(n));
+extern aint Lwrite (aint n) {
+  printf ("%" PRIdPTR "\n", UNBOX(n));
   fflush (stdout);
 
   return 0;
 }
 
-extern int Lrandom (int n) {
+extern aint Lrandom (aint n) {
   ASSERT_UNBOXED("Lrandom, 0", n);
 
   if (UNBOX(n) <= 0) {
@@ -1510,7 +1533,7 @@ extern int Lrandom (int n) {
   return BOX (random () % UNBOX(n));
 }
 
-extern int Ltime () {
+extern aint Ltime () {
   struct timespec t;
   
   clock_gettime (CLOCK_MONOTONIC_RAW, &t);
@@ -1519,7 +1542,7 @@ extern int Ltime () {
 }
 
 extern void set_args (int argc, char *argv[]) {
-  int n = argc, *p = NULL;
+  aint n = argc, *p = NULL;
   int i;
   
   __pre_gc ();
@@ -1540,7 +1563,9 @@ extern void set_args (int argc, char *argv[]) {
     print_indent ();
     printf ("set_args: iteration %i %p %p ->\n", i, &p, p); fflush(stdout);
 #endif
-    ((int*)p) [i] = (int) Bstring (argv[i]);
+    void *arg = Bstring (argv[i]);   // may move p
+    SET_FIELD(p, i, arg);
+    GC_WRITE_BARRIER(p, arg);
 #ifdef DEBUG_PRINT
     print_indent ();
     printf ("set_args: iteration %i <- %p %p\n", i, &p, p); fflush(stdout);
@@ -1586,15 +1611,798 @@ void __gc_init_subst () {}
 
 extern void __gc_root_scan_stack ();
 
+/* Conservative by default: every word of the stack that looks like a heap
+   pointer is a root */
+void (*gc_root_scan_stack) (void) = __gc_root_scan_stack;
+
 /* ======================================== */
 /*           Mark-and-copy                  */
 /* ======================================== */
 
+/* Heap spaces must be addressable by a boxed value; on 64-bit any address is */
+#if defined(__x86_64__)
+# define LAMA_MAP_FLAGS (MAP_PRIVATE | MAP_ANONYMOUS)
+#else
+# define LAMA_MAP_FLAGS (MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT)
+#endif
+
+/* Heap sizing. A space starts at LVM_HEAP_INIT bytes, by default
+   LVM_SPACE_SIZE words (32 MB on 64-bit; -DLVM_SPACE_SIZE=n changes it,
+   see benchmark_gc_compact.sh), and never grows past LVM_HEAP_MAX bytes
+   (no limit by default, with compressed references half of the region);
+   both take a K, M or G suffix. A collection that does not fit grows the
+   space LVM_HEAP_GROWTH times (2 by default), and after every major
+   collection or flip the space is resized for the survivors (see
+   gc_resize_heap). lvm sets these from --heap-init, --heap-max,
+   --heap-growth and --gc-time. */
+# ifndef LVM_SPACE_SIZE
+#  define LVM_SPACE_SIZE (4 * 1024 * 1024)
+# endif
+
+/* Huge pages (LVM_HUGEPAGES, off by default): the copying collector and
+   the bump allocator walk the spaces and the nursery linearly, and with
+   4 KB pages the TLB misses add up. "thp" aligns them to 2 MB and asks for
+   transparent huge pages (MADV_HUGEPAGE; the kernel may still use small
+   ones, e.g. with THP disabled), "hugetlb" maps them from the reserved pool
+   (MAP_HUGETLB) and falls back to "thp" once the pool gives out. */
+
+# define HUGE_PAGE ((size_t) 2 << 20)
+
+enum { HUGE_OFF, HUGE_THP, HUGE_TLB };
+
+static int GC_HUGEPAGES = HUGE_OFF;
+
+// Sizes the policy picks are whole pages (huge ones if asked for), so a space can give its tail back
+# define SPACE_PAGE ((GC_HUGEPAGES != HUGE_OFF ? HUGE_PAGE : 4096) / sizeof(size_t))
+
+// An anonymous read-write mapping, of huge pages if asked for
+static void *map_pages (void *addr, size_t bytes, int flags) {
+  void *p;
+# ifdef MAP_HUGETLB
+  if (GC_HUGEPAGES == HUGE_TLB) {
+    p = mmap (addr, bytes, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) return p;
+    GC_HUGEPAGES = HUGE_THP;
+  }
+# endif
+  p = mmap (addr, bytes, PROT_READ | PROT_WRITE, flags, -1, 0);
+# ifdef MADV_HUGEPAGE
+  if (p != MAP_FAILED && GC_HUGEPAGES != HUGE_OFF) madvise (p, bytes, MADV_HUGEPAGE);
+# endif
+  return p;
+}
+
 //static size_t SPACE_SIZE = 16;
-static size_t SPACE_SIZE = 256 * 1024 * 1024;
+static size_t SPACE_SIZE       = LVM_SPACE_SIZE;            // words: the next to_space, not less than from_space
+static size_t SPACE_SIZE_INIT  = LVM_SPACE_SIZE;
+static size_t SPACE_SIZE_LIMIT = SIZE_MAX / sizeof(size_t);
+static double HEAP_GROWTH      = 2;
+static double GC_TIME_RATIO    = 0.05;                      // LVM_GC_TIME_PCT / 100
 // static size_t SPACE_SIZE = 128;
 // static size_t SPACE_SIZE = 1024 * 1024;
 
+# ifdef LVM_COMPRESSED_REFS
+
+/* Compressed references (see hword in runtime.h): the heap is one 4 GB
+   region aligned to 4 GB, so the low 32 bits of a heap pointer are its
+   offset and decoding only puts the base back. Each semispace takes its
+   own half of the region, the nursery takes the top of the second one
+   and the large-object space (512 MB) the part under it, so both halves
+   are as much shorter; the first 2 MB of a half are never mapped, so a
+   zero word does not decode to an object and a space starts on a huge
+   page. */
+
+char *__gc_heap_base = NULL;
+
+# define HEAP_REGION    ((size_t) 1 << 32)
+# define HEAP_HALF      (HEAP_REGION >> 1)
+# define HEAP_GUARD     HUGE_PAGE
+# define HEAP_NURSERY   ((size_t) 64 << 20)
+# define HEAP_LARGE     ((size_t) 512 << 20)
+# define SPACE_SIZE_MAX ((HEAP_HALF - HEAP_GUARD - HEAP_NURSERY - HEAP_LARGE) / sizeof(size_t))
+
+// Reserved on first use: the heap is set up lazily by the first alloc
+static void reserve_heap (void) {
+  if (__gc_heap_base != NULL) return;
+  size_t span = HEAP_REGION << 1;
+  char  *p    = mmap (NULL, span, PROT_NONE,
+		      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (p == MAP_FAILED) {
+    perror ("ERROR: reserve_heap: mmap failed\n");
+    exit   (1);
+  }
+  char *base = (char*) (((size_t) p + HEAP_REGION - 1) & ~(HEAP_REGION - 1));
+  if (base > p) munmap (p, base - p);
+  munmap (base + HEAP_REGION, p + span - (base + HEAP_REGION));
+  __gc_heap_base = base;
+  if (SPACE_SIZE_LIMIT > SPACE_SIZE_MAX) SPACE_SIZE_LIMIT = SPACE_SIZE_MAX;
+  if (SPACE_SIZE > SPACE_SIZE_LIMIT) SPACE_SIZE = SPACE_SIZE_INIT = SPACE_SIZE_LIMIT;
+}
+
+// A space of words in the half of the region not taken by other
+static size_t *map_space (size_t *other, size_t words) {
+  char *begin = __gc_heap_base + HEAP_GUARD;
+  if (other != NULL && (char*) other < __gc_heap_base + HEAP_HALF) begin += HEAP_HALF;
+  if (words > SPACE_SIZE_MAX) return MAP_FAILED;
+  return map_pages (begin, words * sizeof(size_t), MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED);
+}
+
+static int grow_space (size_t *begin, size_t words, size_t new_words) {
+  if (new_words > SPACE_SIZE_MAX) return -1;
+  return map_pages (begin + words, (new_words - words) * sizeof(size_t),
+		    MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED) == MAP_FAILED ? -1 : 0;
+}
+
+// A space grown to new_words, in place: it must stay in its half
+static size_t *move_space (size_t *begin, size_t words, size_t new_words) {
+  return grow_space (begin, words, new_words) != 0 ? MAP_FAILED : begin;
+}
+
+static size_t *map_nursery (size_t words) {
+  if (words * sizeof(size_t) > HEAP_NURSERY) return MAP_FAILED;
+  return map_pages (__gc_heap_base + HEAP_REGION - HEAP_NURSERY, words * sizeof(size_t),
+		    MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED);
+}
+
+// Drops the pages but keeps the range reserved
+static int unmap_space (size_t *begin, size_t words) {
+  return mmap (begin, words * sizeof(size_t), PROT_NONE,
+	       MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0) == MAP_FAILED ? -1 : 0;
+}
+
+// The large-object space is the top of the second half, under the nursery
+static char *map_large (void) {
+  return mmap (__gc_heap_base + HEAP_REGION - HEAP_NURSERY - HEAP_LARGE, HEAP_LARGE,
+	       PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0);
+}
+
+# else
+
+static void reserve_heap (void) {}
+
+// With huge pages, a larger range is reserved and cut to a 2 MB boundary
+static void *map_aligned (size_t bytes) {
+  char *p, *a;
+  if (GC_HUGEPAGES == HUGE_OFF) return map_pages (NULL, bytes, LAMA_MAP_FLAGS);
+  p = mmap (NULL, bytes + HUGE_PAGE, PROT_NONE, LAMA_MAP_FLAGS | MAP_NORESERVE, -1, 0);
+  if (p == MAP_FAILED) return MAP_FAILED;
+  a = (char*) (((size_t) p + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1));
+  if (a > p) munmap (p, a - p);
+  if (a < p + HUGE_PAGE) munmap (a + bytes, p + HUGE_PAGE - a);
+  return map_pages (a, bytes, LAMA_MAP_FLAGS | MAP_FIXED);
+}
+
+static size_t *map_space (size_t *other, size_t words) {
+  (void) other;
+  return map_aligned (words * sizeof(size_t));
+}
+
+static size_t *map_nursery (size_t words) {
+  return map_aligned (words * sizeof(size_t));
+}
+
+static int grow_space (size_t *begin, size_t words, size_t new_words) {
+  return mremap (begin, words * sizeof(size_t), new_words * sizeof(size_t), 0)
+    == MAP_FAILED ? -1 : 0;
+}
+
+// A space grown to new_words, possibly at another address
+static size_t *move_space (size_t *begin, size_t words, size_t new_words) {
+  return mremap (begin, words * sizeof(size_t), new_words * sizeof(size_t), MREMAP_MAYMOVE);
+}
+
+static int unmap_space (size_t *begin, size_t words) {
+  return munmap (begin, words * sizeof(size_t));
+}
+
+// Only reserved: pages are taken as large objects are written
+# define HEAP_LARGE ((size_t) 64 << 30)
+
+static char *map_large (void) {
+  return mmap (NULL, HEAP_LARGE, PROT_READ | PROT_WRITE, LAMA_MAP_FLAGS | MAP_NORESERVE, -1, 0);
+}
+
+# endif
+
+static size_t space_round (double words) {
+  if (words >= SPACE_SIZE_LIMIT) return SPACE_SIZE_LIMIT;
+  size_t n = ((size_t) words + SPACE_PAGE - 1) / SPACE_PAGE * SPACE_PAGE;
+  return n < SPACE_SIZE_LIMIT ? n : SPACE_SIZE_LIMIT;
+}
+
+// The size of a space grown for a collection that does not fit; the limit is not grown past
+static size_t grown_space_size (size_t words) {
+  return space_round (words * HEAP_GROWTH);
+}
+
+// Bytes with an optional K, M or G suffix, in words
+static size_t heap_words (const char *s) {
+  char  *end;
+  size_t n = strtoull (s, &end, 10);
+  switch (*end) {
+  case 'k': case 'K': n <<= 10; break;
+  case 'm': case 'M': n <<= 20; break;
+  case 'g': case 'G': n <<= 30; break;
+  }
+  return n / sizeof(size_t);
+}
+
+static void init_heap_sizing (void) {
+  char *s = getenv ("LVM_HUGEPAGES");
+  if (s != NULL && strcmp (s, "thp") == 0) GC_HUGEPAGES = HUGE_THP;
+  if (s != NULL && strcmp (s, "hugetlb") == 0) GC_HUGEPAGES = HUGE_TLB;
+  s = getenv ("LVM_HEAP_MAX");
+  if (s != NULL && heap_words (s) >= SPACE_PAGE)
+    SPACE_SIZE_LIMIT = heap_words (s) / SPACE_PAGE * SPACE_PAGE;
+  s = getenv ("LVM_HEAP_INIT");
+  if (s != NULL && heap_words (s) > 0) SPACE_SIZE = heap_words (s);
+  if (GC_HUGEPAGES != HUGE_OFF) SPACE_SIZE = space_round (SPACE_SIZE);
+  if (SPACE_SIZE > SPACE_SIZE_LIMIT) SPACE_SIZE = SPACE_SIZE_LIMIT;
+  SPACE_SIZE_INIT = SPACE_SIZE;
+  s = getenv ("LVM_HEAP_GROWTH");
+  if (s != NULL) HEAP_GROWTH = strtod (s, NULL);
+  // a smaller factor would not grow a space by a page
+  if (!(HEAP_GROWTH >= 1.1)) HEAP_GROWTH = 1.1;
+  s = getenv ("LVM_GC_TIME_PCT");
+  if (s != NULL) GC_TIME_RATIO = strtod (s, NULL) / 100;
+}
+
+/* Generational nursery: small objects are bump-allocated here, and a minor
+   collection copies the survivors to the old space (from_space) without
+   touching the rest of it. Old objects that got a nursery reference since
+   the last collection are remembered by GC_WRITE_BARRIER (runtime.h), their
+   fields are roots of the minor collection. The old space keeps
+   NURSERY_SIZE words of headroom, so a major collection (the semispace copy
+   of both) always fits into to_space. LVM_NURSERY_KB sets the nursery
+   size, 0 turns it off. */
+
+static size_t NURSERY_SIZE = 1024 * 1024;   // words
+
+// Larger objects are allocated in the old space or the large-object space
+static size_t NURSERY_LIMIT  = 0;                         // words
+static size_t GC_LARGE_WORDS = 64 * 1024 / sizeof(size_t); // see gc_large_alloc
+
+char   *__gc_nursery_begin = NULL;
+size_t  __gc_nursery_bytes = 0;
+
+static int   gc_young_only = 0;             // minor collection in progress
+static pool *gc_target     = &to_space;     // where gc_copy puts survivors
+
+/* Remembered set: old objects (as contents pointers) that may refer to the nursery */
+static void  **remembered     = NULL;
+static size_t  remembered_n   = 0;
+static size_t  remembered_cap = 0;
+
+void gc_remember (void *obj) {
+  if (remembered_n > 0 && remembered[remembered_n - 1] == obj) return;
+  if (remembered_n == remembered_cap) {
+    remembered_cap = remembered_cap ? remembered_cap * 2 : 256;
+    remembered     = realloc (remembered, remembered_cap * sizeof(void*));
+    if (remembered == NULL) failure ("gc_remember: out of memory\n");
+  }
+  remembered[remembered_n++] = obj;
+}
+
+/* LVM_GC_STATS: collections and the time spent in them, reported at exit,
+   and the pauses: every stop of the program for the GC (a minor or major
+   collection, an incremental step, a flip) */
+static struct {
+  size_t    minor, major;
+  uint64_t  minor_ns, major_ns;
+  size_t    promoted;                       // words copied out of the nursery
+  size_t    compacting;                     // major collections in place
+  size_t    steps, flips, aborted;          // incremental collection
+  uint64_t  step_ns, flip_ns;
+  size_t    space_peak, resized;            // words of the old space; see gc_resize_heap
+  size_t    large_peak;                     // words of the large-object space
+  size_t    pretenured;                     // words allocated in the old space by their site
+  int       on;
+  uint64_t *pauses;
+  size_t    n_pauses, cap_pauses;
+} gc_stats;
+
+static uint64_t gc_clock (void) {
+  struct timespec t;
+  clock_gettime (CLOCK_MONOTONIC, &t);
+  return (uint64_t) t.tv_sec * 1000000000u + t.tv_nsec;
+}
+
+static void gc_pause (uint64_t start) {
+  if (!gc_stats.on) return;
+  if (gc_stats.n_pauses == gc_stats.cap_pauses) {
+    gc_stats.cap_pauses = gc_stats.cap_pauses ? gc_stats.cap_pauses * 2 : 1024;
+    gc_stats.pauses     = realloc (gc_stats.pauses, gc_stats.cap_pauses * sizeof(uint64_t));
+    if (gc_stats.pauses == NULL) failure ("gc_pause: out of memory\n");
+  }
+  gc_stats.pauses[gc_stats.n_pauses++] = gc_clock () - start;
+}
+
+static int cmp_pause (const void *a, const void *b) {
+  uint64_t x = *(const uint64_t*) a, y = *(const uint64_t*) b;
+  return (x > y) - (x < y);
+}
+
+// Pause at quantile q (nearest rank), ms
+static double gc_pause_at (double q) {
+  size_t k;
+  if (gc_stats.n_pauses == 0) return 0;
+  k = (size_t) (q * gc_stats.n_pauses + 0.999999);
+  if (k < 1) k = 1;
+  return gc_stats.pauses[k - 1] / 1e6;
+}
+
+// Huge pages the process has now, KB: transparent ones and those from the pool
+static size_t huge_pages_kb (void) {
+  FILE  *f = fopen ("/proc/self/smaps_rollup", "r");
+  char   line[256];
+  size_t kb = 0, n;
+  if (f == NULL) return 0;
+  while (fgets (line, sizeof(line), f) != NULL)
+    if (sscanf (line, "AnonHugePages: %zu", &n) == 1 ||
+	sscanf (line, "Private_Hugetlb: %zu", &n) == 1) kb += n;
+  fclose (f);
+  return kb;
+}
+
+static void gc_large_report (void);
+
+static void gc_stats_report (void) {
+  fprintf (stderr, "gc stats: %zu minor (%.3f ms, %zu words promoted), %zu major (%.3f ms)",
+	   gc_stats.minor, gc_stats.minor_ns / 1e6, gc_stats.promoted,
+	   gc_stats.major, gc_stats.major_ns / 1e6);
+  if (gc_stats.compacting > 0)
+    fprintf (stderr, ", %zu of them compacting", gc_stats.compacting);
+  if (gc_stats.steps + gc_stats.flips > 0)
+    fprintf (stderr, ", %zu incremental steps (%.3f ms), %zu flips (%.3f ms), %zu aborted",
+	     gc_stats.steps, gc_stats.step_ns / 1e6, gc_stats.flips, gc_stats.flip_ns / 1e6,
+	     gc_stats.aborted);
+  fprintf (stderr, "; old space %zu KB, at most %zu KB, resized %zu times",
+	   from_space.size * sizeof(size_t) / 1024, gc_stats.space_peak * sizeof(size_t) / 1024,
+	   gc_stats.resized);
+  if (GC_HUGEPAGES != HUGE_OFF)
+    fprintf (stderr, ", %zu KB in huge pages", huge_pages_kb ());
+  if (gc_stats.large_peak > 0) gc_large_report ();
+  if (gc_stats.pretenured > 0)
+    fprintf (stderr, "; %zu KB pretenured", gc_stats.pretenured * sizeof(size_t) / 1024);
+  qsort (gc_stats.pauses, gc_stats.n_pauses, sizeof(uint64_t), cmp_pause);
+  fprintf (stderr, "; pauses: %zu, p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+	   gc_stats.n_pauses, gc_pause_at (0.5), gc_pause_at (0.99), gc_pause_at (1));
+}
+
+/* Adaptive heap sizing, after a major collection or a flip. The space is
+   sized for the survivors: LVM_HEAP_GROWTH times the live words and the
+   nursery headroom, so a collection where much survives grows the heap and
+   one where little does lets it shrink. The time the old space costs (major
+   collections, incremental steps and flips, not the minor ones) is checked
+   too: if since the last resize it took more than LVM_GC_TIME_PCT percent
+   of the run (5 by default) and the collection was forced by a full space,
+   the space grows by the factor anyway, trading memory for fewer
+   collections (a flip is not: incremental cycles start as the old space
+   doubles, however large it is). It shrinks only when that share is under
+   half of the target, by the factor at most, and never below its initial
+   size. A space grows in place if it can, or else the next to_space is
+   mapped at the new size; it shrinks by giving its tail back. */
+
+static struct {
+  uint64_t at;                              // clock of the last resize
+  uint64_t gc_ns;                           // old space collections by then
+} gc_heap;
+
+static void gc_resize_heap (uint64_t start, int full) {
+  uint64_t now   = gc_clock ();
+  uint64_t gc_ns = gc_stats.major_ns + gc_stats.step_ns + gc_stats.flip_ns + (now - start);
+  double   ratio = (double) (gc_ns - gc_heap.gc_ns) / (now - gc_heap.at + 1);
+  size_t   live  = from_space.current - from_space.begin;
+  size_t   size  = from_space.size;
+  size_t   want  = space_round ((live + NURSERY_SIZE) * HEAP_GROWTH);
+
+  if (ratio > GC_TIME_RATIO) {
+    if (full && want < grown_space_size (size)) want = grown_space_size (size);
+    if (want < size) want = size;
+  }
+  else if (want < size) {
+    if (ratio > GC_TIME_RATIO / 2) want = size;
+    else if (want < size / HEAP_GROWTH) want = space_round (size / HEAP_GROWTH);
+  }
+  if (want < SPACE_SIZE_INIT) want = SPACE_SIZE_INIT;
+  if (want <= live + NURSERY_SIZE) want = size;
+
+  if (want < size && unmap_space (from_space.begin + want, size - want) == 0) {
+    from_space.end  = from_space.begin + want;
+    from_space.size = want;
+  }
+  else if (want > size && grow_space (from_space.begin, size, want) == 0) {
+    from_space.end  = from_space.begin + want;
+    from_space.size = want;
+  }
+  if (want != size) gc_stats.resized++;
+  SPACE_SIZE = want > from_space.size ? want : from_space.size;
+  if (gc_stats.space_peak < size) gc_stats.space_peak = size;
+  if (gc_stats.space_peak < from_space.size) gc_stats.space_peak = from_space.size;
+  gc_heap.at    = gc_clock ();
+  gc_heap.gc_ns = gc_ns;
+}
+
+/* Incremental major collection (LVM_GC_PAUSE_US=t): instead of copying the
+   whole old space in one pause, the old objects are replicated into to_space
+   in steps of about t microseconds, one per GC_INCR_WORDS words allocated in
+   the nursery (see alloc). The program keeps using the originals, which are
+   not changed, so no read barrier is needed: the replicas are reached from
+   the originals through a side table, and the write barrier logs the old
+   objects written during the cycle to re-copy them. A cycle starts right
+   after a minor collection by replicating the targets of the roots. Each
+   step does it again, re-copies the logged objects and scans replicas in
+   to_space Cheney-style (young references in replicas are left alone: their
+   old objects are remembered, and the minor collection that moves the young
+   ones logs them). Before a replica is re-copied, the old objects it pointed
+   to are replicated too, since young objects may still reach them: the cycle
+   keeps everything live at its start, and what dies meanwhile waits for the
+   next one. When nothing is left, the next minor collection becomes a flip:
+   it updates the roots, finishes the log and the scan (usually short) and
+   makes to_space the old space. A cycle starts when the old space has
+   doubled since the last major collection or flip (but grown by at least
+   four nurseries), or has used half of the room left by it, whichever comes
+   first; if the old space fills up first, the cycle is dropped for an
+   ordinary major collection. Steps and flips do not bound the minor
+   collections, those depend on the nursery size. */
+
+# define GC_INCR_WORDS (NURSERY_SIZE / 16)
+
+int             __gc_replicating = 0;
+static uint64_t GC_PAUSE_NS      = 0;                     // 0: no incremental collection
+static size_t  *gc_incr_at       = (size_t*) UINTPTR_MAX; // nursery.current of the next step
+static size_t  *gc_cycle_at      = NULL;                  // from_space.current that starts a cycle
+
+static int      GC_COMPACT_PCT   = 30;                    // see gc_compact
+static int      gc_live_pct      = 0;                     // of the old space, after the last major collection or flip
+
+static struct {
+  size_t   *scan;                           // replicas in [scan, to_space.current) are not scanned
+  uint32_t *fwd;                            // hword offset of an original -> of its replica + 1
+  size_t    fwd_bytes;
+  int       done;                           // nothing to do before the flip
+  void    **log;                            // written originals
+  size_t    log_n, log_cap;
+  void    **fresh;                          // allocated in the old space during the cycle
+  size_t    fresh_n, fresh_cap;
+  size_t    large;                          // large objects whose fields are replicated
+} gc_cycle;
+
+// The contents of an object without fields at the top start at current
+static int gc_is_original (void *p) {
+  return !UNBOXED(p) &&
+    (size_t) from_space.begin < (size_t) p && (size_t) p <= (size_t) from_space.current;
+}
+
+void gc_log_write (void *obj) {
+  if (!gc_is_original (obj)) return;
+  if (gc_cycle.log_n > 0 && gc_cycle.log[gc_cycle.log_n - 1] == obj) return;
+  if (gc_cycle.log_n == gc_cycle.log_cap) {
+    gc_cycle.log_cap = gc_cycle.log_cap ? gc_cycle.log_cap * 2 : 256;
+    gc_cycle.log     = realloc (gc_cycle.log, gc_cycle.log_cap * sizeof(void*));
+    if (gc_cycle.log == NULL) failure ("gc_log_write: out of memory\n");
+  }
+  gc_cycle.log[gc_cycle.log_n++] = obj;
+}
+
+/* An object allocated right in the old space (one too big for the nursery
+   but not for the large-object space, such as a big sexp, or one from a
+   pretenured site) is filled without the barrier, possibly after a step has
+   replicated it: the flip re-copies all of them. Its header is not written
+   yet, so the block is logged */
+static void gc_log_fresh (void *obj) {
+  if (gc_cycle.fresh_n == gc_cycle.fresh_cap) {
+    gc_cycle.fresh_cap = gc_cycle.fresh_cap ? gc_cycle.fresh_cap * 2 : 64;
+    gc_cycle.fresh     = realloc (gc_cycle.fresh, gc_cycle.fresh_cap * sizeof(void*));
+    if (gc_cycle.fresh == NULL) failure ("gc_log_fresh: out of memory\n");
+  }
+  gc_cycle.fresh[gc_cycle.fresh_n++] = obj;
+}
+
+/* Allocation-site pretenuring (LVM_GC_PRETENURE=p). The VM stores the
+   bytecode address of every allocating instruction in __gc_alloc_site, and
+   gc_sites_init tells the runtime where the bytecode is, so a site is an
+   offset in it (allocations outside of it share one more site). About one
+   nursery object in GC_SAMPLE_WORDS words allocated is a sample: the next
+   time the nursery is emptied, a sample whose header became a forwarding
+   pointer survived. A window of at least GC_SITE_WINDOW samples of a site
+   ends only then, so it covers whole nurseries. A site where at least p
+   percent (90 by default) of them survived in GC_SITE_STREAK windows in a
+   row is pretenured (one window is not enough: a collection forced early by
+   an object too large for the nursery finds most recent objects alive).
+   Its objects are then allocated in the old space and remembered, like
+   large objects, instead of being copied out of the nursery later; a probe
+   in about GC_SAMPLE_WORDS words it allocates still goes to the nursery as
+   a sample, and when fewer than p - GC_SITE_SLACK percent of the probes in
+   a window survive the site goes back to the nursery. p = 0 turns it off.
+   LVM_GC_SITES reports the sites at exit; then every allocation is
+   counted, not only the samples. LVM_HEAP_PROFILE (lvm --heap-profile)
+   counts them too and makes every nursery object a sample, so the words
+   surviving a collection are known per site (see gc_sites_profile); an
+   object allocated outside of the nursery is a sample until the next major
+   collection (see gc_sites_survey_outside). Pretenuring is off then, as it
+   would hide the survivors. */
+
+# define GC_SAMPLE_WORDS 1024
+# define GC_SITE_WINDOW  64
+# define GC_SITE_STREAK  2
+# define GC_SITE_SLACK   20
+
+const char *__gc_alloc_site = NULL;
+
+typedef struct {
+  size_t   offset;                          // SIZE_MAX: outside of the bytecode
+  size_t   allocs, words;                   // counted with LVM_GC_SITES only
+  size_t   sampled, survived;
+  size_t   survived_words;
+  size_t   pretenured;                      // objects allocated in the old space
+  uint32_t w_sampled, w_survived;           // the current window
+  int      streak;                          // windows in a row where enough survived
+  int      old;
+} gc_site;
+
+typedef struct {
+  size_t  *p;
+  uint32_t site;
+  uint32_t words;
+  int      hdr;                             // header words: 2 in a sexp
+} gc_sample_t;
+
+static struct {
+  const char  *code;                        // see gc_sites_init
+  size_t       size;
+  uint32_t    *index;                       // offset -> site, 0: none yet
+  gc_site     *site;                        // site[0]: outside of the bytecode
+  size_t       n, cap;
+  int          pct;                         // LVM_GC_PRETENURE
+  int          census;                      // LVM_GC_SITES or LVM_HEAP_PROFILE
+  int          profile;                     // LVM_HEAP_PROFILE: every object is a sample
+  size_t       old_n;                       // pretenured sites
+  size_t      *sample_at;                   // gc_site_sample is called from here on
+  size_t      *next;                        // nursery.current of the next sample
+  size_t       probe;                       // words to the next probe
+  uint32_t     seed;
+  gc_sample_t *samples;
+  size_t       samples_n, samples_cap;
+  gc_sample_t *outside;                     // in the old or the large-object space
+  size_t       outside_n, outside_cap;
+} gc_sites = { .pct = 90, .sample_at = (size_t*) UINTPTR_MAX, .next = (size_t*) UINTPTR_MAX };
+
+extern void gc_sites_init (const char *code, size_t size) {
+  gc_sites.code  = code;
+  gc_sites.size  = size;
+  gc_sites.index = calloc (size, sizeof(uint32_t));
+  if (gc_sites.index == NULL) failure ("gc_sites_init: out of memory\n");
+}
+
+// Words to the next sample: GC_SAMPLE_WORDS on average, jittered so that
+// a loop allocating in a fixed pattern is not always sampled at one site
+static size_t gc_sample_gap (void) {
+  uint32_t x = gc_sites.seed;
+  x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+  gc_sites.seed = x;
+  return GC_SAMPLE_WORDS / 2 + x % GC_SAMPLE_WORDS;
+}
+
+static void gc_sample_from (size_t *at) {
+  gc_sites.next      = at;
+  gc_sites.sample_at = gc_sites.census ? NULL : at;
+}
+
+static void gc_site_add (size_t offset) {
+  if (gc_sites.n == gc_sites.cap) {
+    gc_sites.cap  = gc_sites.cap ? gc_sites.cap * 2 : 64;
+    gc_sites.site = realloc (gc_sites.site, gc_sites.cap * sizeof(gc_site));
+    if (gc_sites.site == NULL) failure ("gc_site_add: out of memory\n");
+  }
+  memset (&gc_sites.site[gc_sites.n], 0, sizeof(gc_site));
+  gc_sites.site[gc_sites.n++].offset = offset;
+}
+
+// The site of the allocation in progress
+static uint32_t gc_site_of (void) {
+  size_t off = (uintptr_t) __gc_alloc_site - (uintptr_t) gc_sites.code;
+  if (__gc_alloc_site == NULL || off >= gc_sites.size) return 0;
+  if (gc_sites.index[off] == 0) {
+    gc_sites.index[off] = gc_sites.n;
+    gc_site_add (off);
+  }
+  return gc_sites.index[off];
+}
+
+static void gc_site_count (uint32_t s, size_t words) {
+  gc_sites.site[s].allocs++;
+  gc_sites.site[s].words += words;
+}
+
+static void gc_sample_push (gc_sample_t **v, size_t *n, size_t *cap, gc_sample_t x) {
+  if (*n == *cap) {
+    *cap = *cap ? *cap * 2 : 1024;
+    *v   = realloc (*v, *cap * sizeof(gc_sample_t));
+    if (*v == NULL) failure ("gc_sample_push: out of memory\n");
+  }
+  (*v)[(*n)++] = x;
+}
+
+// An allocation in the nursery at p from nursery.current >= sample_at:
+// counted with LVM_GC_SITES, a sample if it is time for one
+static void gc_site_sample (size_t *p, int hdr) {
+  uint32_t s = gc_site_of ();
+
+  if (gc_sites.census) gc_site_count (s, nursery.current - p);
+  if (!gc_sites.profile && nursery.current < gc_sites.next) return;
+  gc_sample_push (&gc_sites.samples, &gc_sites.samples_n, &gc_sites.samples_cap,
+		  (gc_sample_t) { p, s, nursery.current - p, hdr });
+  gc_sample_from (nursery.current + gc_sample_gap ());
+}
+
+// An allocation of `size` words at p in the old or the large-object space
+// (not a pretenured one): counted with LVM_GC_SITES, a sample with
+// LVM_HEAP_PROFILE
+static void gc_site_outside (size_t *p, size_t size, int hdr) {
+  uint32_t s = gc_site_of ();
+
+  gc_site_count (s, size);
+  if (gc_sites.profile)
+    gc_sample_push (&gc_sites.outside, &gc_sites.outside_n, &gc_sites.outside_cap,
+		    (gc_sample_t) { p, s, size, hdr });
+}
+
+// Whether an allocation of `size` words at the current site goes to the
+// old space: the site is pretenured and it is not the time for a probe
+static int gc_site_pretenured (size_t size) {
+  size_t off = (uintptr_t) __gc_alloc_site - (uintptr_t) gc_sites.code;
+  if (__gc_alloc_site == NULL || off >= gc_sites.size || gc_sites.index[off] == 0 ||
+      !gc_sites.site[gc_sites.index[off]].old) return 0;
+  if (gc_sites.probe > size) {
+    gc_sites.probe -= size;
+    return 1;
+  }
+  gc_sites.probe = gc_sample_gap ();
+  gc_sample_from (nursery.begin);
+  return 0;
+}
+
+static void gc_sample_count (gc_sample_t *x, int survived) {
+  gc_site *s = &gc_sites.site[x->site];
+
+  s->sampled++;
+  s->survived += survived;
+  s->survived_words += survived * x->words;
+}
+
+// The nursery is about to be emptied: which samples survived, and what
+// that tells of their sites. A window ends only here, so it covers whole
+// nurseries: the objects allocated just before a collection survive it
+static void gc_sites_survey (void) {
+  for (size_t i = 0; i < gc_sites.samples_n; i++) {
+    gc_sample_t *x = &gc_sites.samples[i];
+    gc_site     *s = &gc_sites.site[x->site];
+    int          survived = !UNBOXED(((hword*) x->p)[x->hdr - 1]);
+
+    gc_sample_count (x, survived);
+    s->w_sampled++;
+    s->w_survived += survived;
+  }
+  if (gc_sites.samples_n == 0) return;
+  gc_sites.samples_n = 0;
+  gc_sample_from (nursery.begin + gc_sample_gap ());
+
+  for (size_t i = 1; i < gc_sites.n && gc_sites.pct > 0; i++) {
+    gc_site *s = &gc_sites.site[i];
+    uint32_t pct;
+    if (s->w_sampled < GC_SITE_WINDOW) continue;
+    pct = s->w_survived * 100 / s->w_sampled;
+    s->streak = pct >= (uint32_t) gc_sites.pct ? s->streak + 1 : 0;
+    if (!s->old && s->streak >= GC_SITE_STREAK) {
+      s->old = 1;
+      gc_sites.old_n++;
+    }
+    else if (s->old && (int) pct < gc_sites.pct - GC_SITE_SLACK) {
+      s->old = 0;
+      gc_sites.old_n--;
+    }
+    s->w_sampled = s->w_survived = 0;
+  }
+}
+
+static int cmp_site (const void *a, const void *b) {
+  const gc_site *x = a, *y = b;
+  return (x->allocs < y->allocs) - (x->allocs > y->allocs);
+}
+
+static void gc_sites_report (void) {
+  size_t old = 0;
+
+  qsort (gc_sites.site, gc_sites.n, sizeof(gc_site), cmp_site);
+  for (size_t i = 0; i < gc_sites.n; i++) old += gc_sites.site[i].pretenured > 0;
+  fprintf (stderr, "allocation sites: %zu, %zu of them pretenured\n", gc_sites.n, old);
+  fprintf (stderr, "%10s %12s %12s %10s %9s %12s\n",
+	   "offset", "allocations", "KB", "sampled", "survived", "pretenured");
+  for (size_t i = 0; i < gc_sites.n; i++) {
+    gc_site *s = &gc_sites.site[i];
+    char     off[32];
+    if (s->allocs + s->sampled + s->pretenured == 0) continue;
+    if (s->offset == SIZE_MAX) strcpy (off, "runtime");
+    else snprintf (off, sizeof(off), "0x%zx", s->offset);
+    fprintf (stderr, "%10s %12zu %12zu %10zu %8.1f%% %12zu\n",
+	     off, s->allocs, s->words * sizeof(size_t) / 1024, s->sampled,
+	     s->sampled ? 100.0 * s->survived / s->sampled : 0.0, s->pretenured);
+  }
+}
+
+// The sites for the heap profiler (LVM_HEAP_PROFILE): a copy, in the
+// order of their first allocation; the caller frees it
+extern gc_site_stats * gc_sites_profile (size_t *n) {
+  gc_site_stats *out = malloc ((gc_sites.n + 1) * sizeof(gc_site_stats));
+  if (out == NULL) failure ("gc_sites_profile: out of memory\n");
+  for (size_t i = 0; i < gc_sites.n; i++) {
+    gc_site *s = &gc_sites.site[i];
+    out[i] = (gc_site_stats) {
+      .offset   = s->offset,
+      .objects  = s->allocs,
+      .bytes    = s->words * sizeof(size_t),
+      .survived = s->survived,
+      .survived_bytes = s->survived_words * sizeof(size_t)
+    };
+  }
+  *n = gc_sites.n;
+  return out;
+}
+
+static void init_gc_sites (void) {
+  char *s = getenv ("LVM_GC_PRETENURE");
+  if (s != NULL) gc_sites.pct = atoi (s);
+  gc_sites.profile = getenv ("LVM_HEAP_PROFILE") != NULL;
+  if (gc_sites.profile) gc_sites.pct = 0;
+  gc_sites.census = gc_sites.profile || getenv ("LVM_GC_SITES") != NULL;
+  gc_sites.seed   = 2463534242u;
+  gc_sites.probe  = gc_sample_gap ();
+  gc_site_add (SIZE_MAX);
+  if (getenv ("LVM_GC_SITES") != NULL) atexit (gc_sites_report);
+  if (NURSERY_SIZE > 0 && (gc_sites.pct > 0 || gc_sites.census)) gc_sample_from (nursery.begin);
+}
+
+static void init_nursery (void) {
+  char *s = getenv ("LVM_NURSERY_KB");
+  if (s != NULL) NURSERY_SIZE = strtoul (s, NULL, 10) * 1024 / sizeof(size_t);
+# ifdef LVM_COMPRESSED_REFS
+  if (NURSERY_SIZE > HEAP_NURSERY / sizeof(size_t)) NURSERY_SIZE = HEAP_NURSERY / sizeof(size_t);
+# endif
+  if (NURSERY_SIZE > SPACE_SIZE / 2) NURSERY_SIZE = SPACE_SIZE / 2;
+  if (getenv ("LVM_GC_STATS") != NULL) {
+    gc_stats.on = 1;
+    atexit (gc_stats_report);
+  }
+  s = getenv ("LVM_GC_PAUSE_US");
+  if (s != NULL && NURSERY_SIZE > 0) GC_PAUSE_NS = strtoull (s, NULL, 10) * 1000;
+  s = getenv ("LVM_GC_COMPACT");
+  if (s != NULL) GC_COMPACT_PCT = atoi (s);
+  s = getenv ("LVM_GC_LARGE_KB");
+  if (s != NULL) GC_LARGE_WORDS = strtoul (s, NULL, 10) * 1024 / sizeof(size_t);
+  NURSERY_LIMIT = NURSERY_SIZE / 8;
+  if (GC_LARGE_WORDS > 0 && NURSERY_LIMIT >= GC_LARGE_WORDS) NURSERY_LIMIT = GC_LARGE_WORDS - 1;
+  if (NURSERY_SIZE == 0) return;
+
+  nursery.begin = map_nursery (NURSERY_SIZE);
+  if (nursery.begin == MAP_FAILED) {
+    perror ("ERROR: init_nursery: mmap failed\n");
+    exit   (1);
+  }
+  nursery.current    = nursery.begin;
+  nursery.end        = nursery.begin + NURSERY_SIZE;
+  nursery.size       = NURSERY_SIZE;
+  __gc_nursery_begin = (char*) nursery.begin;
+  __gc_nursery_bytes = NURSERY_SIZE * sizeof(size_t);
+}
+
+static void reset_nursery (void) {
+  gc_sites_survey ();
+  nursery.current = nursery.begin;
+  remembered_n    = 0;
+  if (__gc_replicating) gc_incr_at = nursery.begin + GC_INCR_WORDS;
+}
+
 static int free_pool (pool * p) {
   size_t *a = p->begin;
   size_t b = p->size;
@@ -1602,22 +2410,90 @@ static int free_pool (pool * p) {
   p->size    = 0;
   p->end     = NULL;
   p->current = NULL;
-  return munmap((void *)a, b);
+  return unmap_space (a, b);
+}
+
+/* The space a collection leaves behind stays mapped as the spare and is the
+   next to_space, so a collection makes no mmap and munmap calls, and the
+   pages the survivors are copied to do not fault again. Only the head of
+   the spare stays resident, as many words as survived the collection that
+   left it (the next one is likely to copy about as much); the rest goes
+   back to the system with LVM_GC_RELEASE: "dontneed" (the default,
+   MADV_DONTNEED) drops the pages, "free" (MADV_FREE) lets the kernel take
+   them only when memory is short, so the allocation that follows does not
+   fault either but the pages count in RSS until then, and "unmap" unmaps
+   the whole space as before. */
+
+enum { RELEASE_UNMAP, RELEASE_DONTNEED, RELEASE_FREE };
+
+static pool spare;
+static int  GC_RELEASE = RELEASE_DONTNEED;
+
+static void init_gc_release (void) {
+  char *s = getenv ("LVM_GC_RELEASE");
+  if (s == NULL) return;
+  if (strcmp (s, "unmap") == 0) GC_RELEASE = RELEASE_UNMAP;
+  else if (strcmp (s, "free") == 0) GC_RELEASE = RELEASE_FREE;
+  else GC_RELEASE = RELEASE_DONTNEED;
+}
+
+// The whole pages of words at p go back to the system, still mapped; lazily if allowed
+static void release_pages (size_t *p, size_t words, int lazy) {
+  size_t b = ((size_t) p + 4095) & ~(size_t) 4095;
+  size_t e = (size_t) (p + words) & ~(size_t) 4095;
+  if (b >= e) return;
+# ifdef MADV_FREE
+  if (lazy && GC_RELEASE == RELEASE_FREE && madvise ((void*) b, e - b, MADV_FREE) == 0) return;
+# endif
+  madvise ((void*) b, e - b, MADV_DONTNEED);
+}
+
+// A space without live objects becomes the spare; keep words of it stay resident
+static void park_space (pool *p, size_t keep) {
+  if (GC_RELEASE == RELEASE_UNMAP || spare.begin != NULL) {
+    free_pool (p);
+    return;
+  }
+  if (keep < p->size) release_pages (p->begin + keep, p->size - keep, 1);
+  spare      = *p;
+  p->begin   = NULL;
+  p->size    = 0;
+  p->end     = NULL;
+  p->current = NULL;
 }
 
 static void init_to_space (int flag) {
-  size_t space_size = 0;
-  if (flag) SPACE_SIZE = SPACE_SIZE << 1;
-  space_size     = SPACE_SIZE * sizeof(size_t);
-  to_space.begin = mmap (NULL, space_size, PROT_READ | PROT_WRITE,
-			 MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+  reserve_heap ();
+  if (flag) {
+    if (grown_space_size (SPACE_SIZE) == SPACE_SIZE)
+      failure ("heap exhausted (%zu bytes per semispace)\n",
+	       SPACE_SIZE * sizeof(size_t));
+    SPACE_SIZE = grown_space_size (SPACE_SIZE);
+  }
+  // a spare of another size is grown or cut in place; a larger one is kept whole if it cannot be cut
+  if (spare.begin != NULL && spare.size < SPACE_SIZE &&
+      grow_space (spare.begin, spare.size, SPACE_SIZE) == 0)
+    spare.size = SPACE_SIZE;
+  if (spare.begin != NULL && spare.size > SPACE_SIZE &&
+      unmap_space (spare.begin + SPACE_SIZE, spare.size - SPACE_SIZE) == 0)
+    spare.size = SPACE_SIZE;
+  if (spare.begin != NULL && spare.size >= SPACE_SIZE) {
+    to_space.begin = spare.begin;
+    to_space.size  = spare.size;
+    spare.begin    = NULL;
+    spare.size     = 0;
+  }
+  else {
+    if (spare.begin != NULL) free_pool (&spare);
+    to_space.begin = map_space (from_space.begin, SPACE_SIZE);
+    to_space.size  = SPACE_SIZE;
+  }
   if (to_space.begin == MAP_FAILED) {
     perror ("EROOR: init_to_space: mmap failed\n");
     exit   (1);
   }
   to_space.current = to_space.begin;
-  to_space.end     = to_space.begin + SPACE_SIZE;
-  to_space.size    = SPACE_SIZE;
+  to_space.end     = to_space.begin + to_space.size;
 }
 
 static void gc_swap_spaces (void) {
@@ -1625,7 +2501,7 @@ static void gc_swap_spaces (void) {
   indent++; print_indent ();
   printf ("gc_swap_spaces\n"); fflush (stdout);
 #endif
-  free_pool (&from_space);
+  park_space (&from_space, current - to_space.begin);
   from_space.begin   = to_space.begin;
   from_space.current = current;
   from_space.end     = to_space.end;
@@ -1639,14 +2515,182 @@ static void gc_swap_spaces (void) {
 #endif
 }
 
+/* Large-object space: arrays, strings and closures of at least
+   GC_LARGE_WORDS words (LVM_GC_LARGE_KB, 64 KB by default, 0 turns it off)
+   are allocated here one by one, in whole pages, and never move: a major
+   collection marks them in place instead of copying and sweeps the ones it
+   has not reached, so a program holding a few big buffers does not pay for
+   their size in every collection (sexps have two header words and stay in
+   the old space). The space is a reserved range (HEAP_LARGE), so a
+   reference is told by its address, and a block is the run of pages of one
+   object: two words of header (the size of the run in bytes and the mark,
+   the number of the collection that last reached it), then the object.
+   Free runs are reused first fit and coalesced by the sweep, their pages go
+   back to the system as with LVM_GC_RELEASE; a run that does not fit any
+   is taken at the top. A large object is old from the start: it is
+   remembered when allocated, so the nursery is not emptied for it. Minor
+   collections and flips do not sweep: a major collection starts when the
+   space has grown by LVM_HEAP_GROWTH times what survived the last one (by
+   the size of the old space at least, so it grows with the heap when the
+   collections take too long, see gc_resize_heap). An incremental cycle keeps
+   all large objects alive: their fields are replicated along with the
+   rest and updated by the flip. An object that does not fit into the
+   space is allocated in the old space as before. */
+
+# define LARGE_HDR 2                        // words before the object in a block
+
+typedef struct {
+  char   *at;
+  size_t  bytes;
+} large_run;
+
+static struct {
+  char      *begin, *top, *end;             // pages below top were used
+  size_t   **blocks;                        // of the objects, in no order
+  size_t     n, cap;
+  large_run *free;                          // by address, not adjacent
+  size_t     free_n, free_cap;
+  size_t     words, limit;                  // in blocks; a major collection past limit
+  size_t     epoch;                         // major collections started; see gc_large_mark
+  hword    **stack;                         // marked, fields not scanned (gc_scan)
+  size_t     stack_n, stack_cap;
+} gc_large;
+
+# define IS_LARGE(p) ((size_t) ((char*) (p) - gc_large.begin) < (size_t) (gc_large.top - gc_large.begin))
+
+// The block of a large object: the object starts on its first page
+# define LARGE_BLOCK(p) ((size_t*) ((size_t) (p) & ~(size_t) 4095))
+
+// The contents of the object in a block
+# define LARGE_OBJECT(b) ((hword*) ((b) + LARGE_HDR) + 1)
+
+// size words in a new block; NULL without room
+static void *gc_large_alloc (size_t size) {
+  size_t  bytes = ((LARGE_HDR + size) * sizeof(size_t) + 4095) & ~(size_t) 4095;
+  size_t *b     = NULL;
+
+  if (gc_large.begin == NULL) {
+    char *p = map_large ();
+    if (p == MAP_FAILED) {
+      GC_LARGE_WORDS = 0;
+      return NULL;
+    }
+    gc_large.begin = gc_large.top = p;
+    gc_large.end   = p + HEAP_LARGE;
+    gc_large.limit = SPACE_SIZE_INIT;
+  }
+  for (size_t i = 0; i < gc_large.free_n; i++) {
+    large_run *r = &gc_large.free[i];
+    if (r->bytes < bytes) continue;
+    b         = (size_t*) r->at;
+    r->at    += bytes;
+    r->bytes -= bytes;
+    if (r->bytes == 0) {
+      memmove (r, r + 1, (gc_large.free_n - i - 1) * sizeof(large_run));
+      gc_large.free_n--;
+    }
+    break;
+  }
+  if (b == NULL) {
+    if (bytes > (size_t) (gc_large.end - gc_large.top)) return NULL;
+    b             = (size_t*) gc_large.top;
+    gc_large.top += bytes;
+  }
+  if (gc_large.n == gc_large.cap) {
+    gc_large.cap    = gc_large.cap ? gc_large.cap * 2 : 64;
+    gc_large.blocks = realloc (gc_large.blocks, gc_large.cap * sizeof(size_t*));
+    if (gc_large.blocks == NULL) failure ("gc_large_alloc: out of memory\n");
+  }
+  gc_large.blocks[gc_large.n++] = b;
+  gc_large.words += bytes / sizeof(size_t);
+  if (gc_stats.large_peak < gc_large.words) gc_stats.large_peak = gc_large.words;
+  b[0] = bytes;
+  b[1] = 0;
+  return b + LARGE_HDR;
+}
+
+// Marks a large object (also from several threads); 1 if it was not
+// marked yet and has fields to scan
+static int gc_large_mark (void *obj) {
+  size_t *b = LARGE_BLOCK(obj);
+
+  if (__atomic_load_n (&b[1], __ATOMIC_RELAXED) == gc_large.epoch ||
+      __atomic_exchange_n (&b[1], gc_large.epoch, __ATOMIC_ACQ_REL) == gc_large.epoch)
+    return 0;
+  return TAG(TO_DATA(obj)->tag) != STRING_TAG;
+}
+
+static void gc_large_push (hword *obj) {
+  if (gc_large.stack_n == gc_large.stack_cap) {
+    gc_large.stack_cap = gc_large.stack_cap ? gc_large.stack_cap * 2 : 256;
+    gc_large.stack     = realloc (gc_large.stack, gc_large.stack_cap * sizeof(hword*));
+    if (gc_large.stack == NULL) failure ("gc_large_push: out of memory\n");
+  }
+  gc_large.stack[gc_large.stack_n++] = obj;
+}
+
+static void gc_large_report (void) {
+  fprintf (stderr, "; large objects %zu (%zu KB), at most %zu KB",
+	   gc_large.n, gc_large.words * sizeof(size_t) / 1024,
+	   gc_stats.large_peak * sizeof(size_t) / 1024);
+}
+
+static int cmp_run (const void *a, const void *b) {
+  const large_run *x = a, *y = b;
+  return x->at < y->at ? -1 : x->at > y->at;
+}
+
+// After a major collection and the resize of the old space: frees the
+// blocks it has not marked and sets the next limit
+static void gc_large_sweep (void) {
+  size_t n = 0, k = 0;
+
+  if (gc_large.begin == NULL) return;
+  for (size_t i = 0; i < gc_large.n; i++) {
+    size_t *b = gc_large.blocks[i];
+    if (b[1] == gc_large.epoch) {
+      gc_large.blocks[n++] = b;
+      continue;
+    }
+    if (gc_large.free_n == gc_large.free_cap) {
+      gc_large.free_cap = gc_large.free_cap ? gc_large.free_cap * 2 : 64;
+      gc_large.free     = realloc (gc_large.free, gc_large.free_cap * sizeof(large_run));
+      if (gc_large.free == NULL) failure ("gc_large_sweep: out of memory\n");
+    }
+    gc_large.free[gc_large.free_n].at    = (char*) b;
+    gc_large.free[gc_large.free_n].bytes = b[0];
+    gc_large.free_n++;
+    gc_large.words -= b[0] / sizeof(size_t);
+    release_pages (b, b[0] / sizeof(size_t), 1);
+  }
+  gc_large.n = n;
+
+  qsort (gc_large.free, gc_large.free_n, sizeof(large_run), cmp_run);
+  for (size_t i = 0; i < gc_large.free_n; i++)
+    if (k > 0 && gc_large.free[k - 1].at + gc_large.free[k - 1].bytes == gc_large.free[i].at)
+      gc_large.free[k - 1].bytes += gc_large.free[i].bytes;
+    else gc_large.free[k++] = gc_large.free[i];
+  gc_large.free_n = k;
+  if (k > 0 && gc_large.free[k - 1].at + gc_large.free[k - 1].bytes == gc_large.top) {
+    gc_large.top = gc_large.free[k - 1].at;
+    gc_large.free_n--;
+  }
+
+  gc_large.limit = gc_large.words * HEAP_GROWTH;
+  if (gc_large.limit < from_space.size) gc_large.limit = from_space.size;
+}
+
 # define IS_VALID_HEAP_POINTER(p)\
   (!UNBOXED(p) &&		 \
-   (size_t)from_space.begin <= (size_t)p &&	 \
-   (size_t)from_space.end   >  (size_t)p)
+   (IS_YOUNG(p) ||		 \
+    (!gc_young_only &&		 \
+     (((size_t)from_space.begin <= (size_t)p &&	 \
+       (size_t)from_space.end   >  (size_t)p) || \
+      IS_LARGE(p)))))
 
 # define IN_PASSIVE_SPACE(p)	\
-  ((size_t)to_space.begin <= (size_t)p	&&	\
-   (size_t)to_space.end   >  (size_t)p)
+  ((size_t)gc_target->begin <= (size_t)p	&&	\
+   (size_t)gc_target->end   >  (size_t)p)
 
 # define IS_FORWARD_PTR(p)			\
   (!UNBOXED(p) && IN_PASSIVE_SPACE(p))
@@ -1656,8 +2700,9 @@ int is_valid_heap_pointer (void *p)  {
 }
 
 extern size_t * gc_copy (size_t *obj);
+extern void gc_root_scan_data (void);
 
-static void copy_elements (size_t *where, size_t *from, int len) {
+static void copy_elements (hword *where, hword *from, int len) {
   int    i = 0;
   void * p = NULL;
 #ifdef DEBUG_PRINT
@@ -1665,9 +2710,9 @@ static void copy_elements (size_t *where, size_t *from, int len) {
   printf ("copy_elements: start; len = %d\n", len); fflush (stdout);
 #endif
   for (i = 0; i < len; i++) {
-    size_t elem = from[i];
+    void *elem = FROM_WORD(from[i]);
     if (!IS_VALID_HEAP_POINTER(elem)) {
-      *where = elem;
+      *where = from[i];
       where++;
 #ifdef DEBUG_PRINT
       print_indent ();	
@@ -1681,7 +2726,7 @@ static void copy_elements (size_t *where, size_t *from, int len) {
       fflush (stdout);
 #endif
       p = gc_copy ((size_t*) elem);
-      *where = (size_t) p;
+      *where = TO_WORD(p);
       where ++;
     }
 #ifdef DEBUG_PRINT
@@ -1700,14 +2745,11 @@ static void copy_elements (size_t *where, size_t *from, int len) {
 }
 
 static int extend_spaces (void) {
-  void *p = (void *) BOX (NULL);
-  size_t old_space_size = SPACE_SIZE        * sizeof(size_t),
-         new_space_size = (SPACE_SIZE << 1) * sizeof(size_t);
-  p = mremap(to_space.begin, old_space_size, new_space_size, 0);
+  size_t new_size = grown_space_size (to_space.size);
 #ifdef DEBUG_PRINT
   indent++; print_indent ();
 #endif
-  if (p == MAP_FAILED) {
+  if (new_size == to_space.size || grow_space (to_space.begin, to_space.size, new_size) != 0) {
 #ifdef DEBUG_PRINT
     print_indent ();
     printf ("extend: extend_spaces: mremap failed\n"); fflush (stdout);
@@ -1716,20 +2758,26 @@ static int extend_spaces (void) {
   }
 #ifdef DEBUG_PRINT
   print_indent ();
-  printf ("extend: %p %p %p %p\n", p, to_space.begin, to_space.end, current);
+  printf ("extend: %p %p %p\n", to_space.begin, to_space.end, current);
   fflush (stdout);
   indent--;
 #endif
-  to_space.end    += SPACE_SIZE;
-  SPACE_SIZE      =  SPACE_SIZE << 1;
+  to_space.end    += new_size - to_space.size;
+  SPACE_SIZE      =  new_size;
   to_space.size   =  SPACE_SIZE;
   return 0;
 }
 
+// Copying is Cheney-style: gc_copy only moves an object to gc_target and
+// leaves a forwarding pointer behind; the fields of the copy still refer to
+// the old objects until gc_scan walks over it. The C stack stays flat however
+// deep the heap is. A sexp copy starts with its data tag and then the sexp
+// tag, so that every copy gc_scan has not reached yet starts with a data tag;
+// gc_scan puts them back in order.
 extern size_t * gc_copy (size_t *obj) {
   data   *d    = TO_DATA(obj);
   sexp   *s    = NULL;
-  size_t *copy = NULL;
+  hword  *copy = NULL;
   int     i    = 0;
 #ifdef DEBUG_PRINT
   int len1, len2, len3;
@@ -1749,7 +2797,12 @@ extern size_t * gc_copy (size_t *obj) {
     return obj;
   }
 
-  if (!IN_PASSIVE_SPACE(current) && current != to_space.end) {
+  if (IS_LARGE(obj)) {
+    if (gc_large_mark (obj)) gc_large_push ((hword*) obj);
+    return obj;
+  }
+
+  if (!IN_PASSIVE_SPACE(current) && current != gc_target->end) {
 #ifdef DEBUG_PRINT
     print_indent ();
     printf("ERROR: gc_copy: out-of-space %p %p %p\n",
@@ -1760,17 +2813,17 @@ extern size_t * gc_copy (size_t *obj) {
     exit (1);
   }
 
-  if (IS_FORWARD_PTR(d->tag)) {
+  if (IS_FORWARD_PTR(FROM_WORD(d->tag))) {
 #ifdef DEBUG_PRINT
     print_indent ();
-    printf ("gc_copy: IS_FORWARD_PTR: return! %p -> %p\n", obj, (size_t *) d->tag);
+    printf ("gc_copy: IS_FORWARD_PTR: return! %p -> %p\n", obj, FROM_WORD(d->tag));
     fflush(stdout);
     indent--;
 #endif
-    return (size_t *) d->tag;
+    return (size_t *) FROM_WORD(d->tag);
   }
 
-  copy = current;
+  copy = (hword*) current;
 #ifdef DEBUG_PRINT
   objj = d;
 #endif
@@ -1781,13 +2834,11 @@ extern size_t * gc_copy (size_t *obj) {
       printf ("gc_copy:closure_tag; len =  %zu\n", LEN(d->tag)); fflush (stdout);
 #endif
       i = LEN(d->tag);
-      // current += LEN(d->tag) + 1;
-      // current += ((LEN(d->tag) + 1) * sizeof(int) -1) / sizeof(size_t) + 1;
-      current += i+1;
+      current += ((i + 1) * sizeof(hword) - 1) / sizeof(size_t) + 1;
       *copy = d->tag;
       copy++;
-      d->tag = (int) copy;
-      copy_elements (copy, obj, i);
+      d->tag = TO_WORD(copy);
+      memcpy (copy, obj, i * sizeof(hword));
       break;
     
     case ARRAY_TAG:
@@ -1795,12 +2846,12 @@ extern size_t * gc_copy (size_t *obj) {
       print_indent ();
       printf ("gc_copy:array_tag; len =  %zu\n", LEN(d->tag)); fflush (stdout);
 #endif
-      current += ((LEN(d->tag) + 1) * sizeof (int) - 1) / sizeof (size_t) + 1;
+      current += ((LEN(d->tag) + 1) * sizeof(hword) - 1) / sizeof (size_t) + 1;
       *copy = d->tag;
       copy++;
       i = LEN(d->tag);
-      d->tag = (int) copy;
-      copy_elements (copy, obj, i);
+      d->tag = TO_WORD(copy);
+      memcpy (copy, obj, i * sizeof(hword));
       break;
 
     case STRING_TAG:
@@ -1808,11 +2859,12 @@ extern size_t * gc_copy (size_t *obj) {
       print_indent ();
       printf ("gc_copy:string_tag; len = %d\n", LEN(d->tag) + 1); fflush (stdout);
 #endif
-      current += (LEN(d->tag) + sizeof(int)) / sizeof(size_t) + 1;
+      i = LEN(d->tag);
+      current += (i + sizeof(hword)) / sizeof(size_t) + 1;
       *copy = d->tag;
       copy++;
-      d->tag = (int) copy;
-      strcpy ((char*)&copy[0], (char*) obj);
+      d->tag = TO_WORD(copy);
+      memcpy (copy, obj, i + 1);
       break;
 
   case SEXP_TAG  :
@@ -1828,13 +2880,14 @@ extern size_t * gc_copy (size_t *obj) {
       fflush (stdout);
 #endif
       i = LEN(s->contents.tag);
-      current += i + 2;
-      *copy = s->tag;
-      copy++;
+      current += ((i + 2) * sizeof(hword) - 1) / sizeof(size_t) + 1;
+      // header words go swapped until gc_scan reaches the copy
       *copy = d->tag;
       copy++;
-      d->tag = (int) copy;
-      copy_elements (copy, obj, i);
+      *copy = s->tag;
+      copy++;
+      d->tag = TO_WORD(copy);
+      memcpy (copy, obj, i * sizeof(hword));
       break;
 
   default:
@@ -1854,7 +2907,823 @@ extern size_t * gc_copy (size_t *obj) {
   fflush (stdout);
   indent--;
 #endif
-  return copy;
+  return (size_t*) copy;
+}
+
+// Restores the header of the copy at p (see gc_copy); returns its size in
+// words and its fields in *fields, *len
+static inline size_t copy_layout (size_t *p, hword **fields, int *len) {
+  hword *h   = (hword*) p;
+  hword  tag = h[0];
+  int    n   = LEN(tag);
+
+  *fields = h + 1;
+  *len    = n;
+  switch (TAG(tag)) {
+  case STRING_TAG:
+    *len = 0;
+    return (n + sizeof(hword)) / sizeof(size_t) + 1;
+
+  case SEXP_TAG:
+    h[0]    = h[1];
+    h[1]    = tag;
+    *fields = h + 2;
+    return ((n + 2) * sizeof(hword) - 1) / sizeof(size_t) + 1;
+
+  default:
+    return ((n + 1) * sizeof(hword) - 1) / sizeof(size_t) + 1;
+  }
+}
+
+// Size in words of a copy of the object with data tag `tag`, the bytes of
+// its contents and the number of its header words
+static inline size_t copy_size (hword tag, size_t *bytes, int *hdr) {
+  *hdr = 1;
+  switch (TAG(tag)) {
+  case CLOSURE_TAG:
+  case ARRAY_TAG:
+    *bytes = LEN(tag) * sizeof(hword);
+    return ((LEN(tag) + 1) * sizeof(hword) - 1) / sizeof(size_t) + 1;
+
+  case STRING_TAG:
+    *bytes = LEN(tag) + 1;
+    return (LEN(tag) + sizeof(hword)) / sizeof(size_t) + 1;
+
+  case SEXP_TAG:
+    *bytes = LEN(tag) * sizeof(hword);
+    *hdr   = 2;
+    return ((LEN(tag) + 2) * sizeof(hword) - 1) / sizeof(size_t) + 1;
+
+  default:
+    failure ("copy_size: weird tag %x\n", (unsigned) TAG(tag));
+    return 0;
+  }
+}
+
+// Breadth-first scan of the copies in [scan, current): fixes up their fields,
+// which copies more objects at current, until the scan catches up; and of
+// the large objects gc_copy has marked
+static void gc_scan (size_t *scan) {
+  hword *fields;
+  int    len;
+
+  for (;;) {
+    if (scan < current) {
+      scan += copy_layout (scan, &fields, &len);
+      copy_elements (fields, fields, len);
+    }
+    else if (gc_large.stack_n > 0) {
+      fields = gc_large.stack[--gc_large.stack_n];
+      copy_elements (fields, fields, LEN(TO_DATA(fields)->tag));
+    }
+    else return;
+  }
+}
+
+// Number of fields of an object, none in a string (a large one is
+// remembered when allocated, see alloc_slow)
+static inline int fields_len (hword *fields) {
+  hword tag = TO_DATA(fields)->tag;
+  return TAG(tag) == STRING_TAG ? 0 : LEN(tag);
+}
+
+/* Parallel copying (LVM_GC_THREADS=n, 1 < n <= number of processors). The
+   main thread only lists the root slots; n threads (itself and n - 1 workers
+   that sleep between collections) split the roots and the remembered set and
+   copy into their own allocation buffers of GC_LAB_WORDS words taken from
+   current. A copy is published by a CAS of the forwarding pointer into the
+   tag of the original; the thread that loses the race gives its space back.
+   Copies still to be scanned go to the work-stealing deque (Chase-Lev) of the
+   thread that made them. The unused end of every buffer is filled with an
+   array of unboxed words, so the heap stays a sequence of objects. Without
+   live + live / 4 + 2 * n * GC_LAB_WORDS words of room in gc_target the
+   collection is done by gc_scan. */
+
+# define GC_MAX_THREADS 64
+# define GC_LAB_WORDS   4096
+# define GC_LAB_LARGE   (GC_LAB_WORDS / 8)   // larger copies bypass the buffers
+
+typedef struct gc_deque_buf {
+  size_t               mask;
+  struct gc_deque_buf *retired;              // smaller buffers, freed after the collection
+  size_t              *items[];
+} gc_deque_buf;
+
+typedef struct {
+  long          top, bottom;                 // accessed with __atomic builtins
+  gc_deque_buf *buf;
+  size_t       *lab, *lab_end;
+  unsigned      seed;
+  pthread_t     thread;
+} gc_worker;
+
+static int       gc_threads = 1;
+static gc_worker gc_workers[GC_MAX_THREADS];
+static int       gc_list_roots = 0;           // gc_test_and_copy_root only lists roots
+
+static size_t ***gc_roots     = NULL;
+static size_t    gc_roots_n   = 0;
+static size_t    gc_roots_cap = 0;
+
+static pthread_mutex_t gc_lock     = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  gc_start_cv = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  gc_done_cv  = PTHREAD_COND_INITIALIZER;
+static unsigned long   gc_epoch    = 0;      // parallel collections started
+static int             gc_running  = 0;      // workers not done with the current one
+static int             gc_idle     = 0;      // threads out of work (termination)
+
+static void gc_root_push (size_t **root) {
+  if (gc_roots_n == gc_roots_cap) {
+    gc_roots_cap = gc_roots_cap ? gc_roots_cap * 2 : 1024;
+    gc_roots     = realloc (gc_roots, gc_roots_cap * sizeof(size_t**));
+    if (gc_roots == NULL) failure ("gc_root_push: out of memory\n");
+  }
+  gc_roots[gc_roots_n++] = root;
+}
+
+static gc_deque_buf *gc_deque_alloc (size_t size) {
+  gc_deque_buf *b = malloc (sizeof(gc_deque_buf) + size * sizeof(size_t*));
+  if (b == NULL) failure ("gc_deque_alloc: out of memory\n");
+  b->mask    = size - 1;
+  b->retired = NULL;
+  return b;
+}
+
+// Owner only: the bottom end
+static void gc_deque_push (gc_worker *w, size_t *p) {
+  long          b   = __atomic_load_n (&w->bottom, __ATOMIC_RELAXED);
+  long          t   = __atomic_load_n (&w->top, __ATOMIC_ACQUIRE);
+  gc_deque_buf *buf = w->buf;
+
+  if ((size_t) (b - t) > buf->mask) {
+    gc_deque_buf *nb = gc_deque_alloc ((buf->mask + 1) * 2);
+    for (long i = t; i < b; i++)
+      nb->items[i & nb->mask] = __atomic_load_n (&buf->items[i & buf->mask], __ATOMIC_RELAXED);
+    nb->retired = buf;
+    __atomic_store_n (&w->buf, nb, __ATOMIC_RELEASE);
+    buf = nb;
+  }
+  __atomic_store_n (&buf->items[b & buf->mask], p, __ATOMIC_RELAXED);
+  __atomic_thread_fence (__ATOMIC_RELEASE);
+  __atomic_store_n (&w->bottom, b + 1, __ATOMIC_RELAXED);
+}
+
+static size_t *gc_deque_take (gc_worker *w) {
+  long          b   = __atomic_load_n (&w->bottom, __ATOMIC_RELAXED) - 1;
+  gc_deque_buf *buf = w->buf;
+  long          t;
+  size_t       *p   = NULL;
+
+  __atomic_store_n (&w->bottom, b, __ATOMIC_RELAXED);
+  __atomic_thread_fence (__ATOMIC_SEQ_CST);
+  t = __atomic_load_n (&w->top, __ATOMIC_RELAXED);
+  if (t <= b) {
+    p = __atomic_load_n (&buf->items[b & buf->mask], __ATOMIC_RELAXED);
+    if (t == b) {
+      if (!__atomic_compare_exchange_n (&w->top, &t, t + 1, 0,
+					__ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+	p = NULL;
+      __atomic_store_n (&w->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+  }
+  else __atomic_store_n (&w->bottom, b + 1, __ATOMIC_RELAXED);
+  return p;
+}
+
+// Any thread: the top end; NULL when empty or on a lost race
+static size_t *gc_deque_steal (gc_worker *w) {
+  long          t = __atomic_load_n (&w->top, __ATOMIC_ACQUIRE);
+  long          b;
+  gc_deque_buf *buf;
+  size_t       *p;
+
+  __atomic_thread_fence (__ATOMIC_SEQ_CST);
+  b = __atomic_load_n (&w->bottom, __ATOMIC_ACQUIRE);
+  if (t >= b) return NULL;
+  buf = __atomic_load_n (&w->buf, __ATOMIC_ACQUIRE);
+  p   = __atomic_load_n (&buf->items[t & buf->mask], __ATOMIC_RELAXED);
+  if (!__atomic_compare_exchange_n (&w->top, &t, t + 1, 0,
+				    __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+    return NULL;
+  return p;
+}
+
+static int gc_deque_empty (gc_worker *w) {
+  return __atomic_load_n (&w->top, __ATOMIC_ACQUIRE) >=
+         __atomic_load_n (&w->bottom, __ATOMIC_ACQUIRE);
+}
+
+// An unreachable object of the given size (an array of unboxed words)
+static void gc_fill (size_t *p, size_t words) {
+  hword *h = (hword*) p;
+  size_t len;
+
+  if (words == 0) return;
+  len  = words * sizeof(size_t) / sizeof(hword) - 1;
+  h[0] = ARRAY_TAG | (len << 3);
+  for (size_t i = 1; i <= len; i++) h[i] = BOX(0);
+}
+
+static size_t *gc_par_take (size_t words) {
+  size_t *p = __atomic_fetch_add (&current, words * sizeof(size_t), __ATOMIC_RELAXED);
+  if (p + words > gc_target->end) failure ("gc: out of to-space\n");
+  return p;
+}
+
+static size_t *gc_lab_alloc (gc_worker *w, size_t words) {
+  size_t *p;
+
+  if (words > GC_LAB_LARGE) return gc_par_take (words);
+  if (w->lab + words > w->lab_end) {
+    gc_fill (w->lab, w->lab_end - w->lab);
+    w->lab     = gc_par_take (GC_LAB_WORDS);
+    w->lab_end = w->lab + GC_LAB_WORDS;
+  }
+  p       = w->lab;
+  w->lab += words;
+  return p;
+}
+
+// gc_copy for several threads
+static size_t *gc_par_copy (gc_worker *w, size_t *obj) {
+  data   *d   = TO_DATA(obj);
+  hword   tag = __atomic_load_n (&d->tag, __ATOMIC_ACQUIRE);
+  size_t  words, bytes;
+  int     hdr;
+  hword  *copy;
+
+  if (IS_FORWARD_PTR(FROM_WORD(tag))) return (size_t*) FROM_WORD(tag);
+  // a large object is scanned in place: its header goes to the deque
+  if (IS_LARGE(obj)) {
+    if (gc_large_mark (obj)) gc_deque_push (w, (size_t*) d);
+    return obj;
+  }
+
+  words   = copy_size (tag, &bytes, &hdr);
+  copy    = (hword*) gc_lab_alloc (w, words);
+  copy[0] = tag;
+  if (hdr == 2) copy[1] = TO_SEXP(obj)->tag;
+  memcpy (copy + hdr, obj, bytes);
+
+  if (!__atomic_compare_exchange_n (&d->tag, &tag, TO_WORD(copy + hdr), 0,
+				    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    if (words > GC_LAB_LARGE) gc_fill ((size_t*) copy, words);
+    else w->lab = (size_t*) copy;
+    return (size_t*) FROM_WORD(tag);
+  }
+  if (TAG(tag) != STRING_TAG) gc_deque_push (w, (size_t*) copy);
+  return (size_t*) (copy + hdr);
+}
+
+static void gc_par_fields (gc_worker *w, hword *fields, int len) {
+  for (int i = 0; i < len; i++) {
+    void *elem = FROM_WORD(fields[i]);
+    if (IS_VALID_HEAP_POINTER(elem))
+      fields[i] = TO_WORD(gc_par_copy (w, (size_t*) elem));
+  }
+}
+
+static void gc_par_work (gc_worker *w) {
+  long    id = w - gc_workers;
+  size_t *p;
+  hword  *fields;
+  int     len;
+
+  for (size_t i = id * gc_roots_n / gc_threads; i < (id + 1) * gc_roots_n / gc_threads; i++) {
+    size_t **root = gc_roots[i];
+    if (IS_VALID_HEAP_POINTER(*root)) *root = gc_par_copy (w, *root);
+  }
+  if (gc_young_only)
+    for (size_t i = id * remembered_n / gc_threads; i < (id + 1) * remembered_n / gc_threads; i++) {
+      fields = (hword*) remembered[i];
+      gc_par_fields (w, fields, fields_len (fields));
+    }
+
+  for (;;) {
+    while ((p = gc_deque_take (w)) != NULL) {
+      copy_layout (p, &fields, &len);
+      gc_par_fields (w, fields, len);
+    }
+
+    for (int k = 0; k < 2 * gc_threads && p == NULL; k++)
+      p = gc_deque_steal (&gc_workers[rand_r (&w->seed) % gc_threads]);
+    if (p != NULL) {
+      copy_layout (p, &fields, &len);
+      gc_par_fields (w, fields, len);
+      continue;
+    }
+
+    // Every thread out of work with all deques empty: the copy is complete
+    __atomic_fetch_add (&gc_idle, 1, __ATOMIC_SEQ_CST);
+    for (;;) {
+      int busy = 0;
+      if (__atomic_load_n (&gc_idle, __ATOMIC_SEQ_CST) == gc_threads) return;
+      for (int k = 0; k < gc_threads && !busy; k++) busy = !gc_deque_empty (&gc_workers[k]);
+      if (busy) break;
+      sched_yield ();
+    }
+    __atomic_fetch_sub (&gc_idle, 1, __ATOMIC_SEQ_CST);
+  }
+}
+
+static void *gc_worker_main (void *arg) {
+  gc_worker     *w    = arg;
+  unsigned long  seen = 0;
+
+  for (;;) {
+    pthread_mutex_lock (&gc_lock);
+    while (gc_epoch == seen) pthread_cond_wait (&gc_start_cv, &gc_lock);
+    seen = gc_epoch;
+    pthread_mutex_unlock (&gc_lock);
+
+    gc_par_work (w);
+
+    pthread_mutex_lock (&gc_lock);
+    if (--gc_running == 0) pthread_cond_signal (&gc_done_cv);
+    pthread_mutex_unlock (&gc_lock);
+  }
+  return NULL;
+}
+
+static void init_gc_threads (void) {
+  char *s     = getenv ("LVM_GC_THREADS");
+  long  ncpus = sysconf (_SC_NPROCESSORS_ONLN);
+  if (s != NULL) gc_threads = atoi (s);
+  // idle threads spin while the others copy: more threads than processors only slow it down
+  if (ncpus > 0 && gc_threads > ncpus) gc_threads = ncpus;
+  if (gc_threads > GC_MAX_THREADS) gc_threads = GC_MAX_THREADS;
+  if (gc_threads < 1) gc_threads = 1;
+  for (int i = 0; i < gc_threads; i++) {
+    gc_workers[i].buf  = gc_deque_alloc (1024);
+    gc_workers[i].seed = i + 1;
+  }
+  for (int i = 1; i < gc_threads; i++)
+    if (pthread_create (&gc_workers[i].thread, NULL, gc_worker_main, &gc_workers[i]) != 0)
+      failure ("init_gc_threads: cannot start GC thread %d\n", i);
+}
+
+// Copies the listed roots (and the remembered set) and everything reachable from them
+static void gc_par_run (void) {
+  pthread_mutex_lock (&gc_lock);
+  gc_running = gc_threads - 1;
+  gc_idle    = 0;
+  gc_epoch++;
+  pthread_cond_broadcast (&gc_start_cv);
+  pthread_mutex_unlock (&gc_lock);
+
+  gc_par_work (&gc_workers[0]);
+
+  pthread_mutex_lock (&gc_lock);
+  while (gc_running > 0) pthread_cond_wait (&gc_done_cv, &gc_lock);
+  pthread_mutex_unlock (&gc_lock);
+
+  for (int i = 0; i < gc_threads; i++) {
+    gc_worker    *w = &gc_workers[i];
+    gc_deque_buf *r = w->buf->retired;
+    gc_fill (w->lab, w->lab_end - w->lab);
+    w->lab = w->lab_end = NULL;
+    w->buf->retired = NULL;
+    while (r != NULL) {
+      gc_deque_buf *next = r->retired;
+      free (r);
+      r = next;
+    }
+  }
+  gc_roots_n = 0;
+}
+
+// Lists the root slots in gc_roots
+static void gc_list_root_slots (void) {
+  gc_list_roots = 1;
+  gc_root_scan_data ();
+#ifdef DEBUG_PRINT
+  print_indent ();
+  printf ("gc: data is scanned\n"); fflush (stdout);
+#endif
+  gc_root_scan_stack ();
+  for (int i = 0; i < extra_roots.current_free; i++) {
+#ifdef DEBUG_PRINT
+    print_indent ();
+    printf ("gc: extra_root № %i: %p %p\n", i, extra_roots.roots[i],
+	    (size_t*) extra_roots.roots[i]);
+    fflush (stdout);
+#endif
+    gc_test_and_copy_root ((size_t**)extra_roots.roots[i]);
+  }
+#ifdef DEBUG_PRINT
+  print_indent ();
+  printf ("gc: no more extra roots\n"); fflush (stdout);
+#endif
+  gc_list_roots = 0;
+}
+
+// Copies everything reachable from the roots (and, in a minor collection, from
+// the remembered set) to gc_target at current; live bounds the amount to copy
+static void gc_copy_live (size_t live) {
+  size_t *scan = current;
+
+  if (gc_threads > 1 &&
+      (size_t) (gc_target->end - current) >= live + live / 4 + 2 * gc_threads * GC_LAB_WORDS) {
+    gc_list_root_slots ();
+    gc_par_run ();
+    return;
+  }
+  gc_root_scan_data ();
+  gc_root_scan_stack ();
+  for (int i = 0; i < extra_roots.current_free; i++)
+    gc_test_and_copy_root ((size_t**)extra_roots.roots[i]);
+  if (gc_young_only)
+    for (size_t i = 0; i < remembered_n; i++) {
+      hword *fields = (hword*) remembered[i];
+      copy_elements (fields, fields, fields_len (fields));
+    }
+  gc_scan (scan);
+}
+
+// Replica of an original (allocated at to_space.current, not scanned)
+static hword *gc_replicate (hword *obj) {
+  size_t  i    = obj - (hword*) from_space.begin;
+  hword   tag  = TO_DATA(obj)->tag;
+  hword  *copy = (hword*) to_space.current;
+  size_t  bytes;
+  int     hdr;
+
+  if (gc_cycle.fwd[i]) return (hword*) to_space.begin + gc_cycle.fwd[i] - 1;
+  to_space.current += copy_size (tag, &bytes, &hdr);
+  copy[0] = tag;
+  if (hdr == 2) copy[1] = TO_SEXP(obj)->tag;
+  memcpy (copy + hdr, obj, bytes);
+  gc_cycle.fwd[i] = (uint32_t) (copy + hdr - (hword*) to_space.begin) + 1;
+  return copy + hdr;
+}
+
+static void gc_replicate_fields (hword *fields, int len) {
+  for (int i = 0; i < len; i++) {
+    void *elem = FROM_WORD(fields[i]);
+    if (gc_is_original (elem)) fields[i] = TO_WORD(gc_replicate ((hword*) elem));
+  }
+}
+
+// Replicates the targets of the roots; update: and points the roots to them
+static void gc_replicate_roots (int update) {
+  gc_list_root_slots ();
+  for (size_t i = 0; i < gc_roots_n; i++) {
+    size_t **root = gc_roots[i];
+    if (gc_is_original (*root)) {
+      hword *r = gc_replicate ((hword*) *root);
+      if (update) *root = (size_t*) r;
+    }
+  }
+  gc_roots_n = 0;
+}
+
+// Re-copies logged originals and scans replicas until nothing is left
+// (returns 1) or, with a deadline, the time is up
+static int gc_cycle_work (uint64_t deadline) {
+  hword   *fields;
+  int      len;
+  unsigned k = 0;
+
+  for (;;) {
+    if (deadline && (++k & 63) == 0 && gc_clock () >= deadline) return 0;
+
+    if (gc_cycle.log_n > 0) {
+      hword *obj = gc_cycle.log[--gc_cycle.log_n];
+      size_t i   = obj - (hword*) from_space.begin, bytes;
+      int    hdr;
+      if (gc_cycle.fwd[i]) {
+	hword *r   = (hword*) to_space.begin + gc_cycle.fwd[i] - 1;
+	hword  tag = TO_DATA(obj)->tag;
+	copy_size (tag, &bytes, &hdr);
+	// what the replica pointed to stays live until the flip: the
+	// program may still hold it in young objects
+	if ((size_t*) r > gc_cycle.scan && TAG(tag) != STRING_TAG)
+	  gc_replicate_fields (r, LEN(tag));
+	memcpy (r, obj, bytes);
+	// a replica behind the scan is fixed up here, one ahead by the scan
+	if ((size_t*) r <= gc_cycle.scan && TAG(tag) != STRING_TAG)
+	  gc_replicate_fields (r, LEN(tag));
+      }
+      continue;
+    }
+
+    if (gc_cycle.scan < to_space.current) {
+      gc_cycle.scan += copy_layout (gc_cycle.scan, &fields, &len);
+      gc_replicate_fields (fields, len);
+      continue;
+    }
+
+    // large objects keep referring to the originals until the flip
+    if (gc_cycle.large < gc_large.n) {
+      fields = LARGE_OBJECT(gc_large.blocks[gc_cycle.large++]);
+      len    = fields_len (fields);
+      for (int i = 0; i < len; i++)
+	if (gc_is_original (FROM_WORD(fields[i]))) gc_replicate (FROM_WORD(fields[i]));
+      continue;
+    }
+    return 1;
+  }
+}
+
+static void gc_cycle_schedule (void) {
+  size_t room  = (from_space.end - NURSERY_SIZE - from_space.current) / 2;
+  size_t grown = from_space.current - from_space.begin;
+
+  if (grown < 4 * NURSERY_SIZE) grown = 4 * NURSERY_SIZE;
+  gc_cycle_at = from_space.current + (grown < room ? grown : room);
+}
+
+static void gc_cycle_start (void) {
+  size_t n = from_space.size * (sizeof(size_t) / sizeof(hword));
+
+  if (n >= UINT32_MAX) return;              // offsets do not fit the side table
+  gc_cycle.fwd_bytes = n * sizeof(uint32_t);
+  gc_cycle.fwd       = mmap (NULL, gc_cycle.fwd_bytes, PROT_READ | PROT_WRITE,
+			     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (gc_cycle.fwd == MAP_FAILED) {
+    gc_cycle.fwd = NULL;
+    return;
+  }
+  init_to_space (0);
+  gc_cycle.scan    = to_space.begin;
+  gc_cycle.done    = 0;
+  gc_cycle.log_n   = 0;
+  gc_cycle.large   = 0;
+  __gc_replicating = 1;
+  gc_incr_at       = nursery.current + GC_INCR_WORDS;
+  gc_replicate_roots (0);
+}
+
+static void gc_cycle_end (void) {
+  munmap (gc_cycle.fwd, gc_cycle.fwd_bytes);
+  gc_cycle.fwd     = NULL;
+  gc_cycle.log_n   = 0;
+  gc_cycle.fresh_n = 0;
+  __gc_replicating = 0;
+  gc_incr_at       = (size_t*) UINTPTR_MAX;
+}
+
+// One step of the cycle, called by alloc: moves nothing
+static void gc_step (void) {
+  uint64_t start = gc_clock ();
+
+  gc_replicate_roots (0);
+  gc_cycle.done = gc_cycle_work (start + GC_PAUSE_NS);
+  gc_incr_at    = nursery.current + GC_INCR_WORDS;
+
+  gc_stats.steps++;
+  gc_stats.step_ns += gc_clock () - start;
+  gc_pause (start);
+}
+
+static void gc_minor (void);
+
+// How a collection that has not moved anything yet tells the live objects
+# define GC_SURVEY_COPY    0                // a forwarding pointer in the header
+# define GC_SURVEY_COMPACT 1                // the start bit
+# define GC_SURVEY_FLIP    2                // a replica; large objects all stay
+static void gc_sites_survey_outside (int how);
+
+// The end of the cycle: a minor collection, then the replicas become the old space
+static void gc_flip (void) {
+  uint64_t start;
+
+  gc_minor ();
+  start = gc_clock ();
+  // contents of a fresh block are after one header word or, in a sexp, two;
+  // the side table knows only the real one
+  for (size_t i = 0; i < gc_cycle.fresh_n; i++) {
+    gc_log_write ((hword*) gc_cycle.fresh[i] + 1);
+    gc_log_write ((hword*) gc_cycle.fresh[i] + 2);
+  }
+  gc_replicate_roots (1);
+  for (size_t i = 0; i < gc_large.n; i++) {
+    hword *fields = LARGE_OBJECT(gc_large.blocks[i]);
+    gc_replicate_fields (fields, fields_len (fields));
+  }
+  gc_cycle_work (0);
+  gc_sites_survey_outside (GC_SURVEY_FLIP);
+  current = to_space.current;
+  gc_cycle_end ();
+  gc_swap_spaces ();
+  gc_live_pct = (int) ((from_space.current - from_space.begin) * 100 / from_space.size);
+  gc_resize_heap (start, 0);
+  gc_cycle_schedule ();
+
+  gc_stats.flips++;
+  gc_stats.flip_ns += gc_clock () - start;
+}
+
+/* Mark-compact major collection (LVM_GC_COMPACT=p): when the live data left
+   by the last major collection took at least p percent of the old space
+   (30 by default), the next one compacts the old space in place instead of
+   copying it to a to_space of the same size, so the heap needs one space,
+   not two, at its peak (copying wins when little survives, when much does
+   it saves little time). The nursery is emptied by a minor collection first.
+   Marking uses an explicit stack; the live objects then slide to the
+   beginning of the space in their order (Lisp-2, but without a forwarding
+   word: new addresses come from bitmaps). One bitmap has a bit per word of
+   every live object, the other a bit per heap word where the contents of a
+   live object begin (a walk over the space could not tell the sexp tag of
+   one object from the data tag of another). The new offset of a word is the
+   number of live words before its block of 64, plus those before it in the
+   block. If there is still no room, the space is grown before anything is
+   moved: mremap may put it at another address, so the references are
+   updated as offsets. p = 100 never compacts, p = 0 always does. */
+
+static struct {
+  uint64_t *live;                           // bit per word of the old space
+  uint64_t *starts;                         // bit per hword: contents of a live object
+  size_t   *dest;                           // per block of 64 words: live words before it
+  size_t    bytes;
+  char     *from, *top;                     // the old space when marked
+  hword   **stack;
+  size_t    stack_n, stack_cap;
+} gc_mc;
+
+static int gc_mc_in (void *p) {
+  return !UNBOXED(p) && gc_mc.from < (char*) p && (char*) p <= gc_mc.top;
+}
+
+static void gc_mc_push (hword *obj) {
+  if (gc_mc.stack_n == gc_mc.stack_cap) {
+    gc_mc.stack_cap = gc_mc.stack_cap ? gc_mc.stack_cap * 2 : 1024;
+    gc_mc.stack     = realloc (gc_mc.stack, gc_mc.stack_cap * sizeof(hword*));
+    if (gc_mc.stack == NULL) failure ("gc_mc_push: out of memory\n");
+  }
+  gc_mc.stack[gc_mc.stack_n++] = obj;
+}
+
+static void gc_mc_mark (hword *obj) {
+  size_t i = obj - (hword*) gc_mc.from, bytes, w, n;
+  int    hdr;
+
+  if (gc_mc.starts[i >> 6] >> (i & 63) & 1) return;
+  gc_mc.starts[i >> 6] |= (uint64_t) 1 << (i & 63);
+  n = copy_size (TO_DATA(obj)->tag, &bytes, &hdr);
+  for (w = (size_t*) (obj - hdr) - (size_t*) gc_mc.from; n > 0; w++, n--)
+    gc_mc.live[w >> 6] |= (uint64_t) 1 << (w & 63);
+  gc_mc_push (obj);
+}
+
+// A large object is only marked: its fields are updated in place
+static void gc_mc_mark_any (void *p) {
+  if (gc_mc_in (p)) gc_mc_mark ((hword*) p);
+  else if (!UNBOXED(p) && IS_LARGE(p) && gc_large_mark (p)) gc_mc_push ((hword*) p);
+}
+
+// New address of a reference into a live object
+static void *gc_mc_forward (void *p) {
+  size_t   off = (char*) p - gc_mc.from;
+  size_t   w   = off / sizeof(size_t);
+  uint64_t m   = gc_mc.live[w >> 6] & (((uint64_t) 1 << (w & 63)) - 1);
+
+  return (char*) (from_space.begin + gc_mc.dest[w >> 6] + __builtin_popcountll (m))
+    + off % sizeof(size_t);
+}
+
+// Calls f on the contents of every marked object, in address order
+static void gc_mc_each (void (*f) (hword *obj, size_t i)) {
+  size_t n = ((hword*) gc_mc.top - (hword*) gc_mc.from) / 64 + 1;
+
+  for (size_t k = 0; k < n; k++)
+    for (uint64_t b = gc_mc.starts[k]; b != 0; b &= b - 1) {
+      size_t i = (k << 6) + __builtin_ctzll (b);
+      f ((hword*) from_space.begin + i, i);
+    }
+}
+
+static void gc_mc_update (hword *obj, size_t i) {
+  hword tag = TO_DATA(obj)->tag;
+
+  (void) i;
+  if (TAG(tag) == STRING_TAG) return;
+  for (size_t j = 0; j < LEN(tag); j++) {
+    void *elem = FROM_WORD(obj[j]);
+    if (gc_mc_in (elem)) obj[j] = TO_WORD(gc_mc_forward (elem));
+  }
+}
+
+static void gc_mc_slide (hword *obj, size_t i) {
+  size_t bytes;
+  int    hdr;
+  size_t n = copy_size (TO_DATA(obj)->tag, &bytes, &hdr);
+
+  memmove (gc_mc_forward ((hword*) gc_mc.from + i - hdr), obj - hdr, n * sizeof(size_t));
+}
+
+// The samples outside of the nursery (see gc_site_outside) that survived
+// the collection; large ones stay samples after a flip, which sweeps none
+static void gc_sites_survey_outside (int how) {
+  size_t n = 0;
+
+  for (size_t i = 0; i < gc_sites.outside_n; i++) {
+    gc_sample_t *x      = &gc_sites.outside[i];
+    hword       *fields = (hword*) x->p + x->hdr;
+    size_t       k;
+    int          survived;
+
+    if (IS_LARGE(fields)) {
+      if (how == GC_SURVEY_FLIP) {
+	gc_sites.outside[n++] = *x;
+	continue;
+      }
+      survived = LARGE_BLOCK(fields)[1] == gc_large.epoch;
+    }
+    else if (how == GC_SURVEY_COMPACT) {
+      k = fields - (hword*) gc_mc.from;
+      survived = gc_mc.starts[k >> 6] >> (k & 63) & 1;
+    }
+    else if (how == GC_SURVEY_FLIP) survived = gc_cycle.fwd[fields - (hword*) from_space.begin] != 0;
+    else survived = !UNBOXED(((hword*) x->p)[x->hdr - 1]);
+    gc_sample_count (x, survived);
+  }
+  gc_sites.outside_n = n;
+}
+
+static void *gc (size_t size);
+
+// Major collection in place; size words are then allocated at the end
+static void *gc_compact (size_t size) {
+  size_t  words, blocks, nstart, new_size;
+  size_t *vals, *moved;
+  void   *p;
+
+  if (nursery.current != nursery.begin) gc_minor ();
+  // compaction is chosen to need one space, so the spare keeps no pages
+  if (spare.begin != NULL) release_pages (spare.begin, spare.size, 0);
+  // one bit more for a reference to the top (see gc_is_original)
+  words  = from_space.current - from_space.begin;
+  blocks = words / 64 + 1;
+  nstart = words * (sizeof(size_t) / sizeof(hword)) / 64 + 1;
+
+  gc_mc.bytes = (2 * blocks + nstart + 1) * sizeof(uint64_t);
+  p = mmap (NULL, gc_mc.bytes, PROT_READ | PROT_WRITE,
+	    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (p == MAP_FAILED) {
+    init_to_space (0);
+    return gc (size);
+  }
+  gc_mc.live   = p;
+  gc_mc.starts = gc_mc.live + blocks;
+  gc_mc.dest   = (size_t*) (gc_mc.starts + nstart);
+  gc_mc.from   = (char*) from_space.begin;
+  gc_mc.top    = (char*) from_space.current;
+
+  gc_large.epoch++;
+  gc_list_root_slots ();
+  for (size_t i = 0; i < gc_roots_n; i++) gc_mc_mark_any (*gc_roots[i]);
+  while (gc_mc.stack_n > 0) {
+    hword *obj = gc_mc.stack[--gc_mc.stack_n];
+    hword  tag = TO_DATA(obj)->tag;
+    if (TAG(tag) == STRING_TAG) continue;
+    for (size_t i = 0; i < LEN(tag); i++) gc_mc_mark_any (FROM_WORD(obj[i]));
+  }
+  gc_sites_survey_outside (GC_SURVEY_COMPACT);
+  for (size_t k = 0; k < blocks; k++)
+    gc_mc.dest[k + 1] = gc_mc.dest[k] + __builtin_popcountll (gc_mc.live[k]);
+
+  // the space grows before anything is moved; if it cannot, it is copied
+  for (new_size = SPACE_SIZE; gc_mc.dest[blocks] + size + NURSERY_SIZE >= new_size;
+       new_size = grown_space_size (new_size))
+    if (grown_space_size (new_size) == new_size)
+      failure ("heap exhausted (%zu bytes per semispace)\n", new_size * sizeof(size_t));
+  if (new_size != from_space.size) {
+    moved = move_space (from_space.begin, from_space.size, new_size);
+    if (moved == MAP_FAILED) {
+      gc_roots_n = 0;
+      munmap (gc_mc.live, gc_mc.bytes);
+      init_to_space (1);
+      return gc (size);
+    }
+    SPACE_SIZE       = new_size;
+    from_space.begin = moved;
+    from_space.end   = moved + new_size;
+    from_space.size  = new_size;
+  }
+
+  // a slot may be listed twice, so all new values are computed first
+  vals = malloc ((gc_roots_n + 1) * sizeof(size_t));
+  if (vals == NULL) failure ("gc_compact: out of memory\n");
+  for (size_t i = 0; i < gc_roots_n; i++)
+    vals[i] = (size_t) (gc_mc_in (*gc_roots[i]) ? gc_mc_forward (*gc_roots[i]) : *gc_roots[i]);
+  for (size_t i = 0; i < gc_roots_n; i++) *gc_roots[i] = (size_t*) vals[i];
+  free (vals);
+  gc_roots_n = 0;
+
+  gc_mc_each (gc_mc_update);
+  for (size_t i = 0; i < gc_large.n; i++)
+    if (gc_large.blocks[i][1] == gc_large.epoch) gc_mc_update (LARGE_OBJECT(gc_large.blocks[i]), 0);
+  gc_mc_each (gc_mc_slide);
+  from_space.current = from_space.begin + gc_mc.dest[blocks];
+  munmap (gc_mc.live, gc_mc.bytes);
+  // with the nursery empty on entry no minor collection has reset the
+  // remembered set: its pretenured objects have just been slid away
+  remembered_n = 0;
+
+  p = from_space.current;
+  from_space.current += size;
+  return p;
 }
 
 extern void gc_test_and_copy_root (size_t ** root) {
@@ -1867,7 +3736,8 @@ extern void gc_test_and_copy_root (size_t ** root) {
     printf ("gc_test_and_copy_root: root %p top=%p bot=%p  *root %p \n", root, __gc_stack_top, __gc_stack_bottom, *root);
     fflush (stdout);
 #endif
-    *root = gc_copy (*root);
+    if (gc_list_roots) gc_root_push (root);
+    else *root = gc_copy (*root);
   }
 #ifdef DEBUG_PRINT
   else {
@@ -1891,15 +3761,12 @@ static inline void init_extra_roots (void) {
   extra_roots.current_free = 0;
 }
 
-extern void __init (void) {
-  size_t space_size = SPACE_SIZE * sizeof(size_t);
-
-  srandom (time (NULL));
-  
-  from_space.begin = mmap (NULL, space_size, PROT_READ | PROT_WRITE,
-    			   MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+static void init_heap (void) {
+  init_heap_sizing ();
+  reserve_heap ();
+  from_space.begin = map_space (NULL, SPACE_SIZE);
   to_space.begin   = NULL;
-  if (to_space.begin == MAP_FAILED) {
+  if (from_space.begin == MAP_FAILED) {
     perror ("EROOR: init_pool: mmap failed\n");
     exit   (1);
   }
@@ -1909,6 +3776,19 @@ extern void __init (void) {
   to_space.current   = NULL;
   to_space.end       = NULL;
   to_space.size      = 0;
+  init_nursery ();
+  init_gc_sites ();
+  init_gc_release ();
+  init_gc_threads ();
+  gc_cycle_schedule ();
+  gc_heap.at          = gc_clock ();
+  gc_stats.space_peak = SPACE_SIZE;
+}
+
+extern void __init (void) {
+  srandom (time (NULL));
+
+  init_heap ();
   init_extra_roots ();
 }
 
@@ -1918,6 +3798,7 @@ static void* gc (size_t size) {
   }
   
   current = to_space.begin;
+  gc_large.epoch++;
 #ifdef DEBUG_PRINT
   print_indent ();
   printf ("gc: current:%p; to_space.b =%p; to_space.e =%p; \
@@ -1926,25 +3807,9 @@ static void* gc (size_t size) {
 	  __gc_stack_top, __gc_stack_bottom);
   fflush (stdout);
 #endif
-  gc_root_scan_data ();
-#ifdef DEBUG_PRINT
-  print_indent ();
-  printf ("gc: data is scanned\n"); fflush (stdout);
-#endif
-  __gc_root_scan_stack ();
-  for (int i = 0; i < extra_roots.current_free; i++) {
-#ifdef DEBUG_PRINT
-    print_indent ();
-    printf ("gc: extra_root № %i: %p %p\n", i, extra_roots.roots[i],
-	    (size_t*) extra_roots.roots[i]);
-    fflush (stdout);
-#endif
-    gc_test_and_copy_root ((size_t**)extra_roots.roots[i]);
-  }
-#ifdef DEBUG_PRINT
-  print_indent ();
-  printf ("gc: no more extra roots\n"); fflush (stdout);
-#endif
+  gc_copy_live ((from_space.current - from_space.begin) +
+		(nursery.current - nursery.begin));
+  gc_sites_survey_outside (GC_SURVEY_COPY);
 
   if (!IN_PASSIVE_SPACE(current)) {
     printf ("gc: ASSERT: !IN_PASSIVE_SPACE(current) to_begin = %p to_end = %p \
@@ -1954,7 +3819,7 @@ static void* gc (size_t size) {
     exit   (1);
   }
 
-  while (current + size >= to_space.end) {
+  while (current + size + NURSERY_SIZE >= to_space.end) {
 #ifdef DEBUG_PRINT
     print_indent ();
     printf ("gc: pre-extend_spaces : %p %zu %p \n", current, size, to_space.end);
@@ -1972,9 +3837,10 @@ static void* gc (size_t size) {
 #endif
   }
   assert (IN_PASSIVE_SPACE(current));
-  assert (current + size < to_space.end);
+  assert (current + size + NURSERY_SIZE < to_space.end);
 
   gc_swap_spaces ();
+  reset_nursery ();
   from_space.current = current + size;
 #ifdef DEBUG_PRINT
   print_indent ();
@@ -1987,6 +3853,80 @@ static void* gc (size_t size) {
   return (void *) current;
 }
 
+// Major collection: both the old space and the nursery
+static void* gc_major (size_t size) {
+  uint64_t start = gc_clock ();
+  void    *p;
+
+  if (__gc_replicating) {
+    gc_cycle_end ();
+    park_space (&to_space, to_space.current - to_space.begin);
+    gc_stats.aborted++;
+  }
+  if (GC_COMPACT_PCT < 100 && gc_live_pct >= GC_COMPACT_PCT) {
+    p = gc_compact (size);
+    gc_stats.compacting++;
+  }
+  else {
+    init_to_space (0);
+    p = gc (size);
+  }
+  gc_live_pct = (int) (((size_t*) p - from_space.begin) * 100 / from_space.size);
+  gc_resize_heap (start, 1);
+  gc_large_sweep ();
+  // the nursery is empty now, so nothing has to stay remembered: an entry
+  // of a swept large object would point to freed or reused pages
+  remembered_n = 0;
+  gc_cycle_schedule ();
+  gc_stats.major++;
+  gc_stats.major_ns += gc_clock () - start;
+  gc_pause (start);
+  return p;
+}
+
+// Minor collection: nursery survivors are copied to the end of the old space
+static void gc_minor (void) {
+  uint64_t start = gc_clock ();
+  size_t  *old   = from_space.current;
+
+  if (! enable_GC) {
+    Lfailure ("GC disabled");
+  }
+
+  // the collection updates the remembered objects, replicas of them follow
+  if (__gc_replicating)
+    for (size_t i = 0; i < remembered_n; i++) gc_log_write (remembered[i]);
+
+  gc_young_only = 1;
+  gc_target     = &from_space;
+  current       = from_space.current;
+  gc_copy_live (nursery.current - nursery.begin);
+  from_space.current = current;
+  gc_target     = &to_space;
+  gc_young_only = 0;
+  reset_nursery ();
+
+  gc_stats.minor++;
+  gc_stats.promoted += from_space.current - old;
+  gc_stats.minor_ns += gc_clock () - start;
+}
+
+// Empties the nursery: promotes its survivors or, without room for them, collects everything
+static void gc_young (void) {
+  size_t   used = nursery.current - nursery.begin;
+  uint64_t start;
+
+  if (from_space.current + used >= from_space.end - NURSERY_SIZE) {
+    gc_major (0);
+    return;
+  }
+  start = gc_clock ();
+  if (__gc_replicating && gc_cycle.done) gc_flip ();
+  else gc_minor ();
+  if (GC_PAUSE_NS && !__gc_replicating && from_space.current >= gc_cycle_at) gc_cycle_start ();
+  gc_pause (start);
+}
+
 #ifdef DEBUG_PRINT
 static void printFromSpace (void) {
   size_t * cur = from_space.begin, *tmp = NULL;
@@ -2006,16 +3946,16 @@ static void printFromSpace (void) {
     case STRING_TAG:
       printf ("(=>%p): STRING\n\t%s; len = %i %zu\n",
 	      d->contents, d->contents,
-	      LEN(d->tag), LEN(d->tag) + 1 + sizeof(int));
+	      LEN(d->tag), LEN(d->tag) + 1 + sizeof(hword));
       fflush (stdout);
-      len = (LEN(d->tag) + sizeof(int)) / sizeof(size_t) + 1;
+      len = (LEN(d->tag) + sizeof(hword)) / sizeof(size_t) + 1;
       break;
 
     case CLOSURE_TAG:
       printf ("(=>%p): CLOSURE\n\t", d->contents);
       len = LEN(d->tag);
       for (int i = 0; i < len; i++) {
-	int elem = ((int*)d->contents)[i];
+	hword elem = ((hword*)d->contents)[i];
 	if (UNBOXED(elem)) printf ("%d ", elem);
 	else printf ("%p ", elem);
       }
@@ -2028,7 +3968,7 @@ static void printFromSpace (void) {
       printf ("(=>%p): ARRAY\n\t", d->contents);
       len = LEN(d->tag);
       for (int i = 0; i < len; i++) {
-	int elem = ((int*)d->contents)[i];
+	hword elem = ((hword*)d->contents)[i];
 	if (UNBOXED(elem)) printf ("%d ", elem);
 	else printf ("%p ", elem);
       }
@@ -2045,7 +3985,7 @@ static void printFromSpace (void) {
       len = LEN(d->tag);
       tmp = (s->contents.contents);
       for (int i = 0; i < len; i++) {
-	int elem = ((int*)tmp)[i];
+	hword elem = ((hword*)tmp)[i];
 	if (UNBOXED(elem)) printf ("%d ", UNBOX(elem));
 	else printf ("%p ", elem);
       }
@@ -2076,40 +4016,111 @@ static void printFromSpace (void) {
 #endif
 
 #ifdef __ENABLE_GC__
-// alloc: allocates `size` bytes in heap
-extern void * alloc (size_t size) {
+// An object at a pretenured site (see gc_site_pretenured): it is remembered,
+// so nothing has to leave the nursery first
+static void * alloc_old (size_t size, int hdr) {
+  uint32_t s = gc_site_of ();
+  void   * p;
+
+  if (from_space.current + size < from_space.end - NURSERY_SIZE) {
+    p = (void*) from_space.current;
+    from_space.current += size;
+    if (__gc_replicating) gc_log_fresh (p);
+  }
+  else p = gc_major (size);
+  gc_remember ((hword*) p + hdr);
+  gc_sites.site[s].pretenured++;
+  if (gc_sites.census) gc_site_count (s, size);
+  gc_stats.pretenured += size;
+  return p;
+}
+
+// hdr: header words of the object, 2 in a sexp (which never goes to the
+// large-object space)
+static void * alloc_slow (size_t size, int hdr) {
+  void * p = (void*)BOX(NULL);
+
+  if (from_space.begin == NULL) init_heap ();
+
+  if (hdr == 1 && GC_LARGE_WORDS > 0 && size >= GC_LARGE_WORDS) {
+    if (gc_large.begin != NULL && gc_large.words + size > gc_large.limit) gc_major (0);
+    p = gc_large_alloc (size);
+    if (p != NULL) {
+      gc_remember ((hword*) p + 1);
+      if (gc_sites.census) gc_site_outside (p, size, hdr);
+      return p;
+    }
+  }
+
+  /* An object that goes to the old space is filled without the write
+     barrier, so nothing may be left in the nursery to point to */
+  if (nursery.current != nursery.begin) gc_young ();
+  if (size <= NURSERY_LIMIT) {
+    p = (void*) nursery.current;
+    nursery.current += size;
+    if (nursery.current >= gc_sites.sample_at) gc_site_sample (p, hdr);
+    return p;
+  }
+
+  if (from_space.current + size < from_space.end - NURSERY_SIZE) {
+    p = (void*) from_space.current;
+    from_space.current += size;
+    if (__gc_replicating) gc_log_fresh (p);
+  }
+  else {
+#ifdef DEBUG_PRINT
+    print_indent ();
+    printf ("alloc: call gc: %zu\n", size); fflush (stdout);
+    printFromSpace(); fflush (stdout);
+    p = gc_major (size);
+    print_indent ();
+    printf("alloc: gc END %p %p %p %p\n\n", from_space.begin,
+	   from_space.end, from_space.current, p); fflush (stdout);
+    printFromSpace(); fflush (stdout);
+#else
+    p = gc_major (size);
+#endif
+  }
+  if (gc_sites.census) gc_site_outside (p, size, hdr);
+  return p;
+}
+
+static inline void * alloc_words (size_t size, int hdr) {
   void * p = (void*)BOX(NULL);
-  size = (size - 1) / sizeof(size_t) + 1; // convert bytes to words
 #ifdef DEBUG_PRINT
   indent++; print_indent ();
-  printf ("alloc: current: %p %zu words!", from_space.current, size);
+  printf ("alloc: current: %p %zu words!", nursery.current, size);
   fflush (stdout);
 #endif
-  if (from_space.current + size < from_space.end) {
-    p = (void*) from_space.current;
-    from_space.current += size;
+  if (size <= NURSERY_LIMIT && nursery.current + size <= nursery.end) {
+    if (gc_sites.old_n > 0 && gc_site_pretenured (size)) return alloc_old (size, hdr);
+    p = (void*) nursery.current;
+    nursery.current += size;
+    if (nursery.current >= gc_sites.sample_at) gc_site_sample (p, hdr);
+    if (nursery.current >= gc_incr_at) gc_step ();
 #ifdef DEBUG_PRINT
     print_indent ();
-    printf (";new current: %p \n", from_space.current); fflush (stdout);
+    printf (";new current: %p \n", nursery.current); fflush (stdout);
     indent--;
 #endif
     return p;
   }
-  
-  init_to_space (0);
 #ifdef DEBUG_PRINT
-  print_indent ();
-  printf ("alloc: call gc: %zu\n", size); fflush (stdout);
-  printFromSpace(); fflush (stdout);
-  p = gc (size);
-  print_indent ();
-  printf("alloc: gc END %p %p %p %p\n\n", from_space.begin,
-	 from_space.end, from_space.current, p); fflush (stdout);
-  printFromSpace(); fflush (stdout);
+  p = alloc_slow (size, hdr);
   indent--;
   return p;
 #else
-  return gc (size);
+  return alloc_slow (size, hdr);
 #endif
 }
+
+// alloc: allocates `size` bytes in heap
+extern void * alloc (size_t size) {
+  return alloc_words ((size - 1) / sizeof(size_t) + 1, 1); // bytes to words
+}
+
+// alloc for a sexp: it never goes to the large-object space
+extern void * alloc_sexp (size_t size) {
+  return alloc_words ((size - 1) / sizeof(size_t) + 1, 2);
+}
 # endif
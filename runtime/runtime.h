@@ -1,15 +1,35 @@
 #ifndef LVM_RUNTIME_H
 #define LVM_RUNTIME_H
 
-# define WORD_SIZE (CHAR_BIT * sizeof(int))
+#include <stddef.h>
+#include <stdint.h>
+
+/* Machine word holding a Lama value: 32 bits with -m32, 64 bits otherwise */
+typedef intptr_t  aint;
+typedef uintptr_t auint;
+
+/* Heap word: object headers and fields. With LVM_COMPRESSED_REFS a 64-bit
+   build keeps them 32 bits wide: a reference is the low half of the pointer
+   into a 4 GB heap region aligned to 4 GB (see reserve_heap), numbers are
+   31 bits as with -m32. Values outside the heap stay full words. */
+# ifdef LVM_COMPRESSED_REFS
+typedef int32_t   hword;
+typedef uint32_t  uhword;
+extern char *__gc_heap_base;
+# else
+typedef aint      hword;
+typedef auint     uhword;
+# endif
+
+# define WORD_SIZE (CHAR_BIT * sizeof(aint))
 
 typedef struct {
-    int tag;
+    hword tag;
     char contents[0];
 } data;
 
 typedef struct {
-    int tag;
+    hword tag;
     data contents;
 } sexp;
 
@@ -19,38 +39,99 @@ typedef struct {
 # define CLOSURE_TAG 0x00000007
 # define UNBOXED_TAG 0x00000009 // Not actually a tag; used to return from LkindOf
 
-# define LEN(x) ((x & 0xFFFFFFF8) >> 3)
-# define TAG(x)  (x & 0x00000007)
+# define LEN(x) ((((auint) (x)) & ~(auint) 7) >> 3)
+# define TAG(x)  (((auint) (x)) & 0x00000007)
+
+# define TO_DATA(x) ((data*)((char*)(x)-sizeof(hword)))
+# define TO_SEXP(x) ((sexp*)((char*)(x)-2*sizeof(hword)))
+
+# define UNBOXED(x)  (((aint) (x)) &  0x0001)
+# define UNBOX(x)    (((aint) (x)) >> 1)
+# ifdef LVM_COMPRESSED_REFS
+#  define BOX(x)     ((aint) (hword) ((((uhword) (auint) (x)) << 1) | 0x0001))
+# else
+#  define BOX(x)     ((((aint) (x)) << 1) | 0x0001)
+# endif
+
+/* Value <-> heap word */
+# ifdef LVM_COMPRESSED_REFS
+#  define TO_WORD(v)  ((hword) (aint) (v))
+static inline void *FROM_WORD (hword w) {
+  return (w & 1) ? (void*) (aint) w : (void*) (__gc_heap_base + (uhword) w);
+}
+# else
+#  define TO_WORD(v)  ((hword) (v))
+#  define FROM_WORD(w) ((void*) (w))
+# endif
 
-# define TO_DATA(x) ((data*)((char*)(x)-sizeof(int)))
-# define TO_SEXP(x) ((sexp*)((char*)(x)-2*sizeof(int)))
+# define FIELD(p, i)         FROM_WORD (((hword*) (p))[i])
+# define SET_FIELD(p, i, v)  (((hword*) (p))[i] = TO_WORD (v))
 
-# define UNBOXED(x)  (((int) (x)) &  0x0001)
-# define UNBOX(x)    (((int) (x)) >> 1)
-# define BOX(x)      ((((int) (x)) << 1) | 0x0001)
+/* Write barrier of the generational GC for stores into existing objects
+   (Bsta, captures written back by END): an old object that gets a
+   reference to the nursery is remembered until the next collection.
+   While an incremental major collection replicates the old space, every
+   written old object is also logged (GC_LOG_WRITE, also for the bytes of
+   strings), so that its replica is brought up to date.
+   Objects are filled right after allocation without it */
+extern char  *__gc_nursery_begin;
+extern size_t __gc_nursery_bytes;
+extern int    __gc_replicating;
+void gc_remember  (void *obj);
+void gc_log_write (void *obj);
+
+# define IS_YOUNG(p) ((size_t) ((char*) (p) - __gc_nursery_begin) < __gc_nursery_bytes)
+# define GC_LOG_WRITE(obj) \
+  do { if (__gc_replicating) gc_log_write (obj); } while (0)
+# define GC_WRITE_BARRIER(obj, v) \
+  do { if (IS_YOUNG (v) && !IS_YOUNG (obj)) gc_remember (obj); GC_LOG_WRITE (obj); } while (0)
+
+/* Stack roots: a collection calls gc_root_scan_stack, which passes every
+   root slot to gc_test_and_copy_root. A VM that knows its frame layout
+   replaces the conservative default with a precise scanner */
+extern void (*gc_root_scan_stack) (void);
+void gc_test_and_copy_root (size_t **root);
+
+/* Allocation sites (pretenuring, see gc_sites_init): before an allocating
+   instruction calls the runtime, the VM stores its address in the bytecode
+   given to gc_sites_init */
+extern const char *__gc_alloc_site;
+void gc_sites_init (const char *code, size_t size);
+
+/* Allocation sites for the heap profiler (LVM_HEAP_PROFILE): `survived`
+   objects of the site, `survived_bytes` in all, were still alive when a
+   collection emptied the nursery or, for those allocated in the old or the
+   large-object space, at the next major collection. offset is SIZE_MAX for
+   the allocations outside of the bytecode */
+typedef struct {
+  size_t offset;
+  size_t objects, bytes;
+  size_t survived, survived_bytes;
+} gc_site_stats;
 
+gc_site_stats * gc_sites_profile (size_t *n);
 
-int LtagHash (char *s);
-void* LmakeArray (int length);
-void* LmakeSexp (int bn, int btag);
-void* LMakeClosure (int bn, void *entry);
+aint LtagHash (char *s);
+void* LmakeArray (aint length);
+void* LmakeSexp (aint bn, aint btag);
+void* LMakeClosure (aint bn, void *entry);
 void* Bstring (void *p);
 void* Bstringval (void *p);
-int Btag (void *d, int t, int n);
-int Barray_patt (void *d, int n);
-int Bstring_patt (void *x, void *y);
-int Bclosure_tag_patt (void *x);
-int Bboxed_patt (void *x);
-int Bunboxed_patt (void *x);
-int Barray_tag_patt (void *x);
-int Bstring_tag_patt (void *x);
-int Bsexp_tag_patt (void *x);
-void* Bsta (void *v, int i, void *x);
-void Bmatch_failure (void *v, char *fname, int line, int col);
-int Lread ();
-int Lwrite (int n);
-void* Belem (void *p, int i);
-int Blength (void *p);
+aint Btag (void *d, aint t, aint n);
+aint Barray_patt (void *d, aint n);
+aint Bstring_patt (void *x, void *y);
+aint Bclosure_tag_patt (void *x);
+aint Bboxed_patt (void *x);
+aint Bunboxed_patt (void *x);
+aint Barray_tag_patt (void *x);
+aint Bstring_tag_patt (void *x);
+aint Bsexp_tag_patt (void *x);
+void* Bsta (void *v, aint i, void *x);
+void Bmatch_failure (void *v, char *fname, aint line, aint col);
+aint Lread ();
+aint Lwrite (aint n);
+void* Belem (void *p, aint i);
+aint Blength (void *p);
 void printValue (void *p);
 
 #endif //LVM_RUNTIME_H
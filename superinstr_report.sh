@@ -0,0 +1,56 @@
+#!/usr/bin/env bash
+
+# Отчёт о суперинструкциях: сколько диспатчей экономят слитые обработчики
+# (tools/superinstr.def) на каждом бенчмарке. Собирает отдельный lvm с
+# -DLVM_DISPATCH_STATS=ON; он печатает в stderr строку
+#   dispatch stats: N dispatches, S saved by superinstructions (P% of N+S)
+
+set -o pipefail
+
+PROJECT_DIR="$(pwd)"
+LAMAC="${LAMAC:-$PROJECT_DIR/Lama/src/lamac}"
+CORPUS="${CORPUS:-performance regression}"
+STATS_BUILD_DIR="${STATS_BUILD_DIR:-build-stats}"
+LVM_STATS="$PROJECT_DIR/$STATS_BUILD_DIR/lvm"
+
+echo "=== Building lvm with dispatch statistics ==="
+cmake -S . -B "$STATS_BUILD_DIR" -DCMAKE_BUILD_TYPE=Release -DLVM_DISPATCH_STATS=ON > /dev/null || exit 1
+cmake --build "$STATS_BUILD_DIR" -j > /dev/null || exit 1
+echo ""
+
+if [ -x "$LAMAC" ] && [ ! -f performance/Sort.bc ]; then
+    (cd performance && "$LAMAC" -b Sort.lama)
+fi
+
+printf "%-24s %14s %14s %14s %8s\n" "benchmark" "without super" "with super" "saved" "saved%"
+
+TOTAL_DISPATCH=0
+TOTAL_SAVED=0
+for DIR in $CORPUS; do
+    for BC_FILE in "$DIR"/*.bc; do
+        [ -f "$BC_FILE" ] || continue
+        STEM="$(basename "${BC_FILE%.bc}")"
+        INPUT="${BC_FILE%.bc}.input"
+        [ -f "$INPUT" ] || INPUT=/dev/null
+
+        STATS=$("$LVM_STATS" "$BC_FILE" < "$INPUT" 2>&1 > /dev/null | grep "^dispatch stats:")
+        if [ -z "$STATS" ]; then
+            printf "%-24s %s\n" "$STEM" "(no stats: program did not reach HALT)"
+            continue
+        fi
+
+        N=$(echo "$STATS" | awk '{print $3}')
+        S=$(echo "$STATS" | awk '{print $5}')
+        TOTAL_DISPATCH=$((TOTAL_DISPATCH + N))
+        TOTAL_SAVED=$((TOTAL_SAVED + S))
+        printf "%-24s %14d %14d %14d %7.1f%%\n" "$STEM" $((N + S)) "$N" "$S" \
+            "$(awk -v n="$N" -v s="$S" 'BEGIN { print 100 * s / (n + s) }')"
+    done
+done
+
+echo ""
+if [ $((TOTAL_DISPATCH + TOTAL_SAVED)) -gt 0 ]; then
+    printf "%-24s %14d %14d %14d %7.1f%%\n" "total" $((TOTAL_DISPATCH + TOTAL_SAVED)) \
+        "$TOTAL_DISPATCH" "$TOTAL_SAVED" \
+        "$(awk -v n="$TOTAL_DISPATCH" -v s="$TOTAL_SAVED" 'BEGIN { print 100 * s / (n + s) }')"
+fi
@@ -106,6 +106,79 @@ typedef enum {
     OP_N
 } BinOp;
 
+/* Full instruction bytes: (prefix << 4) | sub-operation */
+#define OPCODE(h, l) (((h) << 4) | (l))
+
+typedef enum {
+    BC_ADD      = OPCODE(OP_BINOP, OP_ADD),
+    BC_SUB      = OPCODE(OP_BINOP, OP_SUB),
+    BC_MUL      = OPCODE(OP_BINOP, OP_MUL),
+    BC_DIV      = OPCODE(OP_BINOP, OP_DIV),
+    BC_MOD      = OPCODE(OP_BINOP, OP_MOD),
+    BC_LT       = OPCODE(OP_BINOP, OP_LT),
+    BC_LE       = OPCODE(OP_BINOP, OP_LE),
+    BC_GT       = OPCODE(OP_BINOP, OP_GT),
+    BC_GE       = OPCODE(OP_BINOP, OP_GE),
+    BC_EQ       = OPCODE(OP_BINOP, OP_EQ),
+    BC_NEQ      = OPCODE(OP_BINOP, OP_NEQ),
+    BC_AND      = OPCODE(OP_BINOP, OP_AND),
+    BC_OR       = OPCODE(OP_BINOP, OP_OR),
+
+    BC_CONST    = OPCODE(OP_PRIMARY, PRIMARY_CONST),
+    BC_STRING   = OPCODE(OP_PRIMARY, PRIMARY_STRING),
+    BC_SEXP     = OPCODE(OP_PRIMARY, PRIMARY_SEXP),
+    BC_STI      = OPCODE(OP_PRIMARY, PRIMARY_STI),
+    BC_STA      = OPCODE(OP_PRIMARY, PRIMARY_STA),
+    BC_JMP      = OPCODE(OP_PRIMARY, PRIMARY_JMP),
+    BC_END      = OPCODE(OP_PRIMARY, PRIMARY_END),
+    BC_RET      = OPCODE(OP_PRIMARY, PRIMARY_RET),
+    BC_DROP     = OPCODE(OP_PRIMARY, PRIMARY_DROP),
+    BC_DUP      = OPCODE(OP_PRIMARY, PRIMARY_DUP),
+    BC_SWAP     = OPCODE(OP_PRIMARY, PRIMARY_SWAP),
+    BC_ELEM     = OPCODE(OP_PRIMARY, PRIMARY_ELEM),
+
+    BC_LD_G     = OPCODE(OP_LD, LOC_G),
+    BC_LD_L     = OPCODE(OP_LD, LOC_L),
+    BC_LD_A     = OPCODE(OP_LD, LOC_A),
+    BC_LD_C     = OPCODE(OP_LD, LOC_C),
+    BC_LDA_G    = OPCODE(OP_LDA, LOC_G),
+    BC_LDA_L    = OPCODE(OP_LDA, LOC_L),
+    BC_LDA_A    = OPCODE(OP_LDA, LOC_A),
+    BC_LDA_C    = OPCODE(OP_LDA, LOC_C),
+    BC_ST_G     = OPCODE(OP_ST, LOC_G),
+    BC_ST_L     = OPCODE(OP_ST, LOC_L),
+    BC_ST_A     = OPCODE(OP_ST, LOC_A),
+    BC_ST_C     = OPCODE(OP_ST, LOC_C),
+
+    BC_CJMPz    = OPCODE(OP_CTRL, CTRL_CJMPz),
+    BC_CJMPnz   = OPCODE(OP_CTRL, CTRL_CJMPnz),
+    BC_BEGIN    = OPCODE(OP_CTRL, CTRL_BEGIN),
+    BC_CBEGIN   = OPCODE(OP_CTRL, CTRL_CBEGIN),
+    BC_CLOSURE  = OPCODE(OP_CTRL, CTRL_CLOSURE),
+    BC_CALLC    = OPCODE(OP_CTRL, CTRL_CALLC),
+    BC_CALL     = OPCODE(OP_CTRL, CTRL_CALL),
+    BC_TAG      = OPCODE(OP_CTRL, CTRL_TAG),
+    BC_ARRAY    = OPCODE(OP_CTRL, CTRL_ARRAY),
+    BC_FAIL     = OPCODE(OP_CTRL, CTRL_FAIL),
+    BC_LINE     = OPCODE(OP_CTRL, CTRL_LINE),
+
+    BC_PATT_STR    = OPCODE(OP_PATT, PATT_STR),
+    BC_PATT_STRING = OPCODE(OP_PATT, PATT_STRING_TAG),
+    BC_PATT_ARRAY  = OPCODE(OP_PATT, PATT_ARRAY_TAG),
+    BC_PATT_SEXP   = OPCODE(OP_PATT, PATT_SEXP_TAG),
+    BC_PATT_REF    = OPCODE(OP_PATT, PATT_REF),
+    BC_PATT_VAL    = OPCODE(OP_PATT, PATT_VAL),
+    BC_PATT_FUN    = OPCODE(OP_PATT, PATT_FUN),
+
+    BC_READ     = OPCODE(OP_BUILTIN, BUILTIN_READ),
+    BC_WRITE    = OPCODE(OP_BUILTIN, BUILTIN_WRITE),
+    BC_LENGTH   = OPCODE(OP_BUILTIN, BUILTIN_LENGTH),
+    BC_STRINGV  = OPCODE(OP_BUILTIN, BUILTIN_STRING),
+    BC_BARRAY   = OPCODE(OP_BUILTIN, BUILTIN_ARRAY),
+
+    BC_HALT     = OPCODE(OP_HALT, 0)   /* любой байт 0xF? */
+} Bytecode;
+
 /* Other useful constants */
 #define MAX_STACK_DEPTH 10000
 #define MAX_GLOBALS 10000
@@ -0,0 +1,297 @@
+#include "heapprof.h"
+#include "quicken.h"
+#include "runtime.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Место выделения - инструкция STRING, SEXP, CLOSURE, BARRAY или STRINGV
+ * (см. vmalloc в lvm_loop.inc). Функция места - последний BEGIN/CBEGIN
+ * перед ним, строка - последний LINE после этого BEGIN: компилятор
+ * ставит LINE перед кодом каждой строки, так что по порядку в байткоде
+ * этого достаточно. Имена есть только у публичных функций, остальные
+ * называются по смещению BEGIN.
+ *
+ * "Пережившие" - объекты, которые были живы, когда сборка освобождала
+ * молодое поколение (их скопировали в старое). Объекты, выделенные сразу
+ * в старом поколении (большие, без молодого поколения), только считаются.
+ *
+ * pprof: четыре значения на место (alloc_objects, alloc_space,
+ * survived_objects, survived_space), у каждого места одна Location с
+ * адресом-смещением и строкой в своей функции. Стека вызовов нет.
+ */
+
+#define NO_FUNCTION UINT32_MAX
+
+typedef struct {
+    uint32_t *fn;           // смещение -> смещение BEGIN функции или NO_FUNCTION
+    uint32_t *line;         // смещение -> строка исходника, 0 - неизвестна
+    uint32_t size;
+} SiteMap;
+
+typedef struct {
+    gc_site_stats *s;
+    size_t n;
+    SiteMap map;
+} Profile;
+
+static void *xalloc(size_t n) {
+    void *p = calloc(n ? n : 1, 1);
+    if (!p) {
+        fprintf(stderr, "*** FAILURE: unable to allocate memory for the heap profile\n");
+        exit(255);
+    }
+    return p;
+}
+
+static uint32_t read_u32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static void sitemap_build(SiteMap *m, const bytefile *bf, uint32_t code_size) {
+    const uint8_t *bc = (const uint8_t *) bf->code_ptr;
+    uint32_t fn = NO_FUNCTION, line = 0;
+
+    m->size = code_size;
+    m->fn = xalloc(code_size * sizeof(uint32_t));
+    m->line = xalloc(code_size * sizeof(uint32_t));
+    for (uint32_t pos = 0; pos < code_size; pos++) m->fn[pos] = NO_FUNCTION;
+
+    for (uint32_t pos = 0; pos < code_size; ) {
+        uint32_t len = bc_instr_length(bc, pos, code_size);
+        if (len == 0) break;
+        if (bc[pos] == BC_BEGIN || bc[pos] == BC_CBEGIN) {
+            fn = pos;
+            line = 0;
+        }
+        if (bc[pos] == BC_LINE) line = read_u32(bc + pos + 1);
+        m->fn[pos] = fn;
+        m->line[pos] = line;
+        pos += len;
+    }
+}
+
+static void profile_load(Profile *p, const bytefile *bf, uint32_t code_size) {
+    p->s = gc_sites_profile(&p->n);
+    sitemap_build(&p->map, bf, code_size);
+}
+
+static void profile_free(Profile *p) {
+    free(p->s);
+    free(p->map.fn);
+    free(p->map.line);
+}
+
+static uint32_t site_fn(const Profile *p, const gc_site_stats *s) {
+    return s->offset < p->map.size ? p->map.fn[s->offset] : NO_FUNCTION;
+}
+
+static uint32_t site_line(const Profile *p, const gc_site_stats *s) {
+    return s->offset < p->map.size ? p->map.line[s->offset] : 0;
+}
+
+// Имя функции по смещению ее BEGIN: публичное или fn@смещение; вне
+// функций байткод не выделяет память, это runtime
+static const char *fn_name(const bytefile *bf, uint32_t fn, char *buf, size_t n) {
+    if (fn == NO_FUNCTION) return "runtime";
+    for (int i = 0; i < bf->public_symbols_number; i++) {
+        int name = bf->public_ptr[2 * i];
+        if ((uint32_t) bf->public_ptr[2 * i + 1] == fn && name >= 0 && name < bf->stringtab_size)
+            return bf->string_ptr + name;
+    }
+    snprintf(buf, n, "fn@0x%x", fn);
+    return buf;
+}
+
+static int cmp_bytes(const void *a, const void *b) {
+    const gc_site_stats *x = a, *y = b;
+    return (x->bytes < y->bytes) - (x->bytes > y->bytes);
+}
+
+void heap_profile_report(const bytefile *bf, uint32_t code_size, FILE *out) {
+    Profile p;
+    size_t objects = 0, bytes = 0, survived = 0, sites = 0;
+
+    profile_load(&p, bf, code_size);
+    qsort(p.s, p.n, sizeof(gc_site_stats), cmp_bytes);
+    for (size_t i = 0; i < p.n; i++) {
+        objects += p.s[i].objects;
+        bytes += p.s[i].bytes;
+        survived += p.s[i].survived_bytes;
+        sites += p.s[i].objects > 0;
+    }
+
+    fprintf(out, "heap profile: %zu objects, %zu KB allocated at %zu sites, %zu KB survived a collection\n",
+            objects, bytes / 1024, sites, survived / 1024);
+    fprintf(out, "%12s %10s %12s %9s %10s  %s\n",
+            "bytes", "objects", "survived", "survived", "offset", "function:line");
+    for (size_t i = 0; i < p.n; i++) {
+        const gc_site_stats *s = &p.s[i];
+        char off[32], buf[32];
+        if (s->objects == 0) continue;
+        if (s->offset == SIZE_MAX) strcpy(off, "runtime");
+        else snprintf(off, sizeof(off), "0x%zx", s->offset);
+        fprintf(out, "%12zu %10zu %12zu %8.1f%% %10s  %s:%u\n",
+                s->bytes, s->objects, s->survived_bytes,
+                s->bytes ? 100.0 * s->survived_bytes / s->bytes : 0.0, off,
+                fn_name(bf, site_fn(&p, s), buf, sizeof(buf)), site_line(&p, s));
+    }
+
+    profile_free(&p);
+}
+
+/* Кодирование protobuf: только то, что нужно для profile.proto */
+
+typedef struct {
+    uint8_t *p;
+    size_t n, cap;
+} Buf;
+
+static void buf_put(Buf *b, const void *data, size_t n) {
+    if (n == 0) return;
+    if (b->n + n > b->cap) {
+        b->cap = (b->n + n) * 2;
+        b->p = realloc(b->p, b->cap);
+        if (!b->p) {
+            fprintf(stderr, "*** FAILURE: unable to allocate memory for the heap profile\n");
+            exit(255);
+        }
+    }
+    memcpy(b->p + b->n, data, n);
+    b->n += n;
+}
+
+static void put_varint(Buf *b, uint64_t v) {
+    uint8_t x[10];
+    int n = 0;
+    do {
+        x[n++] = (uint8_t) ((v & 0x7f) | (v >= 0x80 ? 0x80 : 0));
+        v >>= 7;
+    } while (v);
+    buf_put(b, x, n);
+}
+
+static void put_uint(Buf *b, int field, uint64_t v) {
+    put_varint(b, (uint64_t) field << 3);           // wire type 0
+    put_varint(b, v);
+}
+
+static void put_bytes(Buf *b, int field, const void *data, size_t n) {
+    put_varint(b, (uint64_t) field << 3 | 2);       // wire type 2
+    put_varint(b, n);
+    buf_put(b, data, n);
+}
+
+// Вложенное сообщение m; m очищается для следующего
+static void put_message(Buf *b, int field, Buf *m) {
+    put_bytes(b, field, m->p, m->n);
+    m->n = 0;
+}
+
+typedef struct {
+    const char **s;
+    size_t n, cap;
+} Strings;
+
+// Индекс строки в string_table (строка 0 - пустая)
+static uint64_t str_index(Strings *t, const char *s) {
+    for (size_t i = 0; i < t->n; i++)
+        if (strcmp(t->s[i], s) == 0) return i;
+    if (t->n == t->cap) {
+        t->cap = t->cap ? t->cap * 2 : 64;
+        t->s = realloc(t->s, t->cap * sizeof(char *));
+        if (!t->s) {
+            fprintf(stderr, "*** FAILURE: unable to allocate memory for the heap profile\n");
+            exit(255);
+        }
+    }
+    t->s[t->n] = strdup(s);
+    return t->n++;
+}
+
+static void put_value_type(Buf *b, int field, Buf *m, Strings *t, const char *type, const char *unit) {
+    put_uint(m, 1, str_index(t, type));
+    put_uint(m, 2, str_index(t, unit));
+    put_message(b, field, m);
+}
+
+bool heap_profile_pprof(const bytefile *bf, uint32_t code_size,
+                        const char *source, const char *path) {
+    Profile p;
+    Buf b = {0}, m = {0}, v = {0};
+    Strings t = {0};
+    uint32_t *fns;
+    size_t n_fns = 0;
+
+    profile_load(&p, bf, code_size);
+    str_index(&t, "");
+
+    // Profile.sample_type
+    put_value_type(&b, 1, &m, &t, "alloc_objects", "count");
+    put_value_type(&b, 1, &m, &t, "alloc_space", "bytes");
+    put_value_type(&b, 1, &m, &t, "survived_objects", "count");
+    put_value_type(&b, 1, &m, &t, "survived_space", "bytes");
+
+    // Profile.sample: Location i + 1 - место i
+    for (size_t i = 0; i < p.n; i++) {
+        const gc_site_stats *s = &p.s[i];
+        if (s->objects == 0) continue;
+        put_varint(&v, i + 1);
+        put_bytes(&m, 1, v.p, v.n);                 // location_id
+        v.n = 0;
+        put_varint(&v, s->objects);
+        put_varint(&v, s->bytes);
+        put_varint(&v, s->survived);
+        put_varint(&v, s->survived_bytes);
+        put_bytes(&m, 2, v.p, v.n);                 // value
+        v.n = 0;
+        put_message(&b, 2, &m);
+    }
+
+    // Profile.location: Line.function_id - номер в fns + 1
+    fns = xalloc((p.n + 1) * sizeof(uint32_t));
+    for (size_t i = 0; i < p.n; i++) {
+        const gc_site_stats *s = &p.s[i];
+        uint32_t fn = site_fn(&p, s);
+        size_t k = 0;
+        if (s->objects == 0) continue;
+        while (k < n_fns && fns[k] != fn) k++;
+        if (k == n_fns) fns[n_fns++] = fn;
+        put_uint(&v, 1, k + 1);                     // Line.function_id
+        put_uint(&v, 2, site_line(&p, s));          // Line.line
+        put_uint(&m, 1, i + 1);                     // id
+        if (s->offset != SIZE_MAX) put_uint(&m, 3, s->offset);
+        put_message(&m, 4, &v);                     // line
+        put_message(&b, 4, &m);
+    }
+
+    // Profile.function
+    for (size_t k = 0; k < n_fns; k++) {
+        char buf[32];
+        const char *name = fn_name(bf, fns[k], buf, sizeof(buf));
+        put_uint(&m, 1, k + 1);
+        put_uint(&m, 2, str_index(&t, name));
+        put_uint(&m, 3, str_index(&t, name));
+        put_uint(&m, 4, str_index(&t, source));
+        put_message(&b, 5, &m);
+    }
+
+    // default_sample_type; string_table - последним, когда все строки известны
+    put_uint(&b, 14, str_index(&t, "alloc_space"));
+    for (size_t i = 0; i < t.n; i++) put_bytes(&b, 6, t.s[i], strlen(t.s[i]));
+
+    FILE *f = fopen(path, "wb");
+    bool ok = f != NULL && fwrite(b.p, 1, b.n, f) == b.n;
+    if (f != NULL && fclose(f) != 0) ok = false;
+
+    for (size_t i = 0; i < t.n; i++) free((char *) t.s[i]);
+    free(t.s);
+    free(fns);
+    free(b.p);
+    free(m.p);
+    free(v.p);
+    profile_free(&p);
+    return ok;
+}
@@ -0,0 +1,27 @@
+#ifndef HEAPPROF_H
+#define HEAPPROF_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "bytecode_defs.h"
+
+/*
+ * Профиль кучи по местам выделения (lvm --heap-profile, см. heapprof.c).
+ *
+ * Счетчики ведет runtime (gc_sites_profile): объекты и байты, выделенные
+ * каждой инструкцией, и сколько из них пережило сборку молодого поколения.
+ * Здесь место - смещение в байткоде - сопоставляется с функцией (ближайший
+ * BEGIN/CBEGIN перед ним) и строкой исходника (ближайший LINE в ней).
+ */
+
+// Отчет в out, места по убыванию выделенных байтов
+void heap_profile_report(const bytefile *bf, uint32_t code_size, FILE *out);
+
+// Тот же профиль в формате pprof (profile.proto, без сжатия); source -
+// имя исходного файла для строк. false, если файл не записан
+bool heap_profile_pprof(const bytefile *bf, uint32_t code_size,
+                        const char *source, const char *path);
+
+#endif
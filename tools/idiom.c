@@ -6,6 +6,7 @@
 #include <stdio.h>
 
 #define HASH_CAPACITY 65536
+#define IDIOM_MAX_INSTRS 3   // пары и тройки инструкций
 #define FNV_OFFSET_BASIS 2166136261U
 #define FNV_PRIME 16777619U
 
@@ -455,27 +456,37 @@ static void walk_callback(uint32_t start_addr, uint8_t opcode, uint32_t end_addr
         }
     }
     
-    // Проверяем, можно ли создать пару инструкций
-    // Не создаем пары если:
+    // Продлеваем последовательность до IDIOM_MAX_INSTRS инструкций.
+    // Не продлеваем если:
     // 1. Это конец кода
     // 2. Следующий адрес - метка перехода
-    // 3. Текущая инструкция терминальная (JMP, END и т.д.)
-    if (end_addr < data->size &&
-        !data->jump_targets[end_addr] &&
-        !should_split_after_opcode(opcode)) {
-        
+    // 3. Последняя инструкция терминальная (JMP, END и т.д.)
+    uint8_t seq_bytes[IDIOM_MAX_INSTRS * 32];
+    uint32_t seq_len = curr_len;
+    uint32_t next_addr = end_addr;
+    uint8_t last_opcode = opcode;
+    memcpy(seq_bytes, curr_param, curr_len);
+
+    for (int n = 2; n <= IDIOM_MAX_INSTRS; n++) {
+        if (curr_len == 0 ||
+            next_addr >= data->size ||
+            data->jump_targets[next_addr] ||
+            should_split_after_opcode(last_opcode)) {
+            break;
+        }
+
         Decoder decoder;
         decoder_init(&decoder, data->bytecode, data->size);
-        decoder_move_to(&decoder, end_addr);
-        
+        decoder_move_to(&decoder, next_addr);
+
         typedef struct {
             uint32_t start_addr;
             uint8_t opcode;
             uint32_t end_addr;
         } NextInstrInfo;
-        
+
         NextInstrInfo next_instr = {0};
-        
+
         void next_callback(const DecodeResult* result, void* userdata) {
             NextInstrInfo* info = (NextInstrInfo*)userdata;
             switch (result->type) {
@@ -490,31 +501,32 @@ static void walk_callback(uint32_t start_addr, uint8_t opcode, uint32_t end_addr
                     break;
             }
         }
-        
-        if (decoder_next(&decoder, next_callback, &next_instr)) {
-            // Проверяем что следующая инструкция существует и не является меткой
-            if (next_instr.start_addr == end_addr &&
-                next_instr.end_addr <= data->size &&
-                !data->jump_targets[next_instr.start_addr]) {
-                
-                // Параметризуем следующую инструкцию
-                uint8_t next_param[32];
-                uint32_t next_len = 0;
-                parametrize_instruction(data->bytecode, next_instr.start_addr,
-                                       next_instr.end_addr, next_param, &next_len);
-                
-                if (curr_len > 0 && next_len > 0) {
-                    uint32_t total_len = curr_len + next_len;
-                    uint8_t* pair_bytes = malloc(total_len);
-                    if (pair_bytes) {
-                        memcpy(pair_bytes, curr_param, curr_len);
-                        memcpy(pair_bytes + curr_len, next_param, next_len);
-                        uint32_t hash = fnv1a_hash(pair_bytes, total_len);
-                        hash_table_insert(data->table, pair_bytes, total_len, hash);
-                    }
-                }
-            }
+
+        if (!decoder_next(&decoder, next_callback, &next_instr) ||
+            next_instr.start_addr != next_addr ||
+            next_instr.end_addr > data->size) {
+            break;
         }
+
+        // Параметризуем следующую инструкцию
+        uint8_t next_param[32];
+        uint32_t next_len = 0;
+        parametrize_instruction(data->bytecode, next_instr.start_addr,
+                               next_instr.end_addr, next_param, &next_len);
+        if (next_len == 0) break;
+
+        memcpy(seq_bytes + seq_len, next_param, next_len);
+        seq_len += next_len;
+
+        uint8_t* idiom_bytes = malloc(seq_len);
+        if (idiom_bytes) {
+            memcpy(idiom_bytes, seq_bytes, seq_len);
+            uint32_t hash = fnv1a_hash(idiom_bytes, seq_len);
+            hash_table_insert(data->table, idiom_bytes, seq_len, hash);
+        }
+
+        next_addr = next_instr.end_addr;
+        last_opcode = next_instr.opcode;
     }
 }
 
@@ -0,0 +1,132 @@
+#include "jit.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+/*
+ * Управление уровнями исполнения: счетчики, политика перехода на машинный
+ * код, поиск функции для OSR и отчет --tier-stats. Машинный код порождает
+ * бэкенд (jit_x86.c).
+ *
+ * Счетчики ведет интерпретатор: вызовы - на BEGIN/CBEGIN (jit_entry, и из
+ * машинного кода через обработчики вызовов), переходы назад - на JMP/CJMPz/
+ * CJMPnz с целью не дальше самого перехода (jit_loop). Функция, у которой
+ * уже есть машинный код, циклы не считает: на каждом переходе назад
+ * интерпретатор сразу входит в него (например, после выхода по медленному
+ * пути).
+ */
+
+static uint32_t policy_value(const char *var, uint32_t def) {
+    const char *s = getenv(var);
+    if (!s || !*s) return def;
+    char *end;
+    unsigned long v = strtoul(s, &end, 10);
+    if (*end != '\0' || v == 0 || v > UINT32_MAX) {
+        fprintf(stderr, "%s=%s: expected a positive number, using %" PRIu32 "\n", var, s, def);
+        return def;
+    }
+    return (uint32_t) v;
+}
+
+Jit *jit_new(QCode *q, JitCallFn call_fn, JitEndFn end_fn) {
+    Jit *jit = calloc(1, sizeof(Jit));
+    if (!jit) return NULL;
+    jit->q = q;
+    jit->call = call_fn;
+    jit->end = end_fn;
+    jit->policy.hot_calls = policy_value("LVM_JIT_HOT_CALLS", JIT_HOT_CALLS);
+    jit->policy.hot_loops = policy_value("LVM_JIT_HOT_LOOPS", JIT_HOT_LOOPS);
+    jit->native = calloc(q->n_code + 1, sizeof(void *));
+    jit->hot = calloc(q->n_code + 1, sizeof(uint32_t));
+    jit->loops = calloc(q->n_code + 1, sizeof(uint32_t));
+    if (!jit->native || !jit->hot || !jit->loops || !jit_backend_init(jit)) {
+        jit_free(jit);
+        return NULL;
+    }
+    return jit;
+}
+
+void jit_free(Jit *jit) {
+    if (!jit) return;
+    jit_backend_free(jit);
+    free(jit->native);
+    free(jit->hot);
+    free(jit->loops);
+    free(jit->funcs);
+    free(jit);
+}
+
+static bool is_begin(int op) {
+    return op == BC_BEGIN || op == BC_CBEGIN;
+}
+
+bool jit_compile(Jit *jit, const Instr *begin, bool by_loop) {
+    const QCode *q = jit->q;
+    uint32_t first = (uint32_t)(begin - q->code) + 1, last = first;
+    while (last < q->n_code && !is_begin(qcode_op(&q->code[last]))) last++;
+    if (jit->native[first]) return true;
+
+    /* Счетчики циклов функции - на момент компиляции */
+    uint32_t loops = 0;
+    for (uint32_t k = first; k < last; k++) loops += jit->loops[k];
+
+    size_t bytes = jit->code_bytes;
+    bool ok = last > first && jit_backend_compile(jit, first, last);
+    if (ok) jit->n_compiled++;
+    else jit->n_failed++;
+
+    if (jit->n_funcs == jit->cap_funcs) {
+        uint32_t cap = jit->cap_funcs ? 2 * jit->cap_funcs : 16;
+        JitFunction *funcs = realloc(jit->funcs, cap * sizeof(JitFunction));
+        if (!funcs) return ok;
+        jit->funcs = funcs;
+        jit->cap_funcs = cap;
+    }
+    jit->funcs[jit->n_funcs++] = (JitFunction){
+        .begin = first - 1, .calls = jit->hot[first - 1], .loops = loops,
+        .by_loop = by_loop, .ok = ok, .code_bytes = jit->code_bytes - bytes,
+    };
+    return ok;
+}
+
+const void *jit_compile_loop(Jit *jit, const Instr *target) {
+    /* Функция цикла - ближайший BEGIN/CBEGIN перед ним */
+    const Instr *begin = target;
+    while (begin > jit->q->code && !is_begin(qcode_op(begin))) begin--;
+    if (!is_begin(qcode_op(begin)) || begin == target) return NULL;
+    if (!jit_compile(jit, begin, true)) return NULL;
+    return jit->native[target - jit->q->code];
+}
+
+void jit_report(const Jit *jit, const char *code, FILE *f) {
+    uint64_t entries = 0;
+    for (int k = 0; k < JIT_ENTER_KINDS; k++) entries += jit->entries[k];
+
+    fprintf(f, "tier stats:\n");
+    fprintf(f, "  policy: compile after %" PRIu32 " calls or %" PRIu32 " back-edges to one target\n",
+            jit->policy.hot_calls, jit->policy.hot_loops);
+    fprintf(f, "  functions: %" PRIu32 " compiled, %" PRIu32 " failed, %zu bytes of code\n",
+            jit->n_compiled, jit->n_failed, jit->code_bytes);
+    fprintf(f, "  interpreter -> native: %" PRIu64 " (%" PRIu64 " at function entry, %" PRIu64
+            " at call return, %" PRIu64 " OSR at loop headers)\n", entries,
+            jit->entries[JIT_ENTER_CALL], jit->entries[JIT_ENTER_RETURN], jit->entries[JIT_ENTER_OSR]);
+
+    if (jit->n_funcs > 0) {
+        fprintf(f, "  %-10s %-8s %12s %12s %10s\n", "function", "reason", "calls", "back-edges", "bytes");
+        for (uint32_t i = 0; i < jit->n_funcs; i++) {
+            const JitFunction *fn = &jit->funcs[i];
+            long offset = (long)(jit->q->code[fn->begin].src - code);
+            fprintf(f, "  0x%08lx %-8s %12" PRIu32 " %12" PRIu32 " %10zu%s\n", offset,
+                    fn->by_loop ? "loop" : "calls", fn->calls, fn->loops, fn->code_bytes,
+                    fn->ok ? "" : "  (failed)");
+        }
+    }
+
+    /* Вызывавшиеся функции, которые остались в интерпретаторе */
+    uint32_t cold = 0;
+    for (uint32_t k = 0; k < jit->q->n_code; k++)
+        if (is_begin(qcode_op(&jit->q->code[k])) && jit->hot[k] > 0 && jit->native[k + 1] == NULL)
+            cold++;
+    fprintf(f, "  functions left in the interpreter: %" PRIu32 "\n", cold);
+}
@@ -0,0 +1,144 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "quicken.h"
+
+/*
+ * Шаблонный JIT для x86 и x86-64 (см. jit_x86.c), только для кода,
+ * прошедшего verify_quickened: шаблоны не проверяют ни стек, ни кадр.
+ *
+ * Уровни исполнения: интерпретатор (--trusted) и машинный код. Функция
+ * (участок от BEGIN/CBEGIN до следующего BEGIN/CBEGIN) компилируется
+ * целиком, когда ее счетчик вызовов или счетчик переходов назад на одну из
+ * ее меток доходит до порога (JitPolicy). Во втором случае интерпретатор
+ * переходит в машинный код прямо посреди цикла (OSR): кадры у обоих уровней
+ * одни и те же, так что перенос кадра - это загрузка sp/base/abase в
+ * регистры машинного кода и переход на метку заголовка цикла. Машинный код работает
+ * с тем же стеком и кадрами, что и интерпретатор; вызовы и возвраты он
+ * выполняет через обработчики интерпретатора (JitCallFn/JitEndFn) и
+ * переходит сразу в машинный код вызываемой функции или точки возврата,
+ * если тот есть. Всё остальное (медленные пути, ошибки, некомпилированный
+ * код) возвращает управление в интерпретатор на нужной инструкции.
+ */
+
+#ifndef JIT_HOT_CALLS
+#define JIT_HOT_CALLS 1000
+#endif
+
+#ifndef JIT_HOT_LOOPS
+#define JIT_HOT_LOOPS 5000
+#endif
+
+struct Jit;
+
+// Регистры цикла интерпретатора на входе в машинный код и выходе из него
+typedef struct {
+    void **sp;          // первый свободный слот стека
+    void **base;        // база кадра
+    void **abase;       // base + n_caps
+    void **globals;     // дно стека: глобальная i - globals[-i]
+    const Instr *pc;    // где продолжать интерпретатору, если обработчик вернул NULL
+    struct Jit *jit;
+    const Instr *gc_at; // последняя выделявшая память инструкция: по ней
+                        // выбирается карта стека верхнего кадра (stackmap.h)
+} JitCtx;
+
+// Вход в машинный код: исполняет его с адреса code и возвращает
+// инструкцию, с которой продолжает интерпретатор (ctx->sp обновлен)
+typedef const Instr *(*JitEnter)(JitCtx *ctx, const void *code);
+
+// Обработчики CALL/CALLC (и хвостовых вариантов) и END над ctx: возвращают
+// точку входа в машинный код, с которой продолжать, или NULL (и ctx->pc)
+typedef const void *(*JitCallFn)(JitCtx *ctx, const Instr *in);
+typedef const void *(*JitEndFn)(JitCtx *ctx);
+
+typedef struct JitChunk JitChunk;
+
+// Пороги перехода на машинный код; переопределяются переменными окружения
+// LVM_JIT_HOT_CALLS и LVM_JIT_HOT_LOOPS
+typedef struct {
+    uint32_t hot_calls;     // вызовов функции
+    uint32_t hot_loops;     // переходов назад на одну метку в интерпретаторе
+} JitPolicy;
+
+// Откуда интерпретатор входит в машинный код
+typedef enum {
+    JIT_ENTER_CALL,         // начало функции
+    JIT_ENTER_RETURN,       // возврат из вызова
+    JIT_ENTER_OSR,          // заголовок цикла
+    JIT_ENTER_KINDS
+} JitEnterKind;
+
+// Скомпилированная (или не скомпилированная) функция для --tier-stats
+typedef struct {
+    uint32_t begin;         // индекс BEGIN/CBEGIN
+    uint32_t calls, loops;  // счетчики на момент компиляции
+    bool by_loop;           // компиляцию вызвал цикл, а не вызовы
+    bool ok;
+    size_t code_bytes;
+} JitFunction;
+
+typedef struct Jit {
+    QCode *q;
+    const void **native;    // по индексу инструкции: точка входа в машинный код или NULL
+    uint32_t *hot;          // по индексу BEGIN/CBEGIN: число вызовов
+    uint32_t *loops;        // по индексу цели: число переходов назад в интерпретаторе
+    JitPolicy policy;
+    JitEnter enter;
+    JitCallFn call;
+    JitEndFn end;
+    JitChunk *chunks;       // исполняемая память
+    JitFunction *funcs;
+    uint32_t n_funcs, cap_funcs;
+    uint32_t n_compiled, n_failed;
+    size_t code_bytes;
+    uint64_t entries[JIT_ENTER_KINDS];
+} Jit;
+
+// NULL, если платформа не поддерживается
+Jit *jit_new(QCode *q, JitCallFn call, JitEndFn end);
+void jit_free(Jit *jit);
+
+// Компиляция функции, начинающейся с BEGIN/CBEGIN begin; false - не удалось
+// (функция остается в интерпретаторе)
+bool jit_compile(Jit *jit, const Instr *begin, bool by_loop);
+
+// Горячий цикл с заголовком target: компиляция содержащей его функции и
+// точка входа в машинный код на target (NULL - остаться в интерпретаторе)
+const void *jit_compile_loop(Jit *jit, const Instr *target);
+
+// Отчет --tier-stats; code - начало байткода (для смещений функций)
+void jit_report(const Jit *jit, const char *code, FILE *f);
+
+// Вход в функцию begin: счетчик вызовов, компиляция на пороге и точка
+// входа в ее машинный код (NULL - исполнять в интерпретаторе)
+static inline const void *jit_entry(Jit *jit, const Instr *begin) {
+    uint32_t k = (uint32_t)(begin - jit->q->code);
+    const void *code = jit->native[k + 1];
+    if (++jit->hot[k] == jit->policy.hot_calls && code == NULL && jit_compile(jit, begin, false))
+        code = jit->native[k + 1];
+    return code;
+}
+
+// Переход назад на target в интерпретаторе: счетчик цикла и точка входа
+// в машинный код (OSR), если функция уже скомпилирована или стала горячей
+static inline const void *jit_loop(Jit *jit, const Instr *target) {
+    uint32_t k = (uint32_t)(target - jit->q->code);
+    const void *code = jit->native[k];
+    if (code == NULL && ++jit->loops[k] == jit->policy.hot_loops)
+        code = jit_compile_loop(jit, target);
+    return code;
+}
+
+// Бэкенд (jit_x86.c): заглушка входа, освобождение памяти и машинный код
+// инструкций [first, last) с точками входа в jit->native
+bool jit_backend_init(Jit *jit);
+void jit_backend_free(Jit *jit);
+bool jit_backend_compile(Jit *jit, uint32_t first, uint32_t last);
+
+#endif
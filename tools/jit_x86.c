@@ -0,0 +1,856 @@
+#include "jit.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stddef.h>
+
+/*
+ * Шаблонный JIT для x86 (i386) и x86-64.
+ *
+ * Каждая инструкция функции разворачивается в свой шаблон машинного кода
+ * с подставленными операндами (смещения слотов, константы, адреса Instr и
+ * функций runtime.c), шаблоны сшиваются в порядке инструкций, переходы
+ * внутри функции становятся прямыми jmp/jcc. Регистры:
+ *
+ *               x86-64  i386
+ *     ctx       rbx     ebx     JitCtx (см. jit.h)
+ *     sp        rbp     ebp     первый свободный слот стека
+ *     base      r14     esi     база кадра
+ *     abase     r15     edi     base + n_caps
+ *
+ * Все они сохраняются вызываемой функцией в обоих ABI, так что вызовы
+ * runtime их не портят. Глобальные переменные адресуются от ctx->globals.
+ *
+ * Внутри линейного участка sp не двигается на каждой инструкции: положенные
+ * и снятые слоты учитываются при компиляции (Emit.d), и sp сдвигается
+ * один раз перед метками, переходами, вызовами и выходами.
+ *
+ * Выход в интерпретатор - возврат из JitEnter с инструкцией, с которой
+ * продолжать: так делают медленные пути (деление на ноль, CJMP по
+ * не-числу - интерпретатор сам выдаст ошибку), FAIL/HALT и прочие редкие
+ * инструкции. CALL/CALLC/END вызывают обработчики интерпретатора и
+ * продолжают в машинном коде, если он есть у точки назначения.
+ */
+
+#if defined(__x86_64__)
+#define JIT_X64 1
+#elif defined(__i386__)
+#define JIT_X64 0
+#endif
+
+#ifdef JIT_X64
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "runtime.h"
+
+extern size_t __gc_stack_top;
+
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+#define R_CTX   RBX
+#define R_SP    RBP
+#if JIT_X64
+#define R_BASE  R14
+#define R_ABASE R15
+#define FRAME   8       // выравнивание rsp до 16 после четырех push
+#else
+#define R_BASE  RSI
+#define R_ABASE RDI
+#define FRAME   28      // выравнивание + 16 байт под аргументы вызовов
+#endif
+
+#define W ((int32_t) sizeof(void *))
+
+// Условия jcc/setcc
+enum { CC_E = 0x4, CC_NE = 0x5, CC_NS = 0x9, CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF };
+
+struct JitChunk {
+    JitChunk *next;
+    void *mem;
+    size_t size;
+};
+
+typedef struct {
+    size_t at;      // позиция rel32
+    int label;
+} Fixup;
+
+typedef struct {
+    int label;
+    int d;              // Emit.d в точке выхода
+    const Instr *in;    // где продолжит интерпретатор
+} Stub;
+
+typedef struct {
+    uint8_t *code;
+    size_t len, cap;
+    int32_t *labels;    // смещение метки в code, -1 - не привязана
+    int n_labels, cap_labels;
+    Fixup *fix;
+    int n_fix, cap_fix;
+    Stub *stubs;
+    int n_stubs, cap_stubs;
+    int d;              // слотов, положенных после последнего сдвига sp
+    bool oom;
+} Emit;
+
+static bool reserve(Emit *e, void **p, int *cap, int n, size_t size) {
+    if (n < *cap) return true;
+    int ncap = *cap ? *cap * 2 : 64;
+    void *np = realloc(*p, ncap * size);
+    if (!np) {
+        e->oom = true;
+        return false;
+    }
+    *p = np;
+    *cap = ncap;
+    return true;
+}
+
+static void put(Emit *e, uint8_t x) {
+    if (e->len == e->cap) {
+        size_t ncap = e->cap ? e->cap * 2 : 4096;
+        uint8_t *np = realloc(e->code, ncap);
+        if (!np) {
+            e->oom = true;
+            e->len = 0;
+        } else {
+            e->code = np;
+            e->cap = ncap;
+        }
+    }
+    if (e->cap) e->code[e->len++] = x;
+}
+
+static void put32(Emit *e, int32_t v) {
+    for (int i = 0; i < 4; i++) put(e, (uint8_t)((uint32_t) v >> (8 * i)));
+}
+
+static int new_label(Emit *e) {
+    if (!reserve(e, (void **) &e->labels, &e->cap_labels, e->n_labels, sizeof(int32_t)))
+        return 0;
+    e->labels[e->n_labels] = -1;
+    return e->n_labels++;
+}
+
+static void bind(Emit *e, int label) {
+    e->labels[label] = (int32_t) e->len;
+}
+
+static void put_rel(Emit *e, int label) {
+    if (reserve(e, (void **) &e->fix, &e->cap_fix, e->n_fix, sizeof(Fixup)))
+        e->fix[e->n_fix++] = (Fixup){e->len, label};
+    put32(e, 0);
+}
+
+/* Кодирование: w - операция над словом (REX.W на x86-64), reg - поле reg
+   ModRM (регистр или расширение опкода), opcode - один или два байта */
+
+static void rex(Emit *e, bool w, int reg, int index, int base) {
+#if JIT_X64
+    uint8_t r = 0x40 | (w ? 8 : 0) | (reg >> 3) << 2 | (index >> 3) << 1 | (base >> 3);
+    if (r != 0x40) put(e, r);
+#else
+    (void) e; (void) w; (void) reg; (void) index; (void) base;
+#endif
+}
+
+static void opcode(Emit *e, unsigned op) {
+    if (op > 0xFF) put(e, op >> 8);
+    put(e, op & 0xFF);
+}
+
+// op reg, [base + disp]
+static void op_mem(Emit *e, bool w, unsigned op, int reg, int base, int32_t disp) {
+    rex(e, w, reg, 0, base);
+    opcode(e, op);
+    int mod = (disp == 0 && (base & 7) != RBP) ? 0 : (disp >= -128 && disp <= 127) ? 1 : 2;
+    put(e, mod << 6 | (reg & 7) << 3 | (base & 7));
+    if ((base & 7) == RSP) put(e, 0x24);
+    if (mod == 1) put(e, (uint8_t) disp);
+    else if (mod == 2) put32(e, disp);
+}
+
+// op reg, rm (оба - регистры)
+static void op_reg(Emit *e, bool w, unsigned op, int reg, int rm) {
+    rex(e, w, reg, 0, rm);
+    opcode(e, op);
+    put(e, 0xC0 | (reg & 7) << 3 | (rm & 7));
+}
+
+static void load(Emit *e, int reg, int base, int32_t disp) {
+    op_mem(e, true, 0x8B, reg, base, disp);
+}
+
+static void store(Emit *e, int base, int32_t disp, int reg) {
+    op_mem(e, true, 0x89, reg, base, disp);
+}
+
+// Поле i объекта по адресу base: слово кучи (hword), 32 бита со сжатыми ссылками
+static void store_field(Emit *e, int base, int i, int reg) {
+    op_mem(e, sizeof(hword) == 8, 0x89, reg, base, i * (int32_t) sizeof(hword));
+}
+
+static void mov_imm(Emit *e, int reg, intptr_t v) {
+#if JIT_X64
+    if (v == (int32_t) v) {
+        op_reg(e, true, 0xC7, 0, reg);
+        put32(e, (int32_t) v);
+        return;
+    }
+    rex(e, true, 0, 0, reg);
+    put(e, 0xB8 + (reg & 7));
+    for (int i = 0; i < 8; i++) put(e, (uint8_t)((uint64_t) v >> (8 * i)));
+#else
+    put(e, 0xB8 + reg);
+    put32(e, (int32_t) v);
+#endif
+}
+
+static void store_imm(Emit *e, int base, int32_t disp, intptr_t v) {
+    if (v == (int32_t) v) {
+        op_mem(e, true, 0xC7, 0, base, disp);
+        put32(e, (int32_t) v);
+    } else {
+        mov_imm(e, RAX, v);
+        store(e, base, disp, RAX);
+    }
+}
+
+static void add_imm(Emit *e, int reg, int32_t v) {
+    if (v >= -128 && v <= 127) {
+        op_reg(e, true, 0x83, 0, reg);
+        put(e, (uint8_t) v);
+    } else {
+        op_reg(e, true, 0x81, 0, reg);
+        put32(e, v);
+    }
+}
+
+static void jmp(Emit *e, int label) {
+    put(e, 0xE9);
+    put_rel(e, label);
+}
+
+static void jcc(Emit *e, int cc, int label) {
+    put(e, 0x0F);
+    put(e, 0x80 | cc);
+    put_rel(e, label);
+}
+
+static void push_reg(Emit *e, int reg) {
+    rex(e, false, 0, 0, reg);
+    put(e, 0x50 + (reg & 7));
+}
+
+static void pop_reg(Emit *e, int reg) {
+    rex(e, false, 0, 0, reg);
+    put(e, 0x58 + (reg & 7));
+}
+
+/* Стек операндов: sp[k] при e->d отложенных слотах */
+#define SP(k)   ((int32_t)((k) - e->d) * W)
+
+// Сдвиг sp на отложенные слоты
+static void flush(Emit *e) {
+    if (e->d == 0) return;
+    add_imm(e, R_SP, -e->d * W);
+    e->d = 0;
+}
+
+static void reload(Emit *e) {
+    load(e, R_SP, R_CTX, offsetof(JitCtx, sp));
+    load(e, R_BASE, R_CTX, offsetof(JitCtx, base));
+    load(e, R_ABASE, R_CTX, offsetof(JitCtx, abase));
+}
+
+/* Вызовы: x86-64 - аргументы в rdi, rsi, rdx, rcx; i386 - в [esp + 4i]
+   (место под них оставлено в кадре, см. FRAME). Перед вызовом runtime sp
+   сдвигается и записывается в __gc_stack_top, как savestack(). */
+
+#if JIT_X64
+static const int arg_regs[] = {RDI, RSI, RDX, RCX};
+#endif
+
+static void begin_call(Emit *e) {
+    flush(e);
+    mov_imm(e, RAX, (intptr_t) &__gc_stack_top);
+    store(e, RAX, 0, R_SP);
+}
+
+// Перед вызовом runtime, в котором может пройти сборка: ctx->gc_at = in и
+// место выделения для претенуринга (__gc_alloc_site)
+static void gc_point(Emit *e, const Instr *in) {
+    mov_imm(e, RAX, (intptr_t) in);
+    store(e, R_CTX, offsetof(JitCtx, gc_at), RAX);
+    mov_imm(e, RCX, (intptr_t) &__gc_alloc_site);
+    mov_imm(e, RAX, (intptr_t) in->src);
+    store(e, RCX, 0, RAX);
+}
+
+static void arg_word(Emit *e, int i, int base, int32_t disp) {
+#if JIT_X64
+    load(e, arg_regs[i], base, disp);
+#else
+    load(e, RAX, base, disp);
+    store(e, RSP, 4 * i, RAX);
+#endif
+}
+
+static void arg_imm(Emit *e, int i, intptr_t v) {
+#if JIT_X64
+    mov_imm(e, arg_regs[i], v);
+#else
+    store_imm(e, RSP, 4 * i, v);
+#endif
+}
+
+static void arg_ctx(Emit *e, int i) {
+#if JIT_X64
+    op_reg(e, true, 0x89, R_CTX, arg_regs[i]);
+#else
+    store(e, RSP, 4 * i, R_CTX);
+#endif
+}
+
+static void call(Emit *e, const void *fn) {
+    mov_imm(e, RAX, (intptr_t) fn);
+    op_reg(e, false, 0xFF, 2, RAX);     // call rax
+}
+
+/* Выходы в интерпретатор */
+
+typedef struct {
+    int epilogue;   // rax = инструкция, sp в rbp
+    int exit_pc;    // rax = ctx->pc
+} Exits;
+
+static void exit_at(Emit *e, const Exits *x, const Instr *in) {
+    flush(e);
+    mov_imm(e, RAX, (intptr_t) in);
+    jmp(e, x->epilogue);
+}
+
+// Метка выхода вне основного кода: с текущим e->d, продолжение с in
+static int stub(Emit *e, const Instr *in) {
+    int label = new_label(e);
+    if (reserve(e, (void **) &e->stubs, &e->cap_stubs, e->n_stubs, sizeof(Stub)))
+        e->stubs[e->n_stubs++] = (Stub){label, e->d, in};
+    return label;
+}
+
+static void epilogue(Emit *e, const Exits *x) {
+    bind(e, x->exit_pc);
+    load(e, RAX, R_CTX, offsetof(JitCtx, pc));
+    bind(e, x->epilogue);
+    store(e, R_CTX, offsetof(JitCtx, sp), R_SP);
+    add_imm(e, RSP, FRAME);
+    pop_reg(e, R_ABASE);
+    pop_reg(e, R_BASE);
+    pop_reg(e, R_SP);
+    pop_reg(e, R_CTX);
+    put(e, 0xC3);                       // ret
+}
+
+// Продолжение по точке входа, которую вернул обработчик (rax), или выход
+static void dispatch_result(Emit *e, const Exits *x) {
+    reload(e);
+    op_reg(e, true, 0x85, RAX, RAX);    // test rax, rax
+    jcc(e, CC_E, x->exit_pc);
+    op_reg(e, false, 0xFF, 4, RAX);     // jmp rax
+}
+
+/* Шаблоны */
+
+static intptr_t box(intptr_t n) {
+#ifdef LVM_COMPRESSED_REFS
+    return (int32_t)((uint32_t) n << 1 | 1);    // числа в куче - 31 бит
+#else
+    return (intptr_t)((uintptr_t) n << 1) | 1;
+#endif
+}
+
+// Адрес слота переменной: base + disp
+static void slot(Emit *e, int loc, int off, int *base, int32_t *disp, int tmp) {
+    switch (loc) {
+        case LOC_G:
+            load(e, tmp, R_CTX, offsetof(JitCtx, globals));
+            *base = tmp;
+            *disp = -off * W;
+            break;
+        case LOC_L:
+            *base = R_BASE;
+            *disp = off * W;
+            break;
+        default:    // LOC_A, LOC_C
+            *base = R_ABASE;
+            *disp = off * W;
+            break;
+    }
+}
+
+static void push_reg_value(Emit *e, int reg) {
+    store(e, R_SP, SP(0), reg);
+    e->d++;
+}
+
+// reg = sp[k], распакованное, если это число (как step_binop)
+static void load_operand(Emit *e, int reg, int k) {
+    load(e, reg, R_SP, SP(k));
+    op_reg(e, false, 0xF7, 0, reg);     // test reg, 1
+    put32(e, 1);
+    put(e, 0x74);                       // jz +2 (+3 с REX.W)
+    put(e, JIT_X64 ? 3 : 2);
+    op_reg(e, true, 0xD1, 7, reg);      // sar reg, 1
+}
+
+// sp[k] = BOX(rax)
+static void store_boxed(Emit *e, int k) {
+    rex(e, true, RAX, RAX, RAX);        // lea rax, [rax + rax + 1]
+    put(e, 0x8D);
+    put(e, 0x44);
+    put(e, 0x00);
+    put(e, 0x01);
+#ifdef LVM_COMPRESSED_REFS
+    op_reg(e, true, 0x63, RAX, RAX);    // movsxd rax, eax: перенос как у BOX
+#endif
+    store(e, R_SP, SP(k), RAX);
+}
+
+static void emit_binop(Emit *e, int op, const Instr *in) {
+    load_operand(e, RCX, 1);
+    load_operand(e, RAX, 2);
+    switch (op) {
+        case BC_ADD: op_reg(e, true, 0x01, RCX, RAX); break;
+        case BC_SUB: op_reg(e, true, 0x29, RCX, RAX); break;
+        case BC_MUL: op_reg(e, true, 0x0FAF, RAX, RCX); break;
+        case BC_DIV:
+        case BC_MOD: {
+            op_reg(e, true, 0x85, RCX, RCX);        // test rcx, rcx
+            jcc(e, CC_E, stub(e, in));              // ошибку выдаст интерпретатор
+            rex(e, true, 0, 0, 0);
+            put(e, 0x99);                           // cqo (cdq на i386)
+            op_reg(e, true, 0xF7, 7, RCX);          // idiv rcx
+            if (op == BC_DIV) break;
+            op_reg(e, true, 0x89, RDX, RAX);        // mov rax, rdx
+            int done = new_label(e);
+            op_reg(e, true, 0x85, RAX, RAX);
+            jcc(e, CC_NS, done);
+            op_reg(e, true, 0x89, RCX, RDX);        // rax += |rcx| (safe_mod)
+            op_reg(e, true, 0xC1, 7, RDX);
+            put(e, 8 * W - 1);
+            op_reg(e, true, 0x31, RDX, RCX);
+            op_reg(e, true, 0x29, RDX, RCX);
+            op_reg(e, true, 0x01, RCX, RAX);
+            bind(e, done);
+            break;
+        }
+        case BC_AND:
+        case BC_OR:
+            op_reg(e, true, 0x85, RAX, RAX);
+            op_reg(e, false, 0x0F95, 0, RAX);       // setne al
+            op_reg(e, true, 0x85, RCX, RCX);
+            op_reg(e, false, 0x0F95, 0, RCX);       // setne cl
+            op_reg(e, false, op == BC_AND ? 0x20 : 0x08, RCX, RAX);
+            op_reg(e, false, 0x0FB6, RAX, RAX);     // movzx eax, al
+            break;
+        default: {
+            int cc = op == BC_LT ? CC_L : op == BC_LE ? CC_LE : op == BC_GT ? CC_G :
+                     op == BC_GE ? CC_GE : op == BC_EQ ? CC_E : CC_NE;
+            op_reg(e, true, 0x39, RCX, RAX);        // cmp rax, rcx
+            op_reg(e, false, 0x0F90 | cc, 0, RAX);
+            op_reg(e, false, 0x0FB6, RAX, RAX);
+            break;
+        }
+    }
+    store_boxed(e, 2);
+    e->d--;
+}
+
+// Заполнение только что созданного объекта (rax) n значениями со стека
+static void fill_from_stack(Emit *e, int n, int32_t first) {
+    for (int k = 0; k < n; k++) {
+        load(e, RCX, R_SP, SP(n - k));
+        store_field(e, RAX, first + k, RCX);
+    }
+    e->d -= n;
+}
+
+// Функция runtime от вершины стека с результатом на ее месте
+static void emit_unary(Emit *e, const void *fn) {
+    begin_call(e);
+    arg_word(e, 0, R_SP, SP(1));
+    call(e, fn);
+    store(e, R_SP, SP(1), RAX);
+}
+
+static void emit_call_handler(Emit *e, const Exits *x, const Jit *jit, const Instr *in) {
+    flush(e);
+    store(e, R_CTX, offsetof(JitCtx, sp), R_SP);
+    arg_ctx(e, 0);
+    if (in) arg_imm(e, 1, (intptr_t) in);
+    call(e, in ? (const void *) jit->call : (const void *) jit->end);
+    dispatch_result(e, x);
+}
+
+// Шаблон инструкции; false - после нее управление не переходит дальше
+static bool emit_instr(Emit *e, const Exits *x, const Jit *jit, const Instr *in,
+                       const int *labels, uint32_t first, uint32_t last) {
+    const QCode *q = jit->q;
+    int op = qcode_op(in);
+    int base;
+    int32_t disp;
+
+    switch (op) {
+        case BC_ADD: case BC_SUB: case BC_MUL: case BC_DIV: case BC_MOD:
+        case BC_LT:  case BC_LE:  case BC_GT:  case BC_GE:  case BC_EQ:
+        case BC_NEQ: case BC_AND: case BC_OR:
+            emit_binop(e, op, in);
+            return true;
+
+        case BC_CONST:
+            store_imm(e, R_SP, SP(0), box(in->a));
+            e->d++;
+            return true;
+
+        case BC_LD_G: case BC_LD_L: case BC_LD_A: case BC_LD_C:
+            slot(e, op & 0x0F, in->a, &base, &disp, RCX);
+            load(e, RAX, base, disp);
+            push_reg_value(e, RAX);
+            return true;
+
+        case BC_LDA_G: case BC_LDA_L: case BC_LDA_A: case BC_LDA_C:
+            slot(e, op & 0x0F, in->a, &base, &disp, RCX);
+            op_mem(e, true, 0x8D, RAX, base, disp);     // lea
+            push_reg_value(e, RAX);
+            op_mem(e, true, 0x8D, RAX, R_SP, SP(0));    // sp после первого push
+            push_reg_value(e, RAX);
+            return true;
+
+        case BC_ST_G: case BC_ST_L: case BC_ST_A: case BC_ST_C:
+            slot(e, op & 0x0F, in->a, &base, &disp, RCX);
+            load(e, RAX, R_SP, SP(1));
+            store(e, base, disp, RAX);
+            return true;
+
+        case BC_DROP:
+            e->d--;
+            return true;
+
+        case BC_DUP:
+            load(e, RAX, R_SP, SP(1));
+            push_reg_value(e, RAX);
+            return true;
+
+        case BC_SWAP:
+            load(e, RAX, R_SP, SP(1));
+            load(e, RCX, R_SP, SP(2));
+            store(e, R_SP, SP(2), RAX);
+            store(e, R_SP, SP(1), RCX);
+            return true;
+
+        case BC_JMP: {
+            uint32_t t = (uint32_t)(in->u.target - q->code);
+            flush(e);
+            if (t >= first && t < last) jmp(e, labels[t - first]);
+            else exit_at(e, x, in->u.target);
+            return false;
+        }
+
+        case BC_CJMPz:
+        case BC_CJMPnz: {
+            uint32_t t = (uint32_t)(in->u.target - q->code);
+            load(e, RAX, R_SP, SP(1));
+            op_reg(e, false, 0xF7, 0, RAX);             // test eax, 1
+            put32(e, 1);
+            jcc(e, CC_E, stub(e, in));                  // не число: ошибка в интерпретаторе
+            e->d--;
+            flush(e);
+            op_reg(e, true, 0x81, 7, RAX);              // cmp rax, BOX(0)
+            put32(e, 1);
+            int cc = op == BC_CJMPz ? CC_E : CC_NE;
+            if (t >= first && t < last) jcc(e, cc, labels[t - first]);
+            else jcc(e, cc, stub(e, in->u.target));
+            return true;
+        }
+
+        case BC_STRING:
+            gc_point(e, in);
+            begin_call(e);
+            arg_imm(e, 0, (intptr_t) in->u.str);
+            call(e, (const void *) Bstring);
+            push_reg_value(e, RAX);
+            return true;
+
+        case BC_SEXP:
+            gc_point(e, in);
+            begin_call(e);
+            arg_imm(e, 0, box(in->b + 1));
+            arg_imm(e, 1, in->a);
+            call(e, (const void *) LmakeSexp);
+            fill_from_stack(e, in->b, 0);
+            push_reg_value(e, RAX);
+            return true;
+
+        case BC_BARRAY:
+            gc_point(e, in);
+            begin_call(e);
+            arg_imm(e, 0, box(in->a));
+            call(e, (const void *) LmakeArray);
+            fill_from_stack(e, in->a, 0);
+            push_reg_value(e, RAX);
+            return true;
+
+        case BC_CLOSURE: {
+            gc_point(e, in);
+            begin_call(e);
+            arg_imm(e, 0, box(in->a));
+            arg_imm(e, 1, (intptr_t) qcode_closure_entry(q, in->u.target));
+            call(e, (const void *) LMakeClosure);
+            const QLoc *caps = q->caps + in->b;
+            for (int i = 0; i < in->a; i++) {
+                slot(e, caps[i].tt, caps[i].off, &base, &disp, RDX);
+                load(e, RCX, base, disp);
+                store_field(e, RAX, i + 1, RCX);
+            }
+            push_reg_value(e, RAX);
+            return true;
+        }
+
+        case BC_STA:
+            begin_call(e);
+            arg_word(e, 0, R_SP, SP(1));
+            arg_word(e, 1, R_SP, SP(2));
+            arg_word(e, 2, R_SP, SP(3));
+            call(e, (const void *) Bsta);
+            store(e, R_SP, SP(3), RAX);
+            e->d -= 2;
+            return true;
+
+        case BC_ELEM:
+            begin_call(e);
+            arg_word(e, 0, R_SP, SP(2));
+            arg_word(e, 1, R_SP, SP(1));
+            call(e, (const void *) Belem);
+            store(e, R_SP, SP(2), RAX);
+            e->d--;
+            return true;
+
+        case BC_TAG:
+            begin_call(e);
+            arg_word(e, 0, R_SP, SP(1));
+            arg_imm(e, 1, in->a);
+            arg_imm(e, 2, box(in->b));
+            call(e, (const void *) Btag);
+            store(e, R_SP, SP(1), RAX);
+            return true;
+
+        case BC_ARRAY:
+            begin_call(e);
+            arg_word(e, 0, R_SP, SP(1));
+            arg_imm(e, 1, box(in->a));
+            call(e, (const void *) Barray_patt);
+            store(e, R_SP, SP(1), RAX);
+            return true;
+
+        case BC_PATT_STR:
+            begin_call(e);
+            arg_word(e, 0, R_SP, SP(2));
+            arg_word(e, 1, R_SP, SP(1));
+            call(e, (const void *) Bstring_patt);
+            store(e, R_SP, SP(2), RAX);
+            e->d--;
+            return true;
+
+        case BC_PATT_STRING: emit_unary(e, (const void *) Bstring_tag_patt); return true;
+        case BC_PATT_ARRAY:  emit_unary(e, (const void *) Barray_tag_patt); return true;
+        case BC_PATT_SEXP:   emit_unary(e, (const void *) Bsexp_tag_patt); return true;
+        case BC_PATT_REF:    emit_unary(e, (const void *) Bboxed_patt); return true;
+        case BC_PATT_VAL:    emit_unary(e, (const void *) Bunboxed_patt); return true;
+        case BC_PATT_FUN:    emit_unary(e, (const void *) Bclosure_tag_patt); return true;
+        case BC_LENGTH:      emit_unary(e, (const void *) Blength); return true;
+        case BC_STRINGV:
+            gc_point(e, in);
+            emit_unary(e, (const void *) Bstringval);
+            return true;
+
+        case BC_READ:
+            begin_call(e);
+            call(e, (const void *) Lread);
+            push_reg_value(e, RAX);
+            return true;
+
+        case BC_WRITE:
+            begin_call(e);
+            arg_word(e, 0, R_SP, SP(1));
+            call(e, (const void *) Lwrite);
+            return true;
+
+        case BC_CALL:
+        case BC_CALLC:
+            emit_call_handler(e, x, jit, in);
+            return false;
+
+        case BC_END:
+            emit_call_handler(e, x, jit, NULL);
+            return false;
+
+        default:    // BEGIN/CBEGIN, FAIL, HALT, STI, RET, QOP_FAULT, QOP_EOC
+            exit_at(e, x, in);
+            return false;
+    }
+}
+
+/* Исполняемая память: отдельное отображение на каждый фрагмент кода,
+   запись до mprotect, исполнение после */
+static const void *publish(Jit *jit, const Emit *e) {
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t size = (e->len + page - 1) / page * page;
+    JitChunk *c = malloc(sizeof(JitChunk));
+    if (!c) return NULL;
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        free(c);
+        return NULL;
+    }
+    memcpy(mem, e->code, e->len);
+    if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(mem, size);
+        free(c);
+        return NULL;
+    }
+    *c = (JitChunk){jit->chunks, mem, size};
+    jit->chunks = c;
+    jit->code_bytes += e->len;
+    return mem;
+}
+
+static void emit_free(Emit *e) {
+    free(e->code);
+    free(e->labels);
+    free(e->fix);
+    free(e->stubs);
+}
+
+bool jit_backend_compile(Jit *jit, uint32_t first, uint32_t last) {
+    const QCode *q = jit->q;
+    uint32_t n = last - first;
+    Emit e = {0};
+    int *labels = malloc((n + 1) * sizeof(int));
+    bool *target = calloc(n + 1, sizeof(bool));
+    if (!labels || !target) {
+        free(labels);
+        free(target);
+        return false;
+    }
+
+    /* Метки с пустым отложенным сдвигом sp: цели переходов и точки входа
+       (начало функции и возвраты из вызовов) */
+    target[0] = true;
+    for (uint32_t k = first; k < last; k++) {
+        const Instr *in = &q->code[k];
+        int op = qcode_op(in);
+        if (op == BC_JMP || op == BC_CJMPz || op == BC_CJMPnz) {
+            uint32_t t = (uint32_t)(in->u.target - q->code);
+            if (t >= first && t < last) target[t - first] = true;
+        } else if (op == BC_CALL || op == BC_CALLC) {
+            target[k + 1 - first] = true;
+        }
+    }
+    for (uint32_t k = 0; k < n; k++) labels[k] = new_label(&e);
+    Exits x = {new_label(&e), new_label(&e)};
+
+    bool live = true;
+    for (uint32_t k = first; k < last && !e.oom; k++) {
+        if (target[k - first]) {
+            if (live) flush(&e);
+            e.d = 0;
+        }
+        bind(&e, labels[k - first]);
+        live = emit_instr(&e, &x, jit, &q->code[k], labels, first, last);
+        if (!live) e.d = 0;
+    }
+    if (live) exit_at(&e, &x, &q->code[last]);
+
+    epilogue(&e, &x);
+    for (int s = 0; s < e.n_stubs; s++) {
+        bind(&e, e.stubs[s].label);
+        e.d = e.stubs[s].d;
+        exit_at(&e, &x, e.stubs[s].in);
+    }
+
+    for (int f = 0; f < e.n_fix && !e.oom; f++) {
+        int32_t rel = e.labels[e.fix[f].label] - (int32_t)(e.fix[f].at + 4);
+        memcpy(e.code + e.fix[f].at, &rel, sizeof(rel));
+    }
+
+    const uint8_t *code = e.oom ? NULL : publish(jit, &e);
+    /* Точки входа из интерпретатора - все метки: начало функции, возвраты
+       из вызовов и цели переходов (заголовки циклов для OSR) */
+    if (code) {
+        for (uint32_t k = first; k < last; k++)
+            if (target[k - first]) jit->native[k] = code + e.labels[labels[k - first]];
+    }
+
+    emit_free(&e);
+    free(labels);
+    free(target);
+    return code != NULL;
+}
+
+// Вход из интерпретатора: сохранение регистров, загрузка ctx, переход на code
+static bool emit_enter(Emit *e) {
+    push_reg(e, R_CTX);
+    push_reg(e, R_SP);
+    push_reg(e, R_BASE);
+    push_reg(e, R_ABASE);
+    add_imm(e, RSP, -FRAME);
+#if JIT_X64
+    op_reg(e, true, 0x89, RDI, R_CTX);      // mov rbx, rdi
+    reload(e);
+    op_reg(e, false, 0xFF, 4, RSI);         // jmp rsi
+#else
+    load(e, R_CTX, RSP, FRAME + 20);
+    load(e, RCX, RSP, FRAME + 24);
+    reload(e);
+    op_reg(e, false, 0xFF, 4, RCX);         // jmp ecx
+#endif
+    return !e->oom;
+}
+
+bool jit_backend_init(Jit *jit) {
+    Emit e = {0};
+    bool ok = emit_enter(&e) && (jit->enter = (JitEnter) publish(jit, &e)) != NULL;
+    emit_free(&e);
+    jit->code_bytes = 0;
+    return ok;
+}
+
+void jit_backend_free(Jit *jit) {
+    for (JitChunk *c = jit->chunks, *next; c; c = next) {
+        next = c->next;
+        munmap(c->mem, c->size);
+        free(c);
+    }
+    jit->chunks = NULL;
+}
+
+#else   /* не x86 */
+
+bool jit_backend_init(Jit *jit) {
+    (void) jit;
+    return false;
+}
+
+void jit_backend_free(Jit *jit) {
+    (void) jit;
+}
+
+bool jit_backend_compile(Jit *jit, uint32_t first, uint32_t last) {
+    (void) jit; (void) first; (void) last;
+    return false;
+}
+
+#endif
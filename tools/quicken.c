@@ -0,0 +1,425 @@
+#include "quicken.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+extern int LtagHash(char *);
+
+/*
+ * Трансляция байткода в массив предекодированных инструкций.
+ *
+ * Операнды читаются, проверяются и разрешаются один раз при загрузке:
+ *   - переходы и вызовы превращаются в указатели на Instr;
+ *   - индексы переменных проверяются по размерам кадра объемлющей функции
+ *     и заменяются смещениями слотов:
+ *       G: stack_bottom - off
+ *       L: base + off,           off = n_locs - idx
+ *       A: abase + off,          off = n_args + n_locs + 1 - idx
+ *       C: abase + off,          off = n_locs - idx  (idx < n_caps проверяется при исполнении)
+ *     где abase = base + n_caps (число захватов известно только при вызове,
+ *     поэтому abase вычисляется один раз на входе в функцию);
+ *   - строки и хеши тегов вычисляются заранее;
+ *   - каждому CALL/CALLC выделяется кэш места вызова (QCode.calls); для CALL
+ *     он заполняется здесь же, если BEGIN вызываемой функции пройдет свои
+ *     проверки, для CALLC - при исполнении;
+ *   - LINE не порождает инструкций;
+ *   - CALL/CALLC, за которыми (через безусловные переходы) следует END,
+ *     помечаются как хвостовые вызовы.
+ * Функция - участок кода от BEGIN/CBEGIN до следующего BEGIN/CBEGIN;
+ * переход за её пределы считается ошибкой.
+ *
+ * Ошибки не прерывают загрузку: инструкция заменяется на QOP_FAULT,
+ * и сообщение выдается, только если она будет исполнена.
+ */
+
+static int32_t read_i32(const uint8_t *p) {
+    int32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// Длина инструкции в байтах; 0 - операнды выходят за конец кода
+static uint32_t instr_length(const uint8_t *bc, uint32_t pos, uint32_t size, bool *invalid) {
+    uint8_t x = bc[pos];
+    uint32_t len = 1;
+    *invalid = false;
+
+    switch (x) {
+        case BC_CONST: case BC_STRING: case BC_JMP:
+        case BC_CJMPz: case BC_CJMPnz: case BC_CALLC:
+        case BC_ARRAY: case BC_LINE:   case BC_BARRAY:
+            len = 5;
+            break;
+        case BC_SEXP: case BC_BEGIN: case BC_CBEGIN: case BC_CALL:
+        case BC_TAG:  case BC_FAIL:
+            len = 9;
+            break;
+        case BC_CLOSURE: {
+            if (pos + 9 > size) return 0;
+            int32_t n = read_i32(bc + pos + 5);
+            if (n < 0 || (uint64_t)n * 5 + 9 > size - pos) return 0;
+            len = 9 + (uint32_t)n * 5;
+            break;
+        }
+        case BC_STI: case BC_STA: case BC_END: case BC_RET: case BC_DROP:
+        case BC_DUP: case BC_SWAP: case BC_ELEM:
+        case BC_PATT_STR: case BC_PATT_STRING: case BC_PATT_ARRAY:
+        case BC_PATT_SEXP: case BC_PATT_REF: case BC_PATT_VAL: case BC_PATT_FUN:
+        case BC_READ: case BC_WRITE: case BC_LENGTH: case BC_STRINGV:
+            break;
+        default: {
+            uint8_t h = x >> 4, l = x & 0x0F;
+            if (h == OP_HALT || (h == OP_BINOP && l >= OP_ADD && l < OP_N)) break;
+            if ((h == OP_LD || h == OP_LDA || h == OP_ST) && l < LOC_N) {
+                len = 5;
+                break;
+            }
+            *invalid = true;
+            break;
+        }
+    }
+
+    return pos + len <= size ? len : 0;
+}
+
+uint32_t bc_instr_length(const uint8_t *bc, uint32_t pos, uint32_t size) {
+    bool invalid;
+    return instr_length(bc, pos, size, &invalid);
+}
+
+typedef struct {
+    int n_args, n_locs;
+    int32_t begin;          // индекс BEGIN/CBEGIN функции, -1 вне функций
+} FrameInfo;
+
+static void set_fault(Instr *in, QuickFault kind, int operand) {
+    in->op = QOP_FAULT;
+    in->a = kind;
+    in->b = operand;
+}
+
+// Проверка ссылки на переменную; false - индекс вне кадра
+static bool resolve_loc(const bytefile *bf, const FrameInfo *fr, int tt, int idx, int *off) {
+    if (idx < 0) return false;
+    switch (tt) {
+        case LOC_G:
+            if (idx >= bf->global_area_size) return false;
+            *off = idx;
+            return true;
+        case LOC_L:
+            if (fr->begin < 0 || idx >= fr->n_locs) return false;
+            *off = fr->n_locs - idx;
+            return true;
+        case LOC_A:
+            if (fr->begin < 0 || idx >= fr->n_args) return false;
+            *off = fr->n_args + fr->n_locs + 1 - idx;
+            return true;
+        case LOC_C:
+            if (fr->begin < 0) return false;
+            *off = fr->n_locs - idx;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Шаблоны суперинструкций из superinstr.def
+static const struct {
+    int op;
+    int n;
+    int ops[3];
+} superinstrs[] = {
+#define SUPER2(name, o1, o2)        {QOP_##name, 2, {o1, o2, 0}},
+#define SUPER3(name, o1, o2, o3)    {QOP_##name, 3, {o1, o2, o3}},
+#include "superinstr.def"
+#undef SUPER2
+#undef SUPER3
+    {0, 0, {0}}
+};
+
+/*
+ * Замена первой инструкции последовательности на суперинструкцию.
+ * Остальные записи не трогаются: слитый обработчик читает их операнды
+ * и сам переходит на in + n, а переходы внутрь последовательности
+ * по-прежнему попадают на одиночные обработчики. Из нескольких
+ * подходящих шаблонов выбирается самый длинный.
+ */
+void qcode_fuse(QCode *q) {
+    for (uint32_t k = 0; k < q->n_code; k++) {
+        int best = -1;
+        for (int s = 0; superinstrs[s].n != 0; s++) {
+            int n = superinstrs[s].n;
+            if (k + n > q->n_code) continue;
+            if (best >= 0 && superinstrs[best].n >= n) continue;
+            bool match = true;
+            for (int j = 0; j < n && match; j++)
+                match = q->code[k + j].op == superinstrs[s].ops[j];
+            if (match) best = s;
+        }
+        if (best >= 0) q->code[k].op = superinstrs[best].op;
+    }
+}
+
+/*
+ * Хвостовые вызовы: после возврата из CALL/CALLC исполнение доходит до END,
+ * возможно, через цепочку JMP (так компилируются ветви case и if).
+ * Такой вызов может занять кадр вызывающей функции - см. vmtail в
+ * lvm_loop.inc. Длина цепочки ограничена, чтобы не зациклиться на JMP
+ * самого на себя.
+ */
+#define TAIL_JMP_CHAIN 8
+
+static void mark_tail_calls(QCode *q) {
+    for (uint32_t k = 0; k < q->n_code; k++) {
+        Instr *in = &q->code[k];
+        if (in->op != BC_CALL && in->op != BC_CALLC) continue;
+        const Instr *next = in + 1;
+        for (int n = 0; next->op == BC_JMP && n < TAIL_JMP_CHAIN; n++)
+            next = next->u.target;
+        if (next->op == BC_END)
+            in->op = in->op == BC_CALL ? QOP_TAILCALL : QOP_TAILCALLC;
+    }
+}
+
+QCode *quicken(const bytefile *bf, uint32_t code_size) {
+    const uint8_t *bc = (const uint8_t *) bf->code_ptr;
+    QCode *q = calloc(1, sizeof(QCode));
+    uint32_t *starts = malloc((code_size + 1) * sizeof(uint32_t));
+    int32_t *owner = NULL;
+    if (!q || !starts) {
+        fprintf(stderr, "*** FAILURE: unable to allocate memory for quickened code\n");
+        exit(255);
+    }
+    q->code_ptr = bf->code_ptr;
+    q->code_size = code_size;
+    q->off2idx = malloc((code_size + 1) * sizeof(int32_t));
+    if (!q->off2idx) {
+        fprintf(stderr, "*** FAILURE: unable to allocate memory for quickened code\n");
+        exit(255);
+    }
+    for (uint32_t i = 0; i <= code_size; i++) q->off2idx[i] = -1;
+
+    // Проход 1: границы инструкций и нумерация порождаемых Instr
+    uint32_t n_raw = 0, n_code = 0, n_caps = 0, n_calls = 0;
+    bool truncated = false;
+    for (uint32_t pos = 0; pos < code_size; ) {
+        bool invalid;
+        uint32_t len = instr_length(bc, pos, code_size, &invalid);
+        starts[n_raw++] = pos;
+        q->off2idx[pos] = n_code;
+        if (len == 0) {
+            truncated = true;
+            n_code++;
+            break;
+        }
+        if (bc[pos] != BC_LINE) n_code++;
+        if (bc[pos] == BC_CLOSURE) n_caps += read_i32(bc + pos + 5);
+        if (bc[pos] == BC_CALL || bc[pos] == BC_CALLC) n_calls++;
+        pos += len;
+    }
+    q->off2idx[code_size] = n_code;
+
+    q->n_code = n_code;
+    q->code = calloc(n_code + 1, sizeof(Instr));
+    q->n_caps = n_caps;
+    q->caps = n_caps ? calloc(n_caps, sizeof(QLoc)) : NULL;
+    q->n_calls = n_calls;
+    q->calls = n_calls ? calloc(n_calls, sizeof(CallCache)) : NULL;
+    owner = malloc((n_code + 1) * sizeof(int32_t));
+    if (!q->code || (n_caps && !q->caps) || (n_calls && !q->calls) || !owner) {
+        fprintf(stderr, "*** FAILURE: unable to allocate memory for quickened code\n");
+        exit(255);
+    }
+
+    // Принадлежность инструкций функциям
+    int32_t cur = -1;
+    for (uint32_t k = 0; k < n_raw; k++) {
+        uint8_t x = bc[starts[k]];
+        int32_t idx = q->off2idx[starts[k]];
+        if ((x == BC_BEGIN || x == BC_CBEGIN) && !(truncated && k == n_raw - 1))
+            cur = idx;
+        if (x != BC_LINE || (truncated && k == n_raw - 1)) owner[idx] = cur;
+    }
+    owner[n_code] = -2;
+
+    // Проход 2: декодирование операндов
+    FrameInfo fr = {0, 0, -1};
+    uint32_t cap_pos = 0, call_pos = 0;
+    for (uint32_t k = 0; k < n_raw; k++) {
+        uint32_t pos = starts[k];
+        const uint8_t *p = bc + pos + 1;
+        uint8_t x = bc[pos];
+        bool last_truncated = truncated && k == n_raw - 1;
+
+        if (x == BC_LINE && !last_truncated) continue;
+
+        int32_t idx = q->off2idx[pos];
+        Instr *in = &q->code[idx];
+        in->op = x;
+        in->src = bf->code_ptr + pos;
+
+        if (last_truncated) {
+            set_fault(in, QFAULT_TRUNCATED, code_size - pos);
+            break;
+        }
+
+        bool invalid;
+        instr_length(bc, pos, code_size, &invalid);
+        if (invalid) {
+            set_fault(in, QFAULT_INVALID_OP, x);
+            continue;
+        }
+        if (x >= OPCODE(OP_HALT, 0)) {
+            in->op = BC_HALT;
+            continue;
+        }
+
+        switch (x) {
+            case BC_CONST: case BC_ARRAY: case BC_BARRAY:
+                in->a = read_i32(p);
+                break;
+
+            case BC_CALLC:
+                in->a = read_i32(p);
+                in->b = call_pos++;
+                break;
+
+            case BC_STRING: {
+                int32_t s = read_i32(p);
+                if (s < 0 || s >= bf->stringtab_size) {
+                    set_fault(in, QFAULT_BAD_STRING, s);
+                    break;
+                }
+                in->u.str = bf->string_ptr + s;
+                break;
+            }
+
+            case BC_SEXP: case BC_TAG: {
+                int32_t s = read_i32(p);
+                if (s < 0 || s >= bf->stringtab_size) {
+                    set_fault(in, QFAULT_BAD_STRING, s);
+                    break;
+                }
+                in->a = LtagHash((char *) bf->string_ptr + s);
+                in->b = read_i32(p + 4);
+                break;
+            }
+
+            case BC_JMP: case BC_CJMPz: case BC_CJMPnz: {
+                int32_t t = read_i32(p);
+                int32_t ti = (t >= 0 && (uint32_t) t < code_size) ? q->off2idx[t] : -1;
+                if (ti < 0 || owner[ti] != owner[idx]) {
+                    set_fault(in, QFAULT_BAD_JUMP, t);
+                    break;
+                }
+                in->u.target = &q->code[ti];
+                break;
+            }
+
+            case BC_BEGIN: case BC_CBEGIN:
+                in->a = read_i32(p);
+                in->b = read_i32(p + 4);
+                fr.n_args = in->a;
+                fr.n_locs = in->b;
+                fr.begin = idx;
+                break;
+
+            case BC_CALL: case BC_CLOSURE: {
+                int32_t t = read_i32(p);
+                in->a = read_i32(p + 4);
+                if (t < 0 || (uint32_t) t >= code_size) {
+                    set_fault(in, QFAULT_BAD_JUMP, t);
+                    break;
+                }
+                int32_t ti = q->off2idx[t];
+                if (ti < 0 || (bc[t] != BC_BEGIN && bc[t] != BC_CBEGIN)) {
+                    set_fault(in, QFAULT_BAD_CALL, t);
+                    break;
+                }
+                in->u.target = &q->code[ti];
+                if (x == BC_CALL) {
+                    in->b = call_pos++;
+                    break;
+                }
+
+                QLoc *caps = q->caps + cap_pos;
+                in->b = cap_pos;
+                cap_pos += in->a;
+                for (int i = 0; i < in->a; i++) {
+                    const uint8_t *c = p + 8 + i * 5;
+                    caps[i].tt = c[0];
+                    caps[i].idx = read_i32(c + 1);
+                    if (!resolve_loc(bf, &fr, caps[i].tt, caps[i].idx, &caps[i].off)) {
+                        set_fault(in, QFAULT_BAD_LOC, i);
+                        break;
+                    }
+                }
+                break;
+            }
+
+            case BC_FAIL:
+                in->a = read_i32(p);
+                in->b = read_i32(p + 4);
+                break;
+
+            default: {
+                uint8_t h = x >> 4;
+                if (h == OP_LD || h == OP_LDA || h == OP_ST) {
+                    in->b = read_i32(p);
+                    if (!resolve_loc(bf, &fr, x & 0x0F, in->b, &in->a))
+                        set_fault(in, QFAULT_BAD_LOC, in->b);
+                }
+                break;
+            }
+        }
+    }
+
+    // Сторож: выполнение "за концом" кода
+    q->code[n_code].op = QOP_EOC;
+    q->code[n_code].src = bf->code_ptr + code_size;
+
+    // Кэши CALL: вызываемая функция известна статически. Через CALL и BEGIN,
+    // и CBEGIN строят кадр без захватов; вызовы BEGIN с отрицательными
+    // размерами кадра (или не прошедшего загрузку) остаются на общем пути,
+    // чтобы ошибка была выдана там же, где и раньше.
+    for (uint32_t k = 0; k < n_code; k++) {
+        const Instr *in = &q->code[k];
+        if (in->op != BC_CALL) continue;
+        const Instr *t = in->u.target;
+        if ((t->op != BC_BEGIN && t->op != BC_CBEGIN) || t->a < 0 || t->b < 0) continue;
+        q->calls[in->b] = (CallCache){t, 0, t->a, t->b};
+    }
+
+    mark_tail_calls(q);
+
+    qcode_fuse(q);
+
+    free(owner);
+    free(starts);
+    return q;
+}
+
+void qcode_free(QCode *q) {
+    if (!q) return;
+    free(q->code);
+    free(q->caps);
+    free(q->calls);
+    free(q->off2idx);
+    free(q->height);
+    free(q->consts);
+    free(q);
+}
+
+const Instr *qcode_at(const QCode *q, const char *ip) {
+    if (ip < q->code_ptr || ip >= q->code_ptr + q->code_size) return NULL;
+    int32_t idx = q->off2idx[ip - q->code_ptr];
+    if (idx < 0 || q->code[idx].src != ip) return NULL;
+    return &q->code[idx];
+}
+
+/* Исходный опкод хранится в байткоде по in->src */
+int qcode_op(const Instr *in) {
+    if (in->op == QOP_FAULT || in->op == QOP_EOC) return in->op;
+    uint8_t x = (uint8_t)*in->src;
+    return (x >> 4) == OP_HALT ? BC_HALT : x;
+}
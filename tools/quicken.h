@@ -0,0 +1,120 @@
+#ifndef QUICKEN_H
+#define QUICKEN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "bytecode_defs.h"
+
+// Внутренние опкоды предекодированного потока (идут после байтовых 0x00-0xFF)
+typedef enum {
+    QOP_FAULT = 0x100,  // инструкция, не прошедшая проверку при загрузке
+    QOP_EOC,            // сторож за концом кода
+    QOP_TAILCALL,       // CALL, после которого функция сразу завершается (END)
+    QOP_TAILCALLC,      // то же для CALLC
+    // суперинструкции (см. gen_superinstructions.sh)
+#define SUPER2(name, o1, o2)        QOP_##name,
+#define SUPER3(name, o1, o2, o3)    QOP_##name,
+#include "superinstr.def"
+#undef SUPER2
+#undef SUPER3
+    // регистровая форма (см. regvm.c): операнды a, b, c - слоты (ROPND)
+    QOP_RMOV,           // c := a
+    QOP_RSYNC,          // только выравнивание sp по высоте стека
+    QOP_RADD, QOP_RSUB, QOP_RMUL, QOP_RDIV, QOP_RMOD,
+    QOP_RLT, QOP_RLE, QOP_RGT, QOP_RGE, QOP_REQ, QOP_RNEQ,
+    QOP_RAND, QOP_ROR,  // c := a op b
+    QOP_RELEM,          // c := a[b]
+    QOP_RCJMPz,         // переход по a == 0 (b - высота стека после)
+    QOP_RCJMPnz,
+    QOP_N
+} QuickOpcode;
+
+// Виды ошибок, отложенных до исполнения инструкции (a = вид, b = операнд)
+typedef enum {
+    QFAULT_INVALID_OP = 0,  // неизвестный опкод
+    QFAULT_TRUNCATED,       // операнды выходят за конец кода
+    QFAULT_BAD_JUMP,        // переход не на начало инструкции текущей функции
+    QFAULT_BAD_CALL,        // CALL/CLOSURE не на BEGIN/CBEGIN
+    QFAULT_BAD_LOC,         // индекс переменной вне кадра
+    QFAULT_BAD_STRING       // индекс вне таблицы строк
+} QuickFault;
+
+// Предвычисленная ссылка на переменную (захват в CLOSURE)
+typedef struct {
+    int tt;     // LOC_G/L/A/C
+    int idx;    // исходный индекс
+    int off;    // смещение слота (см. quicken.c)
+} QLoc;
+
+// Кэш места вызова CALL/CALLC: точка входа вызываемой функции и раскладка
+// её кадра, проверенные один раз (CALL - при загрузке, CALLC - при первом
+// вызове замыкания с этой точкой входа). entry == NULL - кэш пуст.
+typedef struct {
+    const struct Instr *entry;  // BEGIN/CBEGIN; для CALLC - ключ вместе с n_caps
+    int n_caps, n_args, n_locs;
+} CallCache;
+
+// Предекодированная инструкция
+typedef struct Instr {
+    const void *handler;        // метка обработчика в eval (computed goto)
+    int op;                     // байт опкода или QuickOpcode
+    int a, b;                   // непосредственные операнды
+                                // (CLOSURE: a - число захватов, b - индекс в QCode.caps;
+                                //  CALL/CALLC: b - индекс в QCode.calls)
+    int c;                      // слот результата регистровой инструкции
+    union {
+        const struct Instr *target;  // JMP/CJMP/CALL/CLOSURE
+        const char *str;             // STRING
+        int depth;                   // BEGIN/CBEGIN: запас стека кадра (verify_quickened);
+                                     // регистровые инструкции: высота стека после
+    } u;
+    const char *src;            // исходная позиция в байткоде (для ошибок)
+} Instr;
+
+// Результат трансляции байткода
+typedef struct {
+    Instr *code;            // инструкции; code[n_code] - сторож QOP_EOC
+    uint32_t n_code;
+    QLoc *caps;             // общий пул описаний захватов
+    uint32_t n_caps;
+    CallCache *calls;       // кэши мест вызова
+    uint32_t n_calls;
+    int32_t *off2idx;       // смещение в байткоде -> индекс инструкции (-1 если нет)
+    int32_t *height;        // verify_quickened: высота стека кадра перед инструкцией
+                            // (-1 - недостижима), иначе NULL
+    void **consts;          // регистровая форма: пул констант (ROPND_CONST)
+    uint32_t n_consts;
+    uint32_t code_size;
+    const char *code_ptr;
+} QCode;
+
+QCode *quicken(const bytefile *bf, uint32_t code_size);
+void qcode_free(QCode *q);
+
+// Слияние последовательностей в суперинструкции (superinstr.def) по Instr.op
+void qcode_fuse(QCode *q);
+
+// Инструкция, начинающаяся по адресу ip в байткоде, или NULL
+const Instr *qcode_at(const QCode *q, const char *ip);
+
+// Длина инструкции байткода по смещению pos (неизвестный опкод - 1 байт);
+// 0 - операнды выходят за конец кода
+uint32_t bc_instr_length(const uint8_t *bc, uint32_t pos, uint32_t size);
+
+// Исходный опкод инструкции (для суперинструкций и хвостовых вызовов
+// Instr.op заменен); QOP_FAULT и QOP_EOC возвращаются как есть
+int qcode_op(const Instr *in);
+
+// Точка входа замыкания (поле 0 объекта). Со сжатыми ссылками (hword в
+// runtime.h) указатель в поле не помещается: там лежит номер инструкции
+// в q->code, упакованный как число
+#ifdef LVM_COMPRESSED_REFS
+#define qcode_closure_entry(q, in)  ((void *)((((intptr_t)((in) - (q)->code)) << 1) | 1))
+#define qcode_closure_target(q, e)  ((q)->code + ((intptr_t)(e) >> 1))
+#else
+#define qcode_closure_entry(q, in)  ((void *)(in))
+#define qcode_closure_target(q, e)  ((const Instr *)(e))
+#endif
+
+#endif
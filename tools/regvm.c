@@ -0,0 +1,333 @@
+#include "regvm.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "runtime.h"
+
+/*
+ * Трансляция стекового кода в регистровую форму.
+ *
+ * Внутри линейного участка стек операндов моделируется при трансляции:
+ * каждая его позиция - операнд (ROPND), где лежит значение. LD и CONST
+ * кладут ссылку на переменную или константу и кода не порождают, DUP,
+ * SWAP и DROP переставляют ссылки, ST либо переписывает слот результата
+ * предыдущей операции на переменную, либо становится RMOV. Арифметика,
+ * сравнения, ELEM и условные переходы порождают трехадресные инструкции
+ * QOP_R* над этими операндами, результат - в ячейку стека своей позиции.
+ * Так LD x; LD y; ADD; ST z; DROP становится одной инструкцией
+ * RADD z, x, y.
+ *
+ * Остальные инструкции остаются стековыми: перед ними (и перед метками,
+ * переходами и концом функции) все отложенные значения записываются в
+ * свои ячейки (RMOV), и стек в памяти совпадает со стековым
+ * интерпретатором. Поэтому вызовы, кадры, GC и ошибки работают без
+ * изменений. Ссылка на переменную, в которую пишет ST, сначала
+ * материализуется; запись через STA и вызовы идут после материализации.
+ *
+ * Каждая регистровая инструкция выставляет sp по высоте стека после себя
+ * (Instr.u.depth, для переходов - b), так что sp и tos на границе со
+ * стековыми инструкциями верны. Если высота изменилась без инструкции
+ * (DROP отложенного значения), она дописывается в последнюю регистровую
+ * инструкцию или выставляется QOP_RSYNC.
+ */
+
+typedef struct {
+    const QCode *q;
+    Instr *code;
+    uint32_t n, cap;
+    struct { uint32_t at, to; } *fix;   // code[at].u.target - исходная инструкция to
+    uint32_t n_fix, cap_fix;
+    void **consts;
+    uint32_t n_consts, cap_consts;
+    int *stk;                   // операнды позиций 1..h
+    int h;
+    int sp_h;                   // высота, по которой выставлен sp
+    int64_t last_reg;           // последняя инструкция - регистровая, не переход
+    int64_t last_result;        // и пишет в ячейку вершины стека
+} Trans;
+
+static void *grow(void *p, uint32_t *cap, uint32_t need, size_t elem) {
+    if (need <= *cap) return p;
+    uint32_t c = *cap ? *cap : 64;
+    while (c < need) c *= 2;
+    p = realloc(p, c * elem);
+    if (!p) {
+        fprintf(stderr, "*** FAILURE: unable to allocate memory for register code\n");
+        exit(255);
+    }
+    *cap = c;
+    return p;
+}
+
+static Instr *emit(Trans *t, const Instr *in) {
+    t->code = grow(t->code, &t->cap, t->n + 2, sizeof(Instr));
+    t->code[t->n] = *in;
+    t->last_reg = t->last_result = -1;
+    return &t->code[t->n++];
+}
+
+// Переход последней инструкции - на исходную инструкцию to
+static void fix(Trans *t, uint32_t to) {
+    t->fix = grow(t->fix, &t->cap_fix, t->n_fix + 1, sizeof(*t->fix));
+    t->fix[t->n_fix].at = t->n - 1;
+    t->fix[t->n_fix++].to = to;
+}
+
+// Регистровая инструкция; высота после нее - текущая t->h
+static void emit_reg(Trans *t, int op, int a, int b, int c, const char *src) {
+    Instr in = {0};
+    in.op = op;
+    in.a = a;
+    in.b = b;
+    in.c = c;
+    in.u.depth = t->h;
+    in.src = src;
+    emit(t, &in);
+    t->last_reg = t->n - 1;
+    t->sp_h = t->h;
+}
+
+static bool in_place(const Trans *t, int p) {
+    return t->stk[p] == ROPND_STACK(p);
+}
+
+static bool is_stack_opnd(int o) {
+    return ROPND_KIND(o) == RK_BASE && ROPND_OFF(o) <= 0;
+}
+
+static void materialize(Trans *t, int p, const char *src) {
+    emit_reg(t, QOP_RMOV, t->stk[p], 0, ROPND_STACK(p), src);
+    t->stk[p] = ROPND_STACK(p);
+}
+
+// Стек в памяти - как у стекового интерпретатора, sp выставлен
+static void flush(Trans *t, const char *src) {
+    for (int p = 1; p <= t->h; p++)
+        if (!in_place(t, p)) materialize(t, p, src);
+    if (t->sp_h == t->h) return;
+    if (t->last_reg >= 0 && t->last_reg == (int64_t) t->n - 1) {
+        t->code[t->last_reg].u.depth = t->h;
+        t->sp_h = t->h;
+    } else {
+        emit_reg(t, QOP_RSYNC, 0, 0, 0, src);
+    }
+}
+
+// Начало участка: все значения в своих ячейках
+static void reset(Trans *t, int h) {
+    t->h = t->sp_h = h;
+    for (int p = 1; p <= h; p++) t->stk[p] = ROPND_STACK(p);
+    t->last_reg = t->last_result = -1;
+}
+
+static void push(Trans *t, int o) {
+    t->stk[++t->h] = o;
+}
+
+static void store(Trans *t, int x, const char *src) {
+    int top = t->stk[t->h];
+    if (top == x) return;
+    bool hazard = false;
+    for (int p = 1; p < t->h; p++)
+        if (t->stk[p] == x) hazard = true;
+    if (!hazard && t->last_result >= 0 && t->last_result == (int64_t) t->n - 1 &&
+        t->code[t->last_result].c == top && in_place(t, t->h)) {
+        /* результат предыдущей операции пишется сразу в переменную */
+        t->code[t->last_result].c = x;
+        t->stk[t->h] = x;
+        t->last_result = -1;
+        return;
+    }
+    for (int p = 1; p < t->h; p++)
+        if (t->stk[p] == x) materialize(t, p, src);
+    emit_reg(t, QOP_RMOV, top, 0, x, src);
+}
+
+static int binop_reg(int op) {
+    switch (op) {
+        case BC_ADD: return QOP_RADD;
+        case BC_SUB: return QOP_RSUB;
+        case BC_MUL: return QOP_RMUL;
+        case BC_DIV: return QOP_RDIV;
+        case BC_MOD: return QOP_RMOD;
+        case BC_LT:  return QOP_RLT;
+        case BC_LE:  return QOP_RLE;
+        case BC_GT:  return QOP_RGT;
+        case BC_GE:  return QOP_RGE;
+        case BC_EQ:  return QOP_REQ;
+        case BC_NEQ: return QOP_RNEQ;
+        case BC_AND: return QOP_RAND;
+        case BC_OR:  return QOP_ROR;
+        case BC_ELEM: return QOP_RELEM;
+        default:     return -1;
+    }
+}
+
+static bool has_target(int op) {
+    return op == BC_JMP || op == BC_CJMPz || op == BC_CJMPnz ||
+           op == BC_CALL || op == BC_CLOSURE;
+}
+
+// Стековая инструкция как есть (суперинструкции - по исходным опкодам)
+static void copy(Trans *t, const Instr *in) {
+    const QCode *q = t->q;
+    Instr c = *in;
+    if (in->op != QOP_TAILCALL && in->op != QOP_TAILCALLC) c.op = qcode_op(in);
+    emit(t, &c);
+    if (c.op != QOP_FAULT && has_target(qcode_op(in)) && in->u.target)
+        fix(t, (uint32_t)(in->u.target - q->code));
+}
+
+QCode *regvm_translate(const QCode *q) {
+    if (!q->height) return NULL;
+    uint32_t n = q->n_code;
+    const int32_t *height = q->height;
+
+    int max_h = 0;
+    for (uint32_t k = 0; k < n; k++)
+        if (height[k] > max_h) max_h = height[k];
+
+    Trans t = {0};
+    t.q = q;
+    t.last_reg = t.last_result = -1;
+    uint32_t *map = malloc((n + 1) * sizeof(uint32_t));
+    bool *label = calloc(n + 1, sizeof(bool));
+    t.stk = malloc((max_h + 4) * sizeof(int));
+    if (!map || !label || !t.stk) {
+        fprintf(stderr, "*** FAILURE: unable to allocate memory for register code\n");
+        exit(255);
+    }
+    for (uint32_t k = 0; k < n; k++) {
+        const Instr *in = &q->code[k];
+        int op = qcode_op(in);
+        if ((op == BC_JMP || op == BC_CJMPz || op == BC_CJMPnz) && in->u.target)
+            label[in->u.target - q->code] = true;
+    }
+
+    bool known = false;     // модель стека соответствует инструкции k
+    for (uint32_t k = 0; k < n; k++) {
+        const Instr *in = &q->code[k];
+        int op = qcode_op(in);
+
+        if (height[k] < 0) {
+            /* недостижима: как есть */
+            map[k] = t.n;
+            copy(&t, in);
+            known = false;
+            continue;
+        }
+        if (!known || label[k] || op == BC_BEGIN || op == BC_CBEGIN) {
+            if (known) flush(&t, in->src);
+            reset(&t, height[k]);
+            known = true;
+        }
+        map[k] = t.n;
+
+        int rop = binop_reg(op);
+        switch (op) {
+            case BC_CONST:
+                t.consts = grow(t.consts, &t.cap_consts, t.n_consts + 1, sizeof(void *));
+                t.consts[t.n_consts] = (void *) BOX(in->a);
+                push(&t, ROPND(RK_CONST, t.n_consts++));
+                continue;
+            case BC_LD_G: push(&t, ROPND(RK_GLOBAL, -in->a)); continue;
+            case BC_LD_L: push(&t, ROPND(RK_BASE, in->a)); continue;
+            case BC_LD_A: case BC_LD_C: push(&t, ROPND(RK_ABASE, in->a)); continue;
+            case BC_ST_G: store(&t, ROPND(RK_GLOBAL, -in->a), in->src); continue;
+            case BC_ST_L: store(&t, ROPND(RK_BASE, in->a), in->src); continue;
+            case BC_ST_A: case BC_ST_C: store(&t, ROPND(RK_ABASE, in->a), in->src); continue;
+            case BC_DUP:
+                push(&t, t.stk[t.h]);
+                continue;
+            case BC_DROP:
+                t.h--;
+                continue;
+            case BC_SWAP:
+                if (!is_stack_opnd(t.stk[t.h]) && !is_stack_opnd(t.stk[t.h - 1])) {
+                    int x = t.stk[t.h];
+                    t.stk[t.h] = t.stk[t.h - 1];
+                    t.stk[t.h - 1] = x;
+                    continue;
+                }
+                break;
+            case BC_CJMPz: case BC_CJMPnz:
+                if (!in_place(&t, t.h)) {
+                    int cond = t.stk[t.h--];
+                    for (int p = 1; p <= t.h; p++)
+                        if (!in_place(&t, p)) materialize(&t, p, in->src);
+                    Instr r = {0};
+                    r.op = op == BC_CJMPz ? QOP_RCJMPz : QOP_RCJMPnz;
+                    r.a = cond;
+                    r.b = t.h;
+                    r.src = in->src;
+                    emit(&t, &r);
+                    fix(&t, (uint32_t)(in->u.target - q->code));
+                    t.sp_h = t.h;
+                    continue;
+                }
+                break;
+            default:
+                if (rop >= 0) {
+                    int s2 = t.stk[t.h--];
+                    int s1 = t.stk[t.h];
+                    emit_reg(&t, rop, s1, s2, ROPND_STACK(t.h), in->src);
+                    t.stk[t.h] = ROPND_STACK(t.h);
+                    t.last_result = t.n - 1;
+                    continue;
+                }
+                break;
+        }
+
+        /* стековая инструкция */
+        flush(&t, in->src);
+        map[k] = t.n;
+        copy(&t, in);
+        if (k + 1 < n && height[k + 1] >= 0) reset(&t, height[k + 1]);
+        else known = false;
+    }
+    map[n] = t.n;
+    emit(&t, &q->code[n]);     // сторож QOP_EOC
+    t.n--;
+
+    QCode *r = calloc(1, sizeof(QCode));
+    if (!r) {
+        fprintf(stderr, "*** FAILURE: unable to allocate memory for register code\n");
+        exit(255);
+    }
+    r->code = t.code;
+    r->n_code = t.n;
+    for (uint32_t f = 0; f < t.n_fix; f++)
+        r->code[t.fix[f].at].u.target = &r->code[map[t.fix[f].to]];
+
+    r->caps = q->n_caps ? malloc(q->n_caps * sizeof(QLoc)) : NULL;
+    r->calls = q->n_calls ? malloc(q->n_calls * sizeof(CallCache)) : NULL;
+    r->off2idx = malloc((q->code_size + 1) * sizeof(int32_t));
+    if ((q->n_caps && !r->caps) || (q->n_calls && !r->calls) || !r->off2idx) {
+        fprintf(stderr, "*** FAILURE: unable to allocate memory for register code\n");
+        exit(255);
+    }
+    if (q->n_caps) memcpy(r->caps, q->caps, q->n_caps * sizeof(QLoc));
+    r->n_caps = q->n_caps;
+    for (uint32_t i = 0; i < q->n_calls; i++) {
+        r->calls[i] = q->calls[i];
+        if (q->calls[i].entry)
+            r->calls[i].entry = &r->code[map[q->calls[i].entry - q->code]];
+    }
+    r->n_calls = q->n_calls;
+    for (uint32_t off = 0; off <= q->code_size; off++) {
+        int32_t idx = q->off2idx[off];
+        r->off2idx[off] = idx < 0 ? -1 : (int32_t) map[idx];
+    }
+    r->code_size = q->code_size;
+    r->code_ptr = q->code_ptr;
+    r->consts = t.consts;
+    r->n_consts = t.n_consts;
+    qcode_fuse(r);   // стековые участки сохраняют суперинструкции
+
+    free(t.fix);
+    free(t.stk);
+    free(label);
+    free(map);
+    return r;
+}
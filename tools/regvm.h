@@ -0,0 +1,33 @@
+#ifndef REGVM_H
+#define REGVM_H
+
+#include "quicken.h"
+
+/*
+ * Регистровая форма предекодированного кода (--regvm, см. regvm.c).
+ *
+ * Операнд регистровой инструкции - слот кадра, глобальная или константа:
+ * смещение от одной из четырех баз, упакованное с ее номером в int.
+ * Ячейки стека операндов - тоже слоты: при высоте h (проверенной
+ * verify_quickened) значение на позиции p (1..h) лежит в base[1 - p].
+ */
+
+typedef enum {
+    RK_BASE,        // base + off: локальные (off > 0) и ячейки стека (off <= 0)
+    RK_ABASE,       // abase + off: аргументы и захваты
+    RK_GLOBAL,      // stack_bottom + off (off = -индекс)
+    RK_CONST        // QCode.consts[off]
+} RegKind;
+
+#define ROPND(kind, off)    ((int)((unsigned)(off) << 2) | (kind))
+#define ROPND_KIND(o)       ((o) & 3)
+#define ROPND_OFF(o)        ((o) >> 2)
+
+// Ячейка стека операндов на позиции p
+#define ROPND_STACK(p)      ROPND(RK_BASE, 1 - (p))
+
+// Регистровая форма кода q, прошедшего verify_quickened (нужны q->height);
+// NULL, если высоты не вычислены. Точки входа ищутся в ней через qcode_at.
+QCode *regvm_translate(const QCode *q);
+
+#endif
@@ -0,0 +1,199 @@
+#include "stackmap.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+/*
+ * Живость локальных и аргументов - обратный анализ потока данных по
+ * каждой функции (участок от BEGIN/CBEGIN до следующего BEGIN/CBEGIN,
+ * переходы за его пределы quicken() не пропускает):
+ *     in(k) = (out(k) \ def(k)) | use(k),  out(k) = U in(преемник)
+ * LD читает слот, ST переписывает его, CLOSURE читает захватываемые
+ * слоты уже после выделения памяти (поэтому в карте точки GC -
+ * множество in). Слоты, адрес которых берет LDA, живы во всей функции:
+ * запись через STA по адресу анализ не видит.
+ *
+ * Карты хранятся только для точек GC. Для вызывающих кадров это место
+ * вызова (ret_pc - 1), для верхнего - текущая инструкция. У
+ * суперинструкций это исполняемая составляющая: L->pc переставляется
+ * перед каждой из них. Регистровая форма (regvm.c) перед стековыми
+ * инструкциями сбрасывает отложенные значения в память, поэтому в ее
+ * точках GC кадр тот же, что в стековом коде.
+ */
+
+static void *xalloc(size_t n) {
+    void *p = calloc(n ? n : 1, 1);
+    if (!p) {
+        fprintf(stderr, "*** FAILURE: unable to allocate memory for stack maps\n");
+        exit(255);
+    }
+    return p;
+}
+
+static bool is_begin(const Instr *in) {
+    uint8_t x = (uint8_t) *in->src;
+    return x == BC_BEGIN || x == BC_CBEGIN;
+}
+
+static bool is_gc_point(int op) {
+    switch (op) {
+        case BC_CALL: case BC_CALLC: case BC_STRING: case BC_SEXP:
+        case BC_BARRAY: case BC_CLOSURE: case BC_STRINGV:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void set_bit(uint32_t *bits, int i) {
+    bits[i >> 5] |= 1u << (i & 31);
+}
+
+// Номер бита переменной tt/idx или -1 (глобальные, захваты, неверный индекс)
+static int slot_bit(int tt, int idx, int n_locs, int n_args) {
+    if (tt == LOC_L && idx >= 0 && idx < n_locs) return idx;
+    if (tt == LOC_A && idx >= 0 && idx < n_args) return n_locs + idx;
+    return -1;
+}
+
+static void analyze(const QCode *q, StackMaps *m, uint32_t f, uint32_t e) {
+    const Instr *begin = &q->code[f];
+    int n_locs = begin->b, n_args = begin->a;
+    if (begin->op == QOP_FAULT || n_locs < 0 || n_args < 0 || n_locs + n_args == 0) return;
+
+    uint32_t words = (uint32_t)(n_locs + n_args + 31) / 32;
+    uint32_t n = e - f;
+    uint32_t *live = xalloc((size_t) n * words * sizeof(uint32_t));
+    uint32_t *use = xalloc((size_t) n * words * sizeof(uint32_t));
+    uint32_t *def = xalloc((size_t) n * words * sizeof(uint32_t));
+    uint32_t *pinned = xalloc(words * sizeof(uint32_t));
+    uint32_t *out = xalloc(words * sizeof(uint32_t));
+
+    for (uint32_t k = f; k < e; k++) {
+        const Instr *in = &q->code[k];
+        uint32_t *u = use + (k - f) * words, *d = def + (k - f) * words;
+        int op = qcode_op(in);
+        int tt = op & 0x0F, bit;
+        switch (op >> 4) {
+            case OP_LD:
+                if ((bit = slot_bit(tt, in->b, n_locs, n_args)) >= 0) set_bit(u, bit);
+                continue;
+            case OP_ST:
+                if ((bit = slot_bit(tt, in->b, n_locs, n_args)) >= 0) set_bit(d, bit);
+                continue;
+            case OP_LDA:
+                if ((bit = slot_bit(tt, in->b, n_locs, n_args)) >= 0) set_bit(pinned, bit);
+                continue;
+        }
+        if (op == BC_CLOSURE) {
+            for (int i = 0; i < in->a; i++) {
+                const QLoc *c = &q->caps[in->b + i];
+                if ((bit = slot_bit(c->tt, c->idx, n_locs, n_args)) >= 0) set_bit(u, bit);
+            }
+        }
+    }
+
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (uint32_t k = e; k-- > f; ) {
+            const Instr *in = &q->code[k];
+            int op = qcode_op(in);
+            const Instr *succ[2] = {in + 1, NULL};
+            switch (op) {
+                case BC_JMP:
+                    succ[0] = in->u.target;
+                    break;
+                case BC_CJMPz: case BC_CJMPnz:
+                    succ[1] = in->u.target;
+                    break;
+                case BC_END: case BC_FAIL: case BC_HALT: case QOP_FAULT: case QOP_EOC:
+                    succ[0] = NULL;
+                    break;
+            }
+
+            memset(out, 0, words * sizeof(uint32_t));
+            for (int j = 0; j < 2; j++) {
+                if (!succ[j]) continue;
+                uint32_t s = (uint32_t)(succ[j] - q->code);
+                if (s <= f || s >= e) continue;
+                const uint32_t *ls = live + (s - f) * words;
+                for (uint32_t w = 0; w < words; w++) out[w] |= ls[w];
+            }
+
+            uint32_t *l = live + (k - f) * words;
+            const uint32_t *u = use + (k - f) * words, *d = def + (k - f) * words;
+            for (uint32_t w = 0; w < words; w++) {
+                uint32_t v = (out[w] & ~d[w]) | u[w];
+                if (v != l[w]) {
+                    l[w] = v;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    for (uint32_t k = f; k < e; k++) {
+        if (!is_gc_point(qcode_op(&q->code[k]))) continue;
+        uint32_t need = m->n_pool + 2 + words;
+        if (need > m->cap_pool) {
+            m->cap_pool = need > 2 * m->cap_pool ? need : 2 * m->cap_pool;
+            m->pool = realloc(m->pool, m->cap_pool * sizeof(uint32_t));
+            if (!m->pool) {
+                fprintf(stderr, "*** FAILURE: unable to allocate memory for stack maps\n");
+                exit(255);
+            }
+        }
+        uint32_t *p = m->pool + m->n_pool;
+        p[0] = (uint32_t) n_locs;
+        p[1] = (uint32_t) n_args;
+        for (uint32_t w = 0; w < words; w++)
+            p[2 + w] = live[(k - f) * words + w] | pinned[w];
+        m->at[k] = (int32_t) m->n_pool;
+        m->n_pool = need;
+        m->n_maps++;
+    }
+
+    free(out);
+    free(pinned);
+    free(def);
+    free(use);
+    free(live);
+}
+
+StackMaps *stackmap_build(const QCode *q) {
+    StackMaps *m = xalloc(sizeof(StackMaps));
+    m->q = q;
+    m->at = xalloc((q->n_code + 1) * sizeof(int32_t));
+    for (uint32_t k = 0; k <= q->n_code; k++) m->at[k] = -1;
+
+    for (uint32_t f = 0; f < q->n_code; ) {
+        if (!is_begin(&q->code[f])) {
+            f++;
+            continue;
+        }
+        uint32_t e = f + 1;
+        while (e < q->n_code && !is_begin(&q->code[e])) e++;
+        analyze(q, m, f, e);
+        f = e;
+    }
+    return m;
+}
+
+void stackmap_free(StackMaps *m) {
+    if (!m) return;
+    free(m->pool);
+    free(m->at);
+    free(m);
+}
+
+bool stackmap_find(const StackMaps *m, const Instr *in, StackMap *out) {
+    const QCode *q = m->q;
+    if (in->src < q->code_ptr || in->src >= q->code_ptr + q->code_size) return false;
+    int32_t idx = q->off2idx[in->src - q->code_ptr];
+    if (idx < 0 || m->at[idx] < 0) return false;
+    const uint32_t *p = m->pool + m->at[idx];
+    out->n_locs = (int) p[0];
+    out->n_args = (int) p[1];
+    out->live = p + 2;
+    return true;
+}
@@ -0,0 +1,43 @@
+#ifndef STACKMAP_H
+#define STACKMAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "quicken.h"
+
+/*
+ * Карты стека для точного обхода корней (см. stackmap.c).
+ *
+ * Для каждой точки, где может пройти сборка (вызовы и инструкции,
+ * выделяющие память), хранится множество живых слотов кадра: бит i < n_locs -
+ * локальная i, бит n_locs + i - аргумент i. Мертвые слоты сборщик не
+ * просматривает и не обновляет: до следующего чтения в них будет запись.
+ * Захваты, функция кадра и стек операндов в карту не входят - их живость
+ * определяется раскладкой кадра (lama_CallInfo).
+ */
+
+typedef struct {
+    int n_locs, n_args;
+    const uint32_t *live;   // (n_locs + n_args) бит
+} StackMap;
+
+typedef struct {
+    const QCode *q;
+    int32_t *at;            // индекс инструкции q -> начало карты в pool, -1 - карты нет
+    uint32_t *pool;         // n_locs, n_args, биты
+    uint32_t n_pool, cap_pool;
+    uint32_t n_maps;
+} StackMaps;
+
+// Карты для всех функций q; код не обязан проходить verify_quickened
+StackMaps *stackmap_build(const QCode *q);
+void stackmap_free(StackMaps *m);
+
+// Карта инструкции in - из q или из ее регистровой формы (сопоставляются
+// по смещению в байткоде); false, если в этой точке карты нет
+bool stackmap_find(const StackMaps *m, const Instr *in, StackMap *out);
+
+#define stackmap_live(map, i)   (((map)->live[(i) >> 5] >> ((i) & 31)) & 1)
+
+#endif
@@ -1307,4 +1307,226 @@ void free_verifier_context(VerifierContext *ctx) {
     }
     
     free(ctx);
-}
\ No newline at end of file
+}
+/*
+ * Phase 6: доказательство для режима --trusted.
+ *
+ * Работает по предекодированному коду (quicken): переходы уже разрешены
+ * и не выходят за функцию, индексы глобальных, локальных переменных и
+ * аргументов уже проверены. Для каждой функции (от BEGIN/CBEGIN до
+ * следующего) высота стека операндов над базой кадра вычисляется по
+ * всем достижимым путям и проверяется, что:
+ *   - ни одна инструкция не снимает больше, чем лежит в кадре;
+ *   - в точках слияния высоты совпадают, END исполняется при высоте 1;
+ *   - управление не проваливается за конец функции;
+ *   - индексы захватов меньше числа захватов любого замыкания функции,
+ *     а CALL передает ровно n_args аргументов функции без захватов.
+ * Глубина кадра (максимальная высота плюс два слота вызова) записывается
+ * в Instr.u.depth инструкции BEGIN/CBEGIN, высоты перед инструкциями -
+ * в QCode.height (по ним строится регистровая форма, см. regvm.c).
+ */
+
+static bool quick_fail(VerificationError *err, const QCode *q, const Instr *in,
+                       const char *fmt, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buffer, sizeof(buffer), fmt, args);
+    va_end(args);
+
+    err->offset = (int)(in->src - q->code_ptr);
+    err->line = 0;
+    err->column = 0;
+    err->message = strdup(buffer);
+    return false;
+}
+
+bool verify_quickened(QCode *q, const Instr *entry, VerificationError *err) {
+    uint32_t n = q->n_code;
+    int32_t *height = malloc((n + 1) * sizeof(int32_t));
+    int32_t *func = malloc((n + 1) * sizeof(int32_t));     /* индекс BEGIN функции */
+    int32_t *n_caps = malloc((n + 1) * sizeof(int32_t));   /* по индексу BEGIN: захватов нужно */
+    uint32_t *worklist = malloc((n + 1) * sizeof(uint32_t));
+    bool ok = true;
+    if (!height || !func || !n_caps || !worklist) {
+        fprintf(stderr, "*** FAILURE: unable to allocate memory for verification\n");
+        exit(255);
+    }
+
+    /* Границы функций и число захватов, к которым обращается каждая */
+    int32_t cur = -1;
+    for (uint32_t k = 0; k < n; k++) {
+        const Instr *in = &q->code[k];
+        int op = qcode_op(in);
+        height[k] = -1;
+        if (op == BC_BEGIN || op == BC_CBEGIN) {
+            cur = k;
+            n_caps[k] = 0;
+        }
+        func[k] = cur;
+        if (cur < 0) continue;
+        if (op == BC_LD_C || op == BC_LDA_C || op == BC_ST_C) {
+            if (in->b + 1 > n_caps[cur]) n_caps[cur] = in->b + 1;
+        } else if (op == BC_CLOSURE) {
+            for (int i = 0; i < in->a; i++) {
+                const QLoc *c = &q->caps[in->b + i];
+                if (c->tt == LOC_C && c->idx + 1 > n_caps[cur]) n_caps[cur] = c->idx + 1;
+            }
+        }
+    }
+    func[n] = -2;
+    height[n] = -1;
+
+    int entry_op = entry ? qcode_op(entry) : -1;
+    uint32_t entry_idx = entry ? (uint32_t)(entry - q->code) : 0;
+    if (entry_op != BC_BEGIN && entry_op != BC_CBEGIN) {
+        ok = quick_fail(err, q, entry ? entry : q->code, "entry point is not BEGIN/CBEGIN");
+    } else if (entry->a > 2 || n_caps[entry_idx] > 0) {
+        ok = quick_fail(err, q, entry, "entry function expects %d argument(s) and %d capture(s)",
+                        entry->a, n_caps[entry_idx]);
+    }
+
+    for (uint32_t f = 0; ok && f < n; f++) {
+        int fop = qcode_op(&q->code[f]);
+        if (func[f] != (int32_t)f || (fop != BC_BEGIN && fop != BC_CBEGIN)) continue;
+
+        uint32_t n_work = 0;
+        int32_t max_height = 0;
+        height[f] = 0;
+        worklist[n_work++] = f;
+
+        while (ok && n_work > 0) {
+            uint32_t k = worklist[--n_work];
+            Instr *in = &q->code[k];
+            int op = qcode_op(in);
+            int32_t h = height[k];
+            int pop = 0, push = 0;
+            bool falls = true;
+            const Instr *target = NULL;
+
+            switch (op) {
+                case BC_ADD: case BC_SUB: case BC_MUL: case BC_DIV: case BC_MOD:
+                case BC_LT: case BC_LE: case BC_GT: case BC_GE: case BC_EQ:
+                case BC_NEQ: case BC_AND: case BC_OR:
+                case BC_ELEM: case BC_PATT_STR:
+                    pop = 2; push = 1;
+                    break;
+                case BC_CONST: case BC_STRING: case BC_READ: case BC_CLOSURE:
+                case BC_LD_G: case BC_LD_L: case BC_LD_A: case BC_LD_C:
+                    push = 1;
+                    break;
+                case BC_LDA_G: case BC_LDA_L: case BC_LDA_A: case BC_LDA_C:
+                    push = 2;
+                    break;
+                case BC_ST_G: case BC_ST_L: case BC_ST_A: case BC_ST_C:
+                case BC_TAG: case BC_ARRAY: case BC_WRITE: case BC_LENGTH: case BC_STRINGV:
+                case BC_PATT_STRING: case BC_PATT_ARRAY: case BC_PATT_SEXP:
+                case BC_PATT_REF: case BC_PATT_VAL: case BC_PATT_FUN:
+                    pop = 1; push = 1;
+                    break;
+                case BC_DUP:
+                    pop = 1; push = 2;
+                    break;
+                case BC_SWAP:
+                    pop = 2; push = 2;
+                    break;
+                case BC_DROP:
+                    pop = 1;
+                    break;
+                case BC_STA:
+                    pop = 3; push = 1;
+                    break;
+                case BC_SEXP:
+                    pop = in->b; push = 1;
+                    break;
+                case BC_BARRAY: case BC_CALL:
+                    pop = in->a; push = 1;
+                    break;
+                case BC_CALLC:
+                    pop = in->a + 1; push = 1;
+                    break;
+                case BC_JMP:
+                    falls = false;
+                    target = in->u.target;
+                    break;
+                case BC_CJMPz: case BC_CJMPnz:
+                    pop = 1;
+                    target = in->u.target;
+                    break;
+                case BC_BEGIN: case BC_CBEGIN:
+                    if (k != f)
+                        ok = quick_fail(err, q, in, "function entry inside another function");
+                    break;
+                case BC_END:
+                    if (h != 1)
+                        ok = quick_fail(err, q, in, "END with stack height %d, expected 1", h);
+                    falls = false;
+                    break;
+                case BC_FAIL:
+                    pop = 1;
+                    falls = false;
+                    break;
+                case BC_HALT: case QOP_FAULT:
+                    /* QOP_FAULT сообщает об ошибке загрузки в обоих режимах */
+                    falls = false;
+                    break;
+                default:
+                    ok = quick_fail(err, q, in, "instruction 0x%02x is not allowed in trusted code",
+                                    (uint8_t)*in->src);
+                    break;
+            }
+            if (!ok) break;
+
+            if (pop < 0) {
+                ok = quick_fail(err, q, in, "negative operand count %d", pop);
+                break;
+            }
+            if (pop > h) {
+                ok = quick_fail(err, q, in, "stack underflow: needs %d value(s), frame has %d",
+                                pop, h);
+                break;
+            }
+            int32_t next = h - pop + push;
+            if (next > max_height) max_height = next;
+
+            if (op == BC_CALL || op == BC_CLOSURE) {
+                uint32_t t = (uint32_t)(in->u.target - q->code);
+                if (op == BC_CALL && (in->u.target->a != in->a || n_caps[t] > 0)) {
+                    ok = quick_fail(err, q, in, "CALL passes %d argument(s) to a function "
+                                    "with %d argument(s) and %d capture(s)",
+                                    in->a, in->u.target->a, n_caps[t]);
+                    break;
+                }
+                if (op == BC_CLOSURE && in->a < n_caps[t]) {
+                    ok = quick_fail(err, q, in, "CLOSURE with %d capture(s), function uses %d",
+                                    in->a, n_caps[t]);
+                    break;
+                }
+            }
+
+            const Instr *succ[2] = {falls ? in + 1 : NULL, target};
+            for (int j = 0; ok && j < 2; j++) {
+                if (!succ[j]) continue;
+                uint32_t s = (uint32_t)(succ[j] - q->code);
+                if (func[s] != (int32_t)f || s == f) {
+                    ok = quick_fail(err, q, in, "control falls through the end of the function");
+                } else if (height[s] < 0) {
+                    height[s] = next;
+                    worklist[n_work++] = s;
+                } else if (height[s] != next) {
+                    ok = quick_fail(err, q, succ[j], "stack height mismatch: %d vs %d at merge point",
+                                    height[s], next);
+                }
+            }
+        }
+
+        q->code[f].u.depth = max_height + 2;
+    }
+
+    free(worklist);
+    free(n_caps);
+    free(func);
+    free(q->height);
+    q->height = height;
+    return ok;
+}
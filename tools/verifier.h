@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <stdarg.h>
 #include "bytecode_defs.h"  // Включаем общие определения
+#include "quicken.h"
 
 /* Теперь bytefile - полный тип */
 
@@ -91,4 +92,10 @@ typedef struct {
 
 VerificationResult get_verification_summary(VerifierContext *ctx);
 
+/* Доказательство для исполнения без проверок (--trusted): анализ высоты
+   стека по предекодированному коду. При успехе записывает в BEGIN/CBEGIN
+   глубину стека кадра (Instr.u.depth); при неудаче заполняет *err
+   (err->message нужно освободить). */
+bool verify_quickened(QCode *q, const Instr *entry, VerificationError *err);
+
 #endif /* VERIFIER_H */
\ No newline at end of file